@@ -35,6 +35,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_packet.h"
 #include "bgpd/bgp_fsm.h"
 #include "bgpd/bgp_mplsvpn.h"
+#include "bgpd/bgp_latency.h"
 
 /* BGP advertise attribute is used for pack same attribute update into
    one packet.  To do that we maintain attribute hash in struct
@@ -253,6 +254,9 @@ bgp_adj_out_set (struct bgp_node *rn, struct peer *peer, struct prefix *p,
   
   assert (adv->binfo == NULL);
   adv->binfo = bgp_info_lock (binfo); /* bgp_info adj_out reference */
+
+  if (bgp_latency_peer && binfo && bgp_latency_peer == binfo->peer)
+    adv->received = bgp_latency_received;
   
   if (attr)
     adv->baa = bgp_advertise_intern (peer->hash[afi][safi], attr);
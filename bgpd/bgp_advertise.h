@@ -61,6 +61,10 @@ struct bgp_advertise
 
   /* BGP info.  */
   struct bgp_info *binfo;
+
+  /* When the UPDATE from binfo's peer which led to this was received,
+     if it was.  */
+  struct timeval received;
 };
 
 /* BGP adjacency out.  */
@@ -333,8 +333,15 @@ aspath_new (void)
 void
 aspath_free (struct aspath *aspath)
 {
+  struct aspath_match *match;
+
   if (!aspath)
     return;
+  while ((match = aspath->match) != NULL)
+    {
+      aspath->match = match->next;
+      XFREE (MTYPE_AS_LIST_MATCH, match);
+    }
   if (aspath->segments)
     assegment_free_all (aspath->segments);
   if (aspath->str)
@@ -691,81 +698,129 @@ aspath_hash_alloc (void *arg)
   return aspath;
 }
 
-/* parse as-segment byte stream in struct assegment */
-static struct assegment *
-assegments_parse (struct stream *s, size_t length, int use32bit)
-{
-  struct assegment_header segh;
-  struct assegment *seg, *prev = NULL, *head = NULL;
+/* Scratch space for aspath_parse, as much as an UPDATE can carry. */
+static struct assegment parse_segs[BGP_MAX_PACKET_SIZE / ASSEGMENT_SIZE (1, 0)];
+static as_t parse_asns[BGP_MAX_PACKET_SIZE / AS16_VALUE_SIZE];
+
+/* parse as-segment byte stream into parse_segs, normalised as
+ * assegment_normalise would.  Returns bytes read, the segments are
+ * left in *head, which is NULL for an empty or malformed path.
+ */
+static size_t
+assegments_parse (struct stream *s, size_t length, int use32bit,
+                  struct assegment **head)
+{
+  u_char *pnt;
+  size_t readable;
+  struct assegment *seg, *prev = NULL;
+  as_t *as = parse_asns;
+  int nsegs = 0;
   size_t bytes = 0;
+  u_char type;
+  u_char count;
   
+  *head = NULL;
+
   /* empty aspath (ie iBGP or somesuch) */
   if (length == 0)
-    return NULL;
+    return 0;
   
   if (BGP_DEBUG (as4, AS4_SEGMENT))
     zlog_debug ("[AS4SEG] Parse aspath segment: got total byte length %lu",
 		(unsigned long) length);
+  pnt = stream_pnt (s);
+  readable = STREAM_READABLE (s);
+
   /* basic checks */
-  if ( (STREAM_READABLE(s) < length)
-      || (STREAM_READABLE(s) < AS_HEADER_SIZE) 
-      || (length % AS16_VALUE_SIZE ))
-    return NULL;
+  if ( (readable < length)
+      || (readable < AS_HEADER_SIZE) 
+      || (length % AS16_VALUE_SIZE )
+      || (length > BGP_MAX_PACKET_SIZE) )
+    return 0;
   
-  while ( (STREAM_READABLE(s) > AS_HEADER_SIZE)
+  while ( (readable - bytes > AS_HEADER_SIZE)
          && (bytes < length))
     {
       int i;
       int seg_size;
       
       /* softly softly, get the header first on its own */
-      segh.type = stream_getc (s);
-      segh.length = stream_getc (s);
+      type = pnt[bytes];
+      count = pnt[bytes + 1];
       
-      seg_size = ASSEGMENT_SIZE(segh.length, use32bit);
+      seg_size = ASSEGMENT_SIZE(count, use32bit);
 
       if (BGP_DEBUG (as4, AS4_SEGMENT))
 	zlog_debug ("[AS4SEG] Parse aspath segment: got type %d, length %d",
-                    segh.type, segh.length);
+                    type, count);
       
       /* check it.. */
       if ( ((bytes + seg_size) > length)
           /* 1771bis 4.3b: seg length contains one or more */
-          || (segh.length == 0) 
-          /* Paranoia in case someone changes type of segment length */
-          || ((sizeof segh.length > 1) && (segh.length > AS_SEGMENT_MAX)) )
+          || (count == 0) )
         {
-          if (head)
-            assegment_free_all (head);
-          return NULL;
+          *head = NULL;
+          return bytes + AS_HEADER_SIZE;
         }
       
       /* now its safe to trust lengths */
-      seg = assegment_new (segh.type, segh.length);
+      for (i = 0; i < count; i++)
+        {
+          u_char *v = pnt + bytes + AS_HEADER_SIZE
+                      + ASSEGMENT_DATA_SIZE (i, use32bit);
+          
+          as[i] = use32bit ? (as_t) v[0] << 24 | v[1] << 16 | v[2] << 8 | v[3]
+                           : (as_t) (v[0] << 8 | v[1]);
+        }
       
-      if (head)
-        prev->next = seg;
-      else /* it's the first segment */
-        head = prev = seg;
+      /* Sort values SET segments and weed out dupes, runs of
+       * AS_SEQUENCEs are merged into one.  The ASNs of all segments
+       * are contiguous, so merging is only a matter of length.
+       */
+      if (type == AS_SET || type == AS_CONFED_SET)
+        {
+          int tail = 0;
+          
+          qsort (as, count, sizeof (as_t), int_cmp);
+          for (i = 1; i < count; i++)
+            if (as[tail] != as[i])
+              as[++tail] = as[i];
+          count = tail + 1;
+        }
       
-      for (i = 0; i < segh.length; i++)
-	seg->as[i] = (use32bit) ? stream_getl (s) : stream_getw (s);
+      if (prev && prev->type == AS_SEQUENCE && type == AS_SEQUENCE)
+        prev->length += count;
+      else
+        {
+          seg = &parse_segs[nsegs++];
+          seg->next = NULL;
+          seg->as = as;
+          seg->length = count;
+          seg->type = type;
+          
+          if (prev)
+            prev->next = seg;
+          else
+            *head = seg;
+          prev = seg;
+        }
+      as += count;
 
       bytes += seg_size;
       
       if (BGP_DEBUG (as4, AS4_SEGMENT))
 	zlog_debug ("[AS4SEG] Parse aspath segment: Bytes now: %lu",
 	            (unsigned long) bytes);
-      
-      prev = seg;
     }
  
-  return assegment_normalise (head);
+  return bytes;
 }
 
 /* AS path parse function.  pnt is a pointer to byte stream and length
    is length of byte stream.  If there is same AS path in the the AS
-   path hash then return it else make new AS path structure. */
+   path hash then return it else make new AS path structure.  The path
+   is looked up as parsed into scratch space, it is only allocated when
+   not in the hash yet.  */
 struct aspath *
 aspath_parse (struct stream *s, size_t length, int use32bit)
 {
@@ -782,18 +837,13 @@ aspath_parse (struct stream *s, size_t length, int use32bit)
     return NULL;
 
   memset (&as, 0, sizeof (struct aspath));
-  as.segments = assegments_parse (s, length, use32bit);
+  if (length)
+    stream_forward_getp (s, assegments_parse (s, length, use32bit,
+                                              &as.segments));
   
   /* If already same aspath exist then return it. */
   find = hash_get (ashash, &as, aspath_hash_alloc);
   
-  /* aspath_hash_alloc dupes segments too. that probably could be
-   * optimised out.
-   */
-  assegment_free_all (as.segments);
-  if (as.str)
-    XFREE (MTYPE_AS_STR, as.str);
-  
   if (! find)
     return NULL;
   find->refcnt++;
@@ -1757,12 +1807,12 @@ unsigned int
 aspath_key_make (void *p)
 {
   struct aspath * aspath = (struct aspath *) p;
+  struct assegment *seg;
   unsigned int key = 0;
 
-  if (!aspath->str)
-    aspath_str_update (aspath);
-  
-  key = jhash (aspath->str, strlen(aspath->str), 2334325);
+  for (seg = aspath->segments; seg; seg = seg->next)
+    key = jhash2 (seg->as, seg->length,
+                  jhash_2words (seg->type, seg->length, key));
 
   return key;
 }
@@ -1797,6 +1847,7 @@ void
 aspath_init (void)
 {
   ashash = hash_create_size (32767, aspath_key_make, aspath_cmp);
+  ashash->name = "BGP AS-Path";
 }
 
 void
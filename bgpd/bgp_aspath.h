@@ -46,6 +46,16 @@ struct assegment
   u_char type;
 };
 
+/* Result of an as-path access-list for an interned AS path, kept by
+   as_list_apply until the filters change.  */
+struct aspath_match
+{
+  struct aspath_match *next;
+  void *aslist;
+  unsigned long gen;
+  int result;
+};
+
 /* AS path may be include some AsSegments.  */
 struct aspath 
 {
@@ -58,6 +68,9 @@ struct aspath
   /* String expression of AS path.  This string is used by vty output
      and AS path regular expression match.  */
   char *str;
+
+  /* Access-list results for this path, if interned.  */
+  struct aspath_match *match;
 };
 
 #define ASPATH_STR_DEFAULT_LEN 32
@@ -28,6 +28,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "stream.h"
 #include "log.h"
 #include "hash.h"
+#include "jhash.h"
 
 #include "bgpd/bgpd.h"
 #include "bgpd/bgp_attr.h"
@@ -200,6 +201,7 @@ static void
 cluster_init (void)
 {
   cluster_hash = hash_create (cluster_hash_key_make, cluster_hash_cmp);
+  cluster_hash->name = "BGP Cluster-list";
 }
 
 /* Unknown transit attribute. */
@@ -221,6 +223,20 @@ transit_hash_alloc (void *p)
   return p;
 }
 
+static void *
+transit_hash_dup (void *p)
+{
+  struct transit *val = (struct transit *) p;
+  struct transit *transit;
+
+  transit = XCALLOC (MTYPE_TRANSIT, sizeof (struct transit));
+  transit->length = val->length;
+  transit->val = XMALLOC (MTYPE_TRANSIT_VAL, val->length);
+  memcpy (transit->val, val->val, val->length);
+
+  return transit;
+}
+
 static struct transit *
 transit_intern (struct transit *transit)
 {
@@ -253,17 +269,8 @@ static unsigned int
 transit_hash_key_make (void *p)
 {
   struct transit * transit = (struct transit *) p;
-  unsigned int key = 0;
-  int length;
-  caddr_t pnt;
 
-  length = transit->length;
-  pnt = (caddr_t) transit->val;
-  
-  while (length)
-    key += pnt[--length];
-
-  return key;
+  return jhash (transit->val, transit->length, 0x6c1d93b2);
 }
 
 static int
@@ -282,6 +289,7 @@ static void
 transit_init ()
 {
   transit_hash = hash_create (transit_hash_key_make, transit_hash_cmp);
+  transit_hash->name = "BGP Transit attributes";
 }
 
 /* Attribute hash routines. */
@@ -438,6 +446,7 @@ static void
 attrhash_init ()
 {
   attrhash = hash_create (attrhash_key_make, attrhash_cmp);
+  attrhash->name = "BGP Attributes";
 }
 
 static void
@@ -1456,6 +1465,7 @@ bgp_attr_unknown (struct peer *peer, struct attr *attr, u_char flag,
 {
   bgp_size_t total;
   struct transit *transit;
+  struct transit tmp;
   struct attr_extra *attre;
 
   if (BGP_DEBUG (normal, NORMAL))
@@ -1497,14 +1507,25 @@ bgp_attr_unknown (struct peer *peer, struct attr *attr, u_char flag,
      is not set back to 0 by the current AS. */
   SET_FLAG (*startp, BGP_ATTR_FLAG_PARTIAL);
 
-  /* Store transitive attribute to the end of attr->transit. */
+  /* The first one is looked up as it is in the packet, more often
+     than not it is interned already. */
   if (! ((attre = bgp_attr_extra_get(attr))->transit) )
     {
-      attre->transit = XMALLOC (MTYPE_TRANSIT, sizeof (struct transit));
-      memset (attre->transit, 0, sizeof (struct transit));
+      tmp.length = total;
+      tmp.val = startp;
+      attre->transit = hash_get (transit_hash, &tmp, transit_hash_dup);
+      attre->transit->refcnt++;
+      return 0;
     }
 
+  /* Store transitive attribute to the end of a copy of attr->transit. */
   transit = attre->transit;
+  if (transit->refcnt)
+    {
+      attre->transit = transit_hash_dup (transit);
+      transit_unintern (transit);
+      transit = attre->transit;
+    }
 
   if (transit->val)
     transit->val = XREALLOC (MTYPE_TRANSIT_VAL, transit->val, 
@@ -1760,8 +1781,9 @@ bgp_attr_parse (struct peer *peer, struct attr *attr, bgp_size_t size,
 	return ret;
     }
 
-  /* Finally intern unknown attribute. */
-  if (attr->extra && attr->extra->transit)
+  /* Finally intern unknown attributes, unless there was only one and
+     it was looked up already. */
+  if (attr->extra && attr->extra->transit && ! attr->extra->transit->refcnt)
     attr->extra->transit = transit_intern (attr->extra->transit);
 
   return 0;
@@ -1802,6 +1824,32 @@ bgp_attr_check (struct peer *peer, struct attr *attr)
 
 int stream_put_prefix (struct stream *, struct prefix *);
 
+/* Bytes P takes in MP_REACH_NLRI or MP_UNREACH_NLRI. */
+size_t
+bgp_packet_mpattr_prefix_size (safi_t safi, struct prefix *p)
+{
+  /* VPN prefixes carry a label and route distinguisher too. */
+  if (safi == SAFI_MPLS_VPN)
+    return 1 + 3 + 8 + PSIZE (p->prefixlen);
+  return 1 + PSIZE (p->prefixlen);
+}
+
+/* Put P into the NLRI of an MP_REACH_NLRI or MP_UNREACH_NLRI. */
+void
+bgp_packet_mpattr_prefix (struct stream *s, struct prefix *p, safi_t safi,
+			  struct prefix_rd *prd, u_char *tag)
+{
+  if (safi == SAFI_MPLS_VPN)
+    {
+      stream_putc (s, p->prefixlen + 88);
+      stream_put (s, tag, 3);
+      stream_put (s, prd->val, 8);
+      stream_put (s, &p->u.prefix, PSIZE (p->prefixlen));
+    }
+  else
+    stream_put_prefix (s, p);
+}
+
 /* Make attribute packet. */
 bgp_size_t
 bgp_packet_attribute (struct bgp *bgp, struct peer *peer,
@@ -2032,10 +2080,10 @@ bgp_packet_attribute (struct bgp *bgp, struct peer *peer,
       
       assert (attr->extra);
       
-      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL);
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL|BGP_ATTR_FLAG_EXTLEN);
       stream_putc (s, BGP_ATTR_MP_REACH_NLRI);
       sizep = stream_get_endp (s);
-      stream_putc (s, 0);	/* Marker: Attribute length. */
+      stream_putw (s, 0);	/* Marker: Attribute length. */
       stream_putw (s, AFI_IP6);	/* AFI */
       stream_putc (s, safi);	/* SAFI */
 
@@ -2053,10 +2101,10 @@ bgp_packet_attribute (struct bgp *bgp, struct peer *peer,
       stream_putc (s, 0);
 
       /* Prefix write. */
-      stream_put_prefix (s, p);
+      bgp_packet_mpattr_prefix (s, p, safi, prd, tag);
 
       /* Set MP attribute length. */
-      stream_putc_at (s, sizep, (stream_get_endp (s) - sizep) - 1);
+      stream_putw_at (s, sizep, (stream_get_endp (s) - sizep) - 2);
     }
 #endif /* HAVE_IPV6 */
 
@@ -2064,10 +2112,10 @@ bgp_packet_attribute (struct bgp *bgp, struct peer *peer,
     {
       unsigned long sizep;
 
-      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL);
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL|BGP_ATTR_FLAG_EXTLEN);
       stream_putc (s, BGP_ATTR_MP_REACH_NLRI);
       sizep = stream_get_endp (s);
-      stream_putc (s, 0);	/* Marker: Attribute Length. */
+      stream_putw (s, 0);	/* Marker: Attribute Length. */
       stream_putw (s, AFI_IP);	/* AFI */
       stream_putc (s, SAFI_MULTICAST);	/* SAFI */
 
@@ -2078,20 +2126,20 @@ bgp_packet_attribute (struct bgp *bgp, struct peer *peer,
       stream_putc (s, 0);
 
       /* Prefix write. */
-      stream_put_prefix (s, p);
+      bgp_packet_mpattr_prefix (s, p, safi, prd, tag);
 
       /* Set MP attribute length. */
-      stream_putc_at (s, sizep, (stream_get_endp (s) - sizep) - 1);
+      stream_putw_at (s, sizep, (stream_get_endp (s) - sizep) - 2);
     }
 
   if (p->family == AF_INET && safi == SAFI_MPLS_VPN)
     {
       unsigned long sizep;
 
-      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL);
+      stream_putc (s, BGP_ATTR_FLAG_OPTIONAL|BGP_ATTR_FLAG_EXTLEN);
       stream_putc (s, BGP_ATTR_MP_REACH_NLRI);
       sizep = stream_get_endp (s);
-      stream_putc (s, 0);	/* Length of this attribute. */
+      stream_putw (s, 0);	/* Length of this attribute. */
       stream_putw (s, AFI_IP);	/* AFI */
       stream_putc (s, BGP_SAFI_VPNV4);	/* SAFI */
 
@@ -2104,13 +2152,10 @@ bgp_packet_attribute (struct bgp *bgp, struct peer *peer,
       stream_putc (s, 0);
 
       /* Tag, RD, Prefix write. */
-      stream_putc (s, p->prefixlen + 88);
-      stream_put (s, tag, 3);
-      stream_put (s, prd->val, 8);
-      stream_put (s, &p->u.prefix, PSIZE (p->prefixlen));
+      bgp_packet_mpattr_prefix (s, p, safi, prd, tag);
 
       /* Set MP attribute length. */
-      stream_putc_at (s, sizep, (stream_get_endp (s) - sizep) - 1);
+      stream_putw_at (s, sizep, (stream_get_endp (s) - sizep) - 2);
     }
 
   /* Extended Communities attribute. */
@@ -2263,37 +2308,24 @@ bgp_packet_withdraw (struct peer *peer, struct stream *s, struct prefix *p,
 
   cp = stream_get_endp (s);
 
-  stream_putc (s, BGP_ATTR_FLAG_OPTIONAL);
+  /* Extended length, as bgp_withdraw_packet adds more prefixes. */
+  stream_putc (s, BGP_ATTR_FLAG_OPTIONAL|BGP_ATTR_FLAG_EXTLEN);
   stream_putc (s, BGP_ATTR_MP_UNREACH_NLRI);
 
   attrlen_pnt = stream_get_endp (s);
-  stream_putc (s, 0);		/* Length of this attribute. */
+  stream_putw (s, 0);		/* Length of this attribute. */
 
   stream_putw (s, family2afi (p->family));
 
-  if (safi == SAFI_MPLS_VPN)
-    {
-      /* SAFI */
-      stream_putc (s, BGP_SAFI_VPNV4);
-
-      /* prefix. */
-      stream_putc (s, p->prefixlen + 88);
-      stream_put (s, tag, 3);
-      stream_put (s, prd->val, 8);
-      stream_put (s, &p->u.prefix, PSIZE (p->prefixlen));
-    }
-  else
-    {
-      /* SAFI */
-      stream_putc (s, safi);
+  /* SAFI */
+  stream_putc (s, safi == SAFI_MPLS_VPN ? BGP_SAFI_VPNV4 : safi);
 
-      /* prefix */
-      stream_put_prefix (s, p);
-    }
+  /* prefix */
+  bgp_packet_mpattr_prefix (s, p, safi, prd, tag);
 
   /* Set MP attribute length. */
-  size = stream_get_endp (s) - attrlen_pnt - 1;
-  stream_putc_at (s, attrlen_pnt, size);
+  size = stream_get_endp (s) - attrlen_pnt - 2;
+  stream_putw_at (s, attrlen_pnt, size);
 
   return stream_get_endp (s) - cp;
 }
@@ -158,6 +158,9 @@ extern bgp_size_t bgp_packet_attribute (struct bgp *bgp, struct peer *,
                                  struct stream *, struct attr *, 
                                  struct prefix *, afi_t, safi_t, 
                                  struct peer *, struct prefix_rd *, u_char *);
+extern size_t bgp_packet_mpattr_prefix_size (safi_t, struct prefix *);
+extern void bgp_packet_mpattr_prefix (struct stream *, struct prefix *,
+				      safi_t, struct prefix_rd *, u_char *);
 extern bgp_size_t bgp_packet_withdraw (struct peer *peer, struct stream *s, 
                                 struct prefix *p, afi_t, safi_t, 
                                 struct prefix_rd *, u_char *);
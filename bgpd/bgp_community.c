@@ -22,6 +22,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 #include "hash.h"
 #include "memory.h"
+#include "jhash.h"
 
 #include "bgpd/bgp_community.h"
 
@@ -339,12 +340,23 @@ community_unintern (struct community *com)
     }
 }
 
+static void *
+community_hash_alloc (void *arg)
+{
+  struct community *com;
+
+  com = community_dup (arg);
+  com->str = community_com2str (com);
+  return com;
+}
+
 /* Create new community attribute. */
 struct community *
 community_parse (u_int32_t *pnt, u_short length)
 {
   struct community tmp;
   struct community *new;
+  int i;
 
   /* If length is malformed return NULL. */
   if (length % 4)
@@ -354,6 +366,18 @@ community_parse (u_int32_t *pnt, u_short length)
   tmp.size = length / 4;
   tmp.val = pnt;
 
+  /* Most arrive sorted and without duplicates, as kept in the hash,
+     and can be looked up as they are.  */
+  for (i = 1; i < tmp.size; i++)
+    if (community_compare (&pnt[i - 1], &pnt[i]) >= 0)
+      break;
+  if (i >= tmp.size)
+    {
+      new = hash_get (comhash, &tmp, community_hash_alloc);
+      new->refcnt++;
+      return new;
+    }
+
   new = community_uniq_sort (&tmp);
 
   return community_intern (new);
@@ -393,17 +417,7 @@ community_str (struct community *com)
 unsigned int
 community_hash_make (struct community *com)
 {
-  int c;
-  unsigned int key;
-  unsigned char *pnt;
-
-  key = 0;
-  pnt = (unsigned char *)com->val;
-  
-  for(c = 0; c < com->size * 4; c++)
-    key += pnt[c];
-      
-  return key;
+  return jhash (com->val, com->size * 4, 0x5ab3a5f1);
 }
 
 int
@@ -634,4 +648,5 @@ void
 community_init (void)
 {
   comhash = hash_create (community_hash_make, community_cmp);
+  comhash->name = "BGP Community";
 }
@@ -27,6 +27,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "prefix.h"
 #include "thread.h"
 #include "linklist.h"
+#include "workqueue.h"
 #include "bgpd/bgp_table.h"
 
 #include "bgpd/bgpd.h"
@@ -73,6 +74,38 @@ struct bgp_dump
   char *interval_str;
 
   struct thread *t_interval;
+
+  /* Flushes what was written since the last flush. */
+  struct thread *t_flush;
+};
+
+/* Seconds messages are kept in the file buffer before being flushed,
+   instead of flushing after each.  */
+#define BGP_DUMP_FLUSH_INTERVAL 1
+
+/* Routes dumped each time the routes dump runs, between which other
+   work gets done.  */
+#define BGP_DUMP_ROUTES_CHUNK 1000
+
+/* A routes dump in progress. */
+struct bgp_dump_routes_walk
+{
+  /* Instance being dumped, NULL when not dumping. */
+  struct bgp *bgp;
+
+  /* Next route to dump, locked. */
+  afi_t afi;
+  struct bgp_node *rn;
+
+  /* Sequence number of the next RIB entry. */
+  unsigned int seq;
+
+  /* Number of the dump, counting from 1.  Peers come and go while it
+     goes on, only paths of those in its PEER_INDEX_TABLE are dumped. */
+  unsigned int dump;
+
+  /* On the work queue. */
+  int queued;
 };
 
 /* BGP packet dump output buffer. */
@@ -87,8 +120,10 @@ struct bgp_dump bgp_dump_updates;
 /* BGP dump structure for 'dump bgp routes' */
 struct bgp_dump bgp_dump_routes;
 
-/* Dump whole BGP table is very heavy process.  */
-struct thread *t_bgp_dump_routes;
+/* Dump whole BGP table is very heavy process, so it is done a chunk
+   at a time from a work queue.  */
+static struct bgp_dump_routes_walk bgp_dump_routes_walk;
+static struct work_queue *bgp_dump_routes_queue;
 
 /* Some define for BGP packet dump. */
 static FILE *
@@ -192,8 +227,33 @@ bgp_dump_set_size (struct stream *s, int type)
   stream_putl_at (s, 8, stream_get_endp (s) - BGP_DUMP_HEADER_SIZE);
 }
 
+static int
+bgp_dump_flush_timer (struct thread *t)
+{
+  struct bgp_dump *bgp_dump;
+
+  bgp_dump = THREAD_ARG (t);
+  bgp_dump->t_flush = NULL;
+
+  if (bgp_dump->fp)
+    fflush (bgp_dump->fp);
+  return 0;
+}
+
+/* Write a message to the file through its buffer, to be flushed
+   later rather than now.  */
 static void
-bgp_dump_routes_index_table(struct bgp *bgp)
+bgp_dump_write (struct bgp_dump *bgp_dump, struct stream *obuf)
+{
+  fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump->fp);
+
+  if (! bgp_dump->t_flush)
+    bgp_dump->t_flush = thread_add_timer (master, bgp_dump_flush_timer,
+					  bgp_dump, BGP_DUMP_FLUSH_INTERVAL);
+}
+
+static void
+bgp_dump_routes_index_table(struct bgp *bgp, unsigned int dump)
 {
   struct peer *peer;
   struct listnode *node;
@@ -261,121 +321,201 @@ bgp_dump_routes_index_table(struct bgp *bgp)
 
       /* Store the peer number for this peer */
       peer->table_dump_index = peerno;
+      peer->table_dump_seq = dump;
       peerno++;
     }
 
   bgp_dump_set_size(obuf, MSG_TABLE_DUMP_V2);
 
   fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump_routes.fp);
-  fflush (bgp_dump_routes.fp);
 }
 
 
-/* Runs under child process. */
-static unsigned int
-bgp_dump_routes_func (int afi, int first_run, unsigned int seq)
+/* Dump the RIB entry for a route, with the paths of the peers indexed
+   for the dump.  Returns 0 if there are none, and nothing is dumped. */
+static int
+bgp_dump_routes_node (struct bgp_node *rn, afi_t afi, unsigned int seq,
+		      unsigned int dump)
 {
   struct stream *obuf;
   struct bgp_info *info;
-  struct bgp_node *rn;
-  struct bgp *bgp;
-  struct bgp_table *table;
-
-  bgp = bgp_get_default ();
-  if (!bgp)
-    return seq;
-
-  if (bgp_dump_routes.fp == NULL)
-    return seq;
-
-  /* Note that bgp_dump_routes_index_table will do ipv4 and ipv6 peers,
-     so this should only be done on the first call to bgp_dump_routes_func.
-     ( this function will be called once for ipv4 and once for ipv6 ) */
-  if(first_run)
-    bgp_dump_routes_index_table(bgp);
 
   obuf = bgp_dump_obuf;
   stream_reset(obuf);
 
-  /* Walk down each BGP route. */
-  table = bgp->rib[afi][SAFI_UNICAST];
-
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+  /* MRT header */
+  if (afi == AFI_IP)
     {
-      if(!rn->info)
-        continue;
+      bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV4_UNICAST);
+    }
+#ifdef HAVE_IPV6
+  else if (afi == AFI_IP6)
+    {
+      bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV6_UNICAST);
+    }
+#endif /* HAVE_IPV6 */
 
-      stream_reset(obuf);
+  /* Sequence number */
+  stream_putl(obuf, seq);
 
-      /* MRT header */
-      if (afi == AFI_IP)
-        {
-          bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV4_UNICAST);
-        }
+  /* Prefix length */
+  stream_putc (obuf, rn->p.prefixlen);
+
+  /* Prefix */
+  if (afi == AFI_IP)
+    {
+      /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
+      stream_write(obuf, (u_char *)&rn->p.u.prefix4, (rn->p.prefixlen+7)/8);
+    }
 #ifdef HAVE_IPV6
-      else if (afi == AFI_IP6)
-        {
-          bgp_dump_header (obuf, MSG_TABLE_DUMP_V2, TABLE_DUMP_V2_RIB_IPV6_UNICAST);
-        }
+  else if (afi == AFI_IP6)
+    {
+      /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
+      stream_write (obuf, (u_char *)&rn->p.u.prefix6, (rn->p.prefixlen+7)/8);
+    }
 #endif /* HAVE_IPV6 */
 
-      /* Sequence number */
-      stream_putl(obuf, seq);
+  /* Save where we are now, so we can overwride the entry count later */
+  int sizep = stream_get_endp(obuf);
 
-      /* Prefix length */
-      stream_putc (obuf, rn->p.prefixlen);
+  /* Entry count */
+  uint16_t entry_count = 0;
 
-      /* Prefix */
-      if (afi == AFI_IP)
-        {
-          /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
-          stream_write(obuf, (u_char *)&rn->p.u.prefix4, (rn->p.prefixlen+7)/8);
-        }
+  /* Entry count, note that this is overwritten later */
+  stream_putw(obuf, 0);
+
+  for (info = rn->info; info; info = info->next)
+    {
+      if (info->peer->table_dump_seq != dump)
+	continue;
+
+      entry_count++;
+
+      /* Peer index */
+      stream_putw(obuf, info->peer->table_dump_index);
+
+      /* Originated */
+      stream_putl (obuf, info->uptime);
+
+      /* Dump attribute. */
+      /* Skip prefix & AFI/SAFI for MP_NLRI */
+      bgp_dump_routes_attr (obuf, info->attr, &rn->p);
+    }
+
+  if (entry_count == 0)
+    return 0;
+
+  /* Overwrite the entry count, now that we know the right number */
+  stream_putw_at (obuf, sizep, entry_count);
+
+  bgp_dump_set_size(obuf, MSG_TABLE_DUMP_V2);
+  fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump_routes.fp);
+  return 1;
+}
+
+/* Dump the next chunk of routes, IPv4 then IPv6.  */
+static wq_item_status
+bgp_dump_routes_func (struct work_queue *wq, void *data)
+{
+  struct bgp_dump_routes_walk *walk = data;
+  int i;
+
+  for (i = 0; walk->bgp && i < BGP_DUMP_ROUTES_CHUNK; i++)
+    {
+      if (walk->rn == NULL)
+	{
 #ifdef HAVE_IPV6
-      else if (afi == AFI_IP6)
-        {
-          /* We'll dump only the useful bits (those not 0), but have to align on 8 bits */
-          stream_write (obuf, (u_char *)&rn->p.u.prefix6, (rn->p.prefixlen+7)/8);
-        }
+	  if (walk->afi == AFI_IP)
+	    {
+	      walk->afi = AFI_IP6;
+	      walk->rn = bgp_table_top (walk->bgp->rib[AFI_IP6][SAFI_UNICAST]);
+	      continue;
+	    }
 #endif /* HAVE_IPV6 */
 
-      /* Save where we are now, so we can overwride the entry count later */
-      int sizep = stream_get_endp(obuf);
+	  /* Close the file now. For a RIB dump there's no point in leaving
+	   * it open until the next scheduled dump starts. */
+	  fclose (bgp_dump_routes.fp);
+	  bgp_dump_routes.fp = NULL;
+	  walk->bgp = NULL;
+	  break;
+	}
 
-      /* Entry count */
-      uint16_t entry_count = 0;
+      if (walk->rn->info
+	  && bgp_dump_routes_node (walk->rn, walk->afi, walk->seq, walk->dump))
+	walk->seq++;
+      walk->rn = bgp_route_next (walk->rn);
+    }
 
-      /* Entry count, note that this is overwritten later */
-      stream_putw(obuf, 0);
+  /* Done, or stopped by bgp_dump_routes_stop.  */
+  if (walk->bgp == NULL)
+    {
+      walk->queued = 0;
+      return WQ_SUCCESS;
+    }
+  return WQ_REQUEUE;
+}
 
-      for (info = rn->info; info; info = info->next)
-        {
-          entry_count++;
+static void
+bgp_dump_routes_start (void)
+{
+  struct bgp_dump_routes_walk *walk = &bgp_dump_routes_walk;
+  struct bgp *bgp;
 
-          /* Peer index */
-          stream_putw(obuf, info->peer->table_dump_index);
+  bgp = bgp_get_default ();
+  if (!bgp)
+    {
+      fclose (bgp_dump_routes.fp);
+      bgp_dump_routes.fp = NULL;
+      return;
+    }
 
-          /* Originated */
-          stream_putl (obuf, info->uptime);
+  /* Note that bgp_dump_routes_index_table will do ipv4 and ipv6 peers. */
+  walk->dump++;
+  bgp_dump_routes_index_table (bgp, walk->dump);
 
-          /* Dump attribute. */
-          /* Skip prefix & AFI/SAFI for MP_NLRI */
-          bgp_dump_routes_attr (obuf, info->attr, &rn->p);
-        }
+  walk->bgp = bgp;
+  walk->afi = AFI_IP;
+  walk->rn = bgp_table_top (bgp->rib[AFI_IP][SAFI_UNICAST]);
+  walk->seq = 0;
 
-      /* Overwrite the entry count, now that we know the right number */
-      stream_putw_at (obuf, sizep, entry_count);
+  if (! bgp_dump_routes_queue)
+    {
+      bgp_dump_routes_queue = work_queue_new (master, "bgp_dump_routes");
+      bgp_dump_routes_queue->spec.workfunc = &bgp_dump_routes_func;
+      bgp_dump_routes_queue->spec.max_retries = 0;
+      bgp_dump_routes_queue->spec.hold = 10;
+    }
 
-      seq++;
+  /* A dump stopped early may still be queued, it carries on with
+     this one.  */
+  if (! walk->queued)
+    {
+      work_queue_add (bgp_dump_routes_queue, walk);
+      walk->queued = 1;
+    }
+}
 
-      bgp_dump_set_size(obuf, MSG_TABLE_DUMP_V2);
-      fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump_routes.fp);
+/* Stop a routes dump in progress of BGP, or of any instance if BGP is
+   NULL.  */
+void
+bgp_dump_routes_stop (struct bgp *bgp)
+{
+  struct bgp_dump_routes_walk *walk = &bgp_dump_routes_walk;
 
-    }
+  if (walk->bgp == NULL || (bgp && walk->bgp != bgp))
+    return;
 
-  fflush (bgp_dump_routes.fp);
+  if (walk->rn)
+    bgp_unlock_node (walk->rn);
+  walk->rn = NULL;
+  walk->bgp = NULL;
 
-  return seq;
+  if (bgp_dump_routes.fp)
+    {
+      fclose (bgp_dump_routes.fp);
+      bgp_dump_routes.fp = NULL;
+    }
 }
 
 static int
@@ -385,20 +525,15 @@ bgp_dump_interval_func (struct thread *t)
   bgp_dump = THREAD_ARG (t);
   bgp_dump->t_interval = NULL;
 
+  /* The last routes dump has to finish before the next starts. */
+  if (bgp_dump->type == BGP_DUMP_ROUTES && bgp_dump_routes_walk.bgp)
+    zlog_warn ("bgp_dump: routes dump still running, skipping this one");
   /* Reschedule dump even if file couldn't be opened this time... */
-  if (bgp_dump_open_file (bgp_dump) != NULL)
+  else if (bgp_dump_open_file (bgp_dump) != NULL)
     {
       /* In case of bgp_dump_routes, we need special route dump function. */
       if (bgp_dump->type == BGP_DUMP_ROUTES)
-	{
-	  unsigned int seq = bgp_dump_routes_func (AFI_IP, 1, 0);
-#ifdef HAVE_IPV6
-	  bgp_dump_routes_func (AFI_IP6, 0, seq);
-#endif /* HAVE_IPV6 */
-	  /* Close the file now. For a RIB dump there's no point in leaving
-	   * it open until the next scheduled dump starts. */
-	  fclose(bgp_dump->fp); bgp_dump->fp = NULL;
-	}
+	bgp_dump_routes_start ();
     }
 
   /* if interval is set reschedule */
@@ -480,8 +615,7 @@ bgp_dump_state (struct peer *peer, int status_old, int status_new)
   bgp_dump_set_size (obuf, MSG_PROTOCOL_BGP4MP);
 
   /* Write to the stream. */
-  fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump_all.fp);
-  fflush (bgp_dump_all.fp);
+  bgp_dump_write (&bgp_dump_all, obuf);
 }
 
 static void
@@ -516,8 +650,7 @@ bgp_dump_packet_func (struct bgp_dump *bgp_dump, struct peer *peer,
   bgp_dump_set_size (obuf, MSG_PROTOCOL_BGP4MP);
 
   /* Write to the stream. */
-  fwrite (STREAM_DATA (obuf), stream_get_endp (obuf), 1, bgp_dump->fp);
-  fflush (bgp_dump->fp);
+  bgp_dump_write (bgp_dump, obuf);
 }
 
 /* Called from bgp_packet.c when BGP packet is received. */
@@ -617,6 +750,10 @@ bgp_dump_set (struct vty *vty, struct bgp_dump *bgp_dump,
       interval = 0;
     }
     
+  /* Not into the file being replaced. */
+  if (bgp_dump == &bgp_dump_routes)
+    bgp_dump_routes_stop (NULL);
+
   /* Create interval thread. */
   bgp_dump_interval_add (bgp_dump, interval);
 
@@ -637,6 +774,9 @@ bgp_dump_set (struct vty *vty, struct bgp_dump *bgp_dump,
 static int
 bgp_dump_unset (struct vty *vty, struct bgp_dump *bgp_dump)
 {
+  if (bgp_dump == &bgp_dump_routes)
+    bgp_dump_routes_stop (NULL);
+
   /* Set file name. */
   if (bgp_dump->filename)
     {
@@ -657,6 +797,11 @@ bgp_dump_unset (struct vty *vty, struct bgp_dump *bgp_dump)
       thread_cancel (bgp_dump->t_interval);
       bgp_dump->t_interval = NULL;
     }
+  if (bgp_dump->t_flush)
+    {
+      thread_cancel (bgp_dump->t_flush);
+      bgp_dump->t_flush = NULL;
+    }
 
   bgp_dump->interval = 0;
 
@@ -50,5 +50,6 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 extern void bgp_dump_init (void);
 extern void bgp_dump_state (struct peer *, int, int);
 extern void bgp_dump_packet (struct peer *, int, struct stream *);
+extern void bgp_dump_routes_stop (struct bgp *);
 
 #endif /* _QUAGGA_BGP_DUMP_H */
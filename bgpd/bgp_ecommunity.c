@@ -22,6 +22,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 #include "hash.h"
 #include "memory.h"
+#include "jhash.h"
 #include "prefix.h"
 #include "command.h"
 
@@ -118,12 +119,23 @@ ecommunity_uniq_sort (struct ecommunity *ecom)
   return new;
 }
 
+static void *
+ecommunity_hash_alloc (void *arg)
+{
+  struct ecommunity *ecom;
+
+  ecom = ecommunity_dup (arg);
+  ecom->str = ecommunity_ecom2str (ecom, ECOMMUNITY_FORMAT_DISPLAY);
+  return ecom;
+}
+
 /* Parse Extended Communites Attribute in BGP packet.  */
 struct ecommunity *
 ecommunity_parse (u_int8_t *pnt, u_short length)
 {
   struct ecommunity tmp;
   struct ecommunity *new;
+  int i;
 
   /* Length check.  */
   if (length % ECOMMUNITY_SIZE)
@@ -134,6 +146,19 @@ ecommunity_parse (u_int8_t *pnt, u_short length)
   tmp.size = length / ECOMMUNITY_SIZE;
   tmp.val = pnt;
 
+  /* Already sorted and without duplicates, it can be looked up as it
+     is.  */
+  for (i = 1; i < tmp.size; i++)
+    if (memcmp (pnt + (i - 1) * ECOMMUNITY_SIZE, pnt + i * ECOMMUNITY_SIZE,
+		ECOMMUNITY_SIZE) >= 0)
+      break;
+  if (i >= tmp.size)
+    {
+      new = hash_get (ecomhash, &tmp, ecommunity_hash_alloc);
+      new->refcnt++;
+      return new;
+    }
+
   /* Create a new Extended Communities Attribute by uniq and sort each
      Extended Communities value  */
   new = ecommunity_uniq_sort (&tmp);
@@ -232,17 +257,8 @@ unsigned int
 ecommunity_hash_make (void *arg)
 {
   const struct ecommunity *ecom = arg;
-  int c;
-  unsigned int key;
-  u_int8_t *pnt;
-
-  key = 0;
-  pnt = ecom->val;
-  
-  for (c = 0; c < ecom->size * ECOMMUNITY_SIZE; c++)
-    key += pnt[c];
 
-  return key;
+  return jhash (ecom->val, ecom->size * ECOMMUNITY_SIZE, 0x2d4e1a73);
 }
 
 /* Compare two Extended Communities Attribute structure.  */
@@ -263,6 +279,7 @@ void
 ecommunity_init (void)
 {
   ecomhash = hash_create (ecommunity_hash_make, ecommunity_cmp);
+  ecomhash->name = "BGP Ext-Community";
 }
 
 /* Extended Communities token enum. */
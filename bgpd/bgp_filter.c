@@ -95,6 +95,10 @@ static struct as_list_master as_list_master =
   NULL
 };
 
+/* Bumped whenever a filter is added or deleted, so that the results
+   remembered in AS paths by as_list_apply are no longer used.  */
+static unsigned long as_list_gen = 1;
+
 /* Allocate new AS filter. */
 static struct as_filter *
 as_filter_new ()
@@ -146,6 +150,8 @@ as_filter_lookup (struct as_list *aslist, const char *reg_str,
 static void
 as_list_filter_add (struct as_list *aslist, struct as_filter *asfilter)
 {
+  as_list_gen++;
+
   asfilter->next = NULL;
   asfilter->prev = aslist->tail;
 
@@ -316,6 +322,8 @@ as_list_delete (struct as_list *aslist)
   struct as_list_list *list;
   struct as_filter *filter, *next;
 
+  as_list_gen++;
+
   for (filter = aslist->head; filter; filter = next)
     {
       next = filter->next;
@@ -352,6 +360,8 @@ as_list_empty (struct as_list *aslist)
 static void
 as_list_filter_delete (struct as_list *aslist, struct as_filter *asfilter)
 {
+  as_list_gen++;
+
   if (asfilter->next)
     asfilter->next->prev = asfilter->prev;
   else
@@ -381,24 +391,63 @@ as_filter_match (struct as_filter *asfilter, struct aspath *aspath)
   return 0;
 }
 
-/* Apply AS path filter to AS. */
+static enum as_filter_type
+as_list_match (struct as_list *aslist, struct aspath *aspath)
+{
+  struct as_filter *asfilter;
+
+  for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
+    {
+      if (as_filter_match (asfilter, aspath))
+	return asfilter->type;
+    }
+  return AS_FILTER_DENY;
+}
+
+/* Apply AS path filter to AS.  Many routes share each interned AS
+   path, so the result is remembered in the path and the regular
+   expressions run once per path rather than once per route.  */
 enum as_filter_type
 as_list_apply (struct as_list *aslist, void *object)
 {
-  struct as_filter *asfilter;
   struct aspath *aspath;
+  struct aspath_match *match;
+  struct aspath_match **prev;
+  enum as_filter_type type;
 
   aspath = (struct aspath *) object;
 
   if (aslist == NULL)
     return AS_FILTER_DENY;
 
-  for (asfilter = aslist->head; asfilter; asfilter = asfilter->next)
+  /* Paths not interned yet may still be changed. */
+  if (aspath->refcnt == 0)
+    return as_list_match (aslist, aspath);
+
+  prev = &aspath->match;
+  while ((match = *prev) != NULL)
     {
-      if (as_filter_match (asfilter, aspath))
-	return asfilter->type;
+      if (match->gen != as_list_gen)
+	{
+	  *prev = match->next;
+	  XFREE (MTYPE_AS_LIST_MATCH, match);
+	  continue;
+	}
+      if (match->aslist == aslist)
+	return match->result;
+      prev = &match->next;
     }
-  return AS_FILTER_DENY;
+
+  type = as_list_match (aslist, aspath);
+
+  match = XMALLOC (MTYPE_AS_LIST_MATCH, sizeof (struct aspath_match));
+  match->aslist = aslist;
+  match->gen = as_list_gen;
+  match->result = type;
+  match->next = aspath->match;
+  aspath->match = match;
+
+  return type;
 }
 
 /* Add hook function. */
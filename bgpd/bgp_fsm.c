@@ -40,6 +40,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_route.h"
 #include "bgpd/bgp_dump.h"
 #include "bgpd/bgp_open.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_latency.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -437,6 +439,8 @@ bgp_stop (struct peer *peer)
   /* Delete all existing events of the peer */
   BGP_EVENT_FLUSH (peer);
 
+  update_group_leave (peer);
+
   /* Increment Dropped count. */
   if (peer->status == Established)
     {
@@ -511,6 +515,8 @@ bgp_stop (struct peer *peer)
   /* Clear input and output buffer.  */
   if (peer->ibuf)
     stream_reset (peer->ibuf);
+  if (peer->ibuf_work)
+    stream_reset (peer->ibuf_work);
   if (peer->work)
     stream_reset (peer->work);
   if (peer->obuf)
@@ -784,6 +790,7 @@ bgp_establish (struct peer *peer)
 
   /* Increment established count. */
   peer->established++;
+  bgp_latency_reset (peer->latency);
   bgp_fsm_change_status (peer, Established);
 
   /* bgp log-neighbor-changes of neighbor Up */
@@ -865,6 +872,12 @@ bgp_establish (struct peer *peer)
 	    || CHECK_FLAG (peer->af_cap[afi][safi], PEER_CAP_ORF_PREFIX_SM_OLD_RCV))
 	  SET_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_ORF_WAIT_REFRESH);
 
+  /* Join the update-groups, so that the others know to share with it. */
+  for (afi = AFI_IP ; afi < AFI_MAX ; afi++)
+    for (safi = SAFI_UNICAST ; safi < SAFI_MAX ; safi++)
+      if (peer->afc_nego[afi][safi])
+	update_group_peer (peer, afi, safi);
+
   bgp_announce_route_all (peer);
 
   BGP_TIMER_ON (peer->t_routeadv, bgp_routeadv_timer, 1);
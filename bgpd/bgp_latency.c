@@ -0,0 +1,273 @@
+/* BGP per-peer latency statistics
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+/* Where the time goes between a peer sending an UPDATE and the routes
+   in it reaching zebra and the other peers.  UPDATE parsing is timed
+   with the same real and CPU time accounting as threads.  The time it
+   was received is then carried along with the routes: to the process
+   queue entry made for each, and from there to the advertisements
+   made when they are selected.  */
+
+#include <zebra.h>
+
+#include "command.h"
+#include "prefix.h"
+#include "sockunion.h"
+#include "thread.h"
+#include "vty.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_latency.h"
+
+struct peer *bgp_latency_peer;
+struct timeval bgp_latency_received;
+
+static const struct
+{
+  const char *name;
+  const char *desc;
+} bgp_latency_strs[BGP_LATENCY_MAX] =
+{
+  [BGP_LATENCY_PARSE]		= { "update_parse",
+				    "UPDATE parse time" },
+  [BGP_LATENCY_PARSE_CPU]	= { "update_parse_cpu",
+				    "UPDATE parse CPU time" },
+  [BGP_LATENCY_PROCESS_QUEUE]	= { "process_queue",
+				    "Route processing queue delay" },
+  [BGP_LATENCY_ZEBRA]		= { "zebra_announce",
+				    "UPDATE received to zebra announce" },
+  [BGP_LATENCY_ADVERTISE]	= { "advertise",
+				    "UPDATE received to advertisement" },
+};
+
+void
+bgp_latency_reset (struct bgp_latency *latency)
+{
+  memset (latency, 0, sizeof (struct bgp_latency));
+  latency->since = quagga_time (NULL);
+}
+
+void
+bgp_latency_add (struct bgp_latency *latency, enum bgp_latency_type type,
+		 unsigned long usec)
+{
+  struct bgp_latency_hist *hist = &latency->hist[type];
+  unsigned long v;
+  int i;
+
+  for (i = 0, v = usec; v && i < BGP_LATENCY_BUCKETS - 1; i++)
+    v >>= 1;
+
+  hist->bucket[i]++;
+  hist->count++;
+  hist->total += usec;
+  if (hist->max < usec)
+    hist->max = usec;
+}
+
+/* Microseconds since SINCE, taken from the monotonic clock. */
+unsigned long
+bgp_latency_elapsed (struct timeval *since)
+{
+  struct timeval now;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &now);
+  return (now.tv_sec - since->tv_sec) * 1000000L
+	 + (now.tv_usec - since->tv_usec);
+}
+
+static const char *
+bgp_latency_time_str (unsigned long usec, char *buf, size_t size)
+{
+  if (usec < 1000)
+    snprintf (buf, size, "%luus", usec);
+  else if (usec < 1000000)
+    snprintf (buf, size, "%.1fms", usec / 1000.0);
+  else
+    snprintf (buf, size, "%.1fs", usec / 1000000.0);
+  return buf;
+}
+
+static void
+bgp_latency_show_hist (struct vty *vty, enum bgp_latency_type type,
+		       struct bgp_latency_hist *hist)
+{
+  char buf[3][16];
+  int i;
+
+  vty_out (vty, "  %s: %lu%s", bgp_latency_strs[type].desc, hist->count,
+	   VTY_NEWLINE);
+  if (! hist->count)
+    return;
+
+  vty_out (vty, "    average %s, max %s%s",
+	   bgp_latency_time_str (hist->total / hist->count,
+				 buf[0], sizeof (buf[0])),
+	   bgp_latency_time_str (hist->max, buf[1], sizeof (buf[1])),
+	   VTY_NEWLINE);
+
+  for (i = 0; i < BGP_LATENCY_BUCKETS; i++)
+    {
+      if (! hist->bucket[i])
+	continue;
+
+      if (i == 0)
+	vty_out (vty, "    %18s", "0us");
+      else if (i == BGP_LATENCY_BUCKETS - 1)
+	vty_out (vty, "    %8s and more",
+		 bgp_latency_time_str (1UL << (i - 1), buf[0], sizeof (buf[0])));
+      else
+	vty_out (vty, "    %8s - %7s",
+		 bgp_latency_time_str (1UL << (i - 1), buf[0], sizeof (buf[0])),
+		 bgp_latency_time_str ((1UL << i) - 1, buf[1], sizeof (buf[1])));
+      vty_out (vty, " %10lu %5.1f%%%s", hist->bucket[i],
+	       100.0 * hist->bucket[i] / hist->count, VTY_NEWLINE);
+    }
+}
+
+static void
+bgp_latency_show (struct vty *vty, struct peer *peer)
+{
+  struct bgp_latency *latency = peer->latency;
+  time_t uptime;
+  int i;
+
+  uptime = quagga_time (NULL) - latency->since;
+  if (uptime < 1)
+    uptime = 1;
+
+  vty_out (vty, "BGP neighbor is %s, statistics for the last %ld seconds%s",
+	   peer->host, (long) uptime, VTY_NEWLINE);
+  vty_out (vty, "  UPDATEs received %lu, %.1f per second%s",
+	   latency->update_in, (double) latency->update_in / uptime,
+	   VTY_NEWLINE);
+  vty_out (vty, "  UPDATEs sent %lu, %.1f per second%s",
+	   latency->update_out, (double) latency->update_out / uptime,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Output queue high-water mark %lu packets%s",
+	   latency->obuf_high, VTY_NEWLINE);
+
+  for (i = 0; i < BGP_LATENCY_MAX; i++)
+    bgp_latency_show_hist (vty, i, &latency->hist[i]);
+}
+
+/* One line for each value, times in microseconds, for scripts. */
+static void
+bgp_latency_show_raw (struct vty *vty, struct peer *peer)
+{
+  struct bgp_latency *latency = peer->latency;
+  struct bgp_latency_hist *hist;
+  int i;
+  int j;
+
+  vty_out (vty, "seconds %ld%s", (long) (quagga_time (NULL) - latency->since),
+	   VTY_NEWLINE);
+  vty_out (vty, "update_in %lu%s", latency->update_in, VTY_NEWLINE);
+  vty_out (vty, "update_out %lu%s", latency->update_out, VTY_NEWLINE);
+  vty_out (vty, "obuf_high %lu%s", latency->obuf_high, VTY_NEWLINE);
+
+  /* Name, count, total, max, then the buckets. */
+  for (i = 0; i < BGP_LATENCY_MAX; i++)
+    {
+      hist = &latency->hist[i];
+      vty_out (vty, "%s %lu %llu %lu", bgp_latency_strs[i].name,
+	       hist->count, hist->total, hist->max);
+      for (j = 0; j < BGP_LATENCY_BUCKETS; j++)
+	vty_out (vty, " %lu", hist->bucket[j]);
+      vty_out (vty, "%s", VTY_NEWLINE);
+    }
+}
+
+static struct peer *
+bgp_latency_peer_lookup (struct vty *vty, const char *ip_str)
+{
+  struct bgp *bgp;
+  struct peer *peer;
+  union sockunion su;
+
+  bgp = bgp_get_default ();
+  if (! bgp)
+    {
+      vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+      return NULL;
+    }
+
+  if (str2sockunion (ip_str, &su) < 0)
+    {
+      vty_out (vty, "Malformed address: %s%s", ip_str, VTY_NEWLINE);
+      return NULL;
+    }
+
+  peer = peer_lookup (bgp, &su);
+  if (! peer)
+    vty_out (vty, "No such neighbor%s", VTY_NEWLINE);
+  return peer;
+}
+
+DEFUN (show_ip_bgp_neighbor_statistics,
+       show_ip_bgp_neighbor_statistics_cmd,
+       "show ip bgp neighbors (A.B.C.D|X:X::X:X) statistics",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Detailed information on TCP and BGP neighbor connections\n"
+       "Neighbor to display information about\n"
+       "Neighbor to display information about\n"
+       "Message rates and latencies\n")
+{
+  struct peer *peer;
+
+  peer = bgp_latency_peer_lookup (vty, argv[0]);
+  if (! peer)
+    return CMD_WARNING;
+
+  bgp_latency_show (vty, peer);
+  return CMD_SUCCESS;
+}
+
+DEFUN (show_ip_bgp_neighbor_statistics_raw,
+       show_ip_bgp_neighbor_statistics_raw_cmd,
+       "show ip bgp neighbors (A.B.C.D|X:X::X:X) statistics raw",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Detailed information on TCP and BGP neighbor connections\n"
+       "Neighbor to display information about\n"
+       "Neighbor to display information about\n"
+       "Message rates and latencies\n"
+       "One value per line, times in microseconds\n")
+{
+  struct peer *peer;
+
+  peer = bgp_latency_peer_lookup (vty, argv[0]);
+  if (! peer)
+    return CMD_WARNING;
+
+  bgp_latency_show_raw (vty, peer);
+  return CMD_SUCCESS;
+}
+
+void
+bgp_latency_init (void)
+{
+  install_element (VIEW_NODE, &show_ip_bgp_neighbor_statistics_cmd);
+  install_element (VIEW_NODE, &show_ip_bgp_neighbor_statistics_raw_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_neighbor_statistics_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_neighbor_statistics_raw_cmd);
+}
@@ -0,0 +1,71 @@
+/* BGP per-peer latency statistics
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#ifndef _QUAGGA_BGP_LATENCY_H
+#define _QUAGGA_BGP_LATENCY_H
+
+/* What is timed, for a peer's UPDATEs and the routes in them. */
+enum bgp_latency_type
+{
+  BGP_LATENCY_PARSE = 0,	/* UPDATE parse, real time */
+  BGP_LATENCY_PARSE_CPU,	/* UPDATE parse, CPU time */
+  BGP_LATENCY_PROCESS_QUEUE,	/* Waiting for bgp_process */
+  BGP_LATENCY_ZEBRA,		/* UPDATE received to route sent to zebra */
+  BGP_LATENCY_ADVERTISE,	/* UPDATE received to route advertised */
+  BGP_LATENCY_MAX,
+};
+
+/* Bucket 0 counts times of 0us, bucket i times of 2^(i-1) to 2^i-1us,
+   the last everything above.  */
+#define BGP_LATENCY_BUCKETS 28
+
+struct bgp_latency_hist
+{
+  unsigned long count;
+  unsigned long max;
+  unsigned long long total;
+  unsigned long bucket[BGP_LATENCY_BUCKETS];
+};
+
+/* Kept for each peer, from when its session last came up. */
+struct bgp_latency
+{
+  time_t since;
+
+  unsigned long update_in;
+  unsigned long update_out;
+
+  /* Most packets waiting to be written. */
+  unsigned long obuf_high;
+
+  struct bgp_latency_hist hist[BGP_LATENCY_MAX];
+};
+
+/* The peer whose UPDATE is being dealt with and when it was received,
+   for what it leads to being timed from then.  */
+extern struct peer *bgp_latency_peer;
+extern struct timeval bgp_latency_received;
+
+extern void bgp_latency_reset (struct bgp_latency *);
+extern void bgp_latency_add (struct bgp_latency *, enum bgp_latency_type,
+			     unsigned long);
+extern unsigned long bgp_latency_elapsed (struct timeval *);
+extern void bgp_latency_init (void);
+
+#endif /* _QUAGGA_BGP_LATENCY_H */
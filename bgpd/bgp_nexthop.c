@@ -36,6 +36,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_nexthop.h"
 #include "bgpd/bgp_debug.h"
 #include "bgpd/bgp_damp.h"
+#include "bgpd/bgp_zebra.h"
 #include "zebra/rib.h"
 #include "zebra/zserv.h"	/* For ZEBRA_SERV_PATH. */
 
@@ -56,10 +57,11 @@ static int bgp_scan_interval;
 /* BGP import interval. */
 static int bgp_import_interval;
 
+/* Connected networks changed, EBGP nexthops need checking. */
+static struct thread *bgp_connected_thread = NULL;
+
 /* Route table for next-hop lookup cache. */
 static struct bgp_table *bgp_nexthop_cache_table[AFI_MAX];
-static struct bgp_table *cache1_table[AFI_MAX];
-static struct bgp_table *cache2_table[AFI_MAX];
 
 /* Route table for connected route. */
 static struct bgp_table *bgp_connected_table[AFI_MAX];
@@ -216,200 +218,412 @@ bgp_nexthop_check_ebgp (afi_t afi, struct attr *attr)
   return 0;
 }
 
-#ifdef HAVE_IPV6
-/* Check specified next-hop is reachable or not. */
-static int
-bgp_nexthop_lookup_ipv6 (struct peer *peer, struct bgp_info *ri, int *changed,
-			 int *metricchanged)
+/* Register the entry with zebra, to be told when it changes. */
+static void
+bgp_nexthop_register (struct bgp_nexthop_cache *bnc)
+{
+  bnc->registered = bgp_zebra_nexthop_register (ZEBRA_NEXTHOP_REGISTER,
+						&bnc->node->p);
+}
+
+/* Get the cache entry for a nexthop, asking zebra about it if it is
+   new. */
+static struct bgp_nexthop_cache *
+bgp_nexthop_cache_get (afi_t afi, struct prefix *p)
 {
   struct bgp_node *rn;
-  struct prefix p;
   struct bgp_nexthop_cache *bnc;
-  struct attr *attr;
 
-  /* If lookup is not enabled, return valid. */
-  if (zlookup->sock < 0)
+  rn = bgp_node_get (bgp_nexthop_cache_table[afi], p);
+  if (rn->info)
     {
-      if (ri->extra)
-        ri->extra->igpmetric = 0;
-      return 1;
+      bgp_unlock_node (rn);
+      return rn->info;
     }
 
-  /* Only check IPv6 global address only nexthop. */
-  attr = ri->attr;
+#ifdef HAVE_IPV6
+  if (afi == AFI_IP6)
+    bnc = zlookup_query_ipv6 (&p->u.prefix6);
+  else
+#endif /* HAVE_IPV6 */
+    bnc = zlookup_query (p->u.prefix4);
 
-  if (attr->extra->mp_nexthop_len != 16 
-      || IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
-    return 1;
+  if (! bnc)
+    {
+      bnc = bnc_new ();
 
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET6;
-  p.prefixlen = IPV6_MAX_BITLEN;
-  p.u.prefix6 = attr->extra->mp_nexthop_global;
+      /* Until zebra can be asked, take the nexthop as reachable. */
+      bnc->valid = (zlookup->sock < 0);
+    }
 
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bgp_nexthop_cache_table[AFI_IP6], &p);
+  bnc->node = rn;
+  rn->info = bnc;
+  bgp_nexthop_register (bnc);
 
-  if (rn->info)
+  return bnc;
+}
+
+/* Add the route to those using the entry. */
+static void
+bgp_nexthop_link (struct bgp_nexthop_cache *bnc, struct bgp_node *rn,
+		  struct bgp_info *ri)
+{
+  struct bgp_info_extra *extra;
+
+  extra = bgp_info_extra_get (ri);
+  if (extra->bnc == bnc)
+    return;
+  if (extra->bnc)
+    bgp_nexthop_unlink (ri);
+
+  extra->bnc = bnc;
+  extra->rn = rn;
+  extra->bnc_prev = NULL;
+  extra->bnc_next = bnc->routes;
+  if (bnc->routes)
+    bnc->routes->extra->bnc_prev = ri;
+  bnc->routes = ri;
+  bnc->refcnt++;
+}
+
+/* Stop tracking the nexthop of the route, freeing the entry once no
+   route uses it. */
+void
+bgp_nexthop_unlink (struct bgp_info *ri)
+{
+  struct bgp_info_extra *extra;
+  struct bgp_nexthop_cache *bnc;
+  struct bgp_node *rn;
+
+  extra = ri->extra;
+  if (! extra || ! extra->bnc)
+    return;
+
+  bnc = extra->bnc;
+  if (extra->bnc_next)
+    extra->bnc_next->extra->bnc_prev = extra->bnc_prev;
+  if (extra->bnc_prev)
+    extra->bnc_prev->extra->bnc_next = extra->bnc_next;
+  else
+    bnc->routes = extra->bnc_next;
+  extra->bnc = NULL;
+  extra->rn = NULL;
+  extra->bnc_next = extra->bnc_prev = NULL;
+
+  if (--bnc->refcnt > 0)
+    return;
+
+  rn = bnc->node;
+  if (bnc->registered)
+    bgp_zebra_nexthop_register (ZEBRA_NEXTHOP_UNREGISTER, &rn->p);
+  bnc_free (bnc);
+  rn->info = NULL;
+  bgp_unlock_node (rn);
+}
+
+/* Check specified next-hop is reachable or not, and track it from now
+   on. */
+int
+bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_node *rn,
+		    struct bgp_info *ri)
+{
+  struct prefix p;
+  struct bgp_nexthop_cache *bnc;
+
+  memset (&p, 0, sizeof (struct prefix));
+
+#ifdef HAVE_IPV6
+  if (afi == AFI_IP6)
     {
-      bnc = rn->info;
-      bgp_unlock_node (rn);
+      struct attr *attr = ri->attr;
+
+      /* Only check IPv6 global address only nexthop. */
+      if (attr->extra->mp_nexthop_len != 16
+	  || IN6_IS_ADDR_LINKLOCAL (&attr->extra->mp_nexthop_global))
+	{
+	  bgp_nexthop_unlink (ri);
+	  return 1;
+	}
+
+      p.family = AF_INET6;
+      p.prefixlen = IPV6_MAX_BITLEN;
+      p.u.prefix6 = attr->extra->mp_nexthop_global;
     }
   else
+#endif /* HAVE_IPV6 */
     {
-      bnc = zlookup_query_ipv6 (&attr->extra->mp_nexthop_global);
-      if (bnc)
-	{
-	  struct bgp_table *old;
-	  struct bgp_node *oldrn;
-	  struct bgp_nexthop_cache *oldbnc;
+      p.family = AF_INET;
+      p.prefixlen = IPV4_MAX_BITLEN;
+      p.u.prefix4 = ri->attr->nexthop;
+    }
 
-	  if (changed)
-	    {
-	      if (bgp_nexthop_cache_table[AFI_IP6] == cache1_table[AFI_IP6])
-		old = cache2_table[AFI_IP6];
-	      else
-		old = cache1_table[AFI_IP6];
+  /* IBGP or ebgp-multihop */
+  bnc = bgp_nexthop_cache_get (afi, &p);
+  bgp_nexthop_link (bnc, rn, ri);
 
-	      oldrn = bgp_node_lookup (old, &p);
-	      if (oldrn)
-		{
-		  oldbnc = oldrn->info;
+  if (bnc->valid && bnc->metric)
+    ri->extra->igpmetric = bnc->metric;
+  else
+    ri->extra->igpmetric = 0;
 
-		  bnc->changed = bgp_nexthop_cache_changed (bnc, oldbnc);
+  return bnc->valid;
+}
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
-		}
-	    }
-	}
-      else
+/* Read the metric and nexthops sent for an address, as put by
+   zserv_nexthop_encode. */
+static void
+bgp_nexthop_read (struct stream *s, struct bgp_nexthop_cache *bnc)
+{
+  struct nexthop *nexthop;
+  int i;
+
+  bnc->metric = stream_getl (s);
+  bnc->nexthop_num = stream_getc (s);
+  bnc->valid = (bnc->nexthop_num > 0);
+
+  for (i = 0; i < bnc->nexthop_num; i++)
+    {
+      nexthop = XCALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      nexthop->type = stream_getc (s);
+      switch (nexthop->type)
 	{
-	  bnc = bnc_new ();
-	  bnc->valid = 0;
+	case ZEBRA_NEXTHOP_IPV4:
+	  nexthop->gate.ipv4.s_addr = stream_get_ipv4 (s);
+	  break;
+	case ZEBRA_NEXTHOP_IFINDEX:
+	case ZEBRA_NEXTHOP_IFNAME:
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#ifdef HAVE_IPV6
+	case ZEBRA_NEXTHOP_IPV6:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  break;
+	case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	  stream_get (&nexthop->gate.ipv6, s, 16);
+	  nexthop->ifindex = stream_getl (s);
+	  break;
+#endif /* HAVE_IPV6 */
+	default:
+	  /* do nothing */
+	  break;
 	}
-      rn->info = bnc;
+      bnc_nexthop_add (bnc, nexthop);
     }
+}
+
+/* Bring a route using the entry up to date with it. */
+static void
+bgp_nexthop_route_update (struct bgp_nexthop_cache *bnc, struct bgp_info *ri,
+			  int changed)
+{
+  struct bgp_node *rn;
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  rn = ri->extra->rn;
+  bgp = ri->peer->bgp;
+  afi = rn->table->afi;
+  safi = rn->table->safi;
+
+  if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+    return;
 
   if (changed)
-    *changed = bnc->changed;
+    SET_FLAG (ri->flags, BGP_INFO_IGP_CHANGED);
 
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  /* The metric counts in best path selection. */
+  if (ri->extra->igpmetric != (bnc->valid ? bnc->metric : 0))
+    SET_FLAG (ri->flags, BGP_INFO_CHANGED);
+  ri->extra->igpmetric = bnc->valid ? bnc->metric : 0;
 
-  if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get (ri))->igpmetric = bnc->metric;
-  else if (ri->extra)
-    ri->extra->igpmetric = 0;
+  if (bnc->valid != (CHECK_FLAG (ri->flags, BGP_INFO_VALID) ? 1 : 0))
+    {
+      if (CHECK_FLAG (ri->flags, BGP_INFO_VALID))
+	{
+	  bgp_aggregate_decrement (bgp, &rn->p, ri, afi, safi);
+	  bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
+	}
+      else
+	{
+	  bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+	  bgp_aggregate_increment (bgp, &rn->p, ri, afi, safi);
+	}
+    }
 
-  return bnc->valid;
+  bgp_process (bgp, rn, afi, safi);
 }
-#endif /* HAVE_IPV6 */
 
-/* Check specified next-hop is reachable or not. */
+/* Zebra tells us the resolution of a registered nexthop changed.
+   Only the routes using it are looked at again.  */
 int
-bgp_nexthop_lookup (afi_t afi, struct peer *peer, struct bgp_info *ri,
-		    int *changed, int *metricchanged)
+bgp_nexthop_update (int command, struct zclient *zclient,
+		    zebra_size_t length)
 {
-  struct bgp_node *rn;
+  struct stream *s;
   struct prefix p;
+  struct bgp_node *rn;
   struct bgp_nexthop_cache *bnc;
-  struct in_addr addr;
+  struct bgp_nexthop_cache new;
+  struct bgp_info *ri;
+  struct bgp_info *next;
+  afi_t afi;
+  int changed;
 
-  /* If lookup is not enabled, return valid. */
-  if (zlookup->sock < 0)
+  s = zclient->ibuf;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = stream_getc (s);
+  if (p.family == AF_INET)
     {
-      if (ri->extra)
-        ri->extra->igpmetric = 0;
-      return 1;
+      afi = AFI_IP;
+      p.prefixlen = IPV4_MAX_BITLEN;
+      p.u.prefix4.s_addr = stream_get_ipv4 (s);
     }
-
 #ifdef HAVE_IPV6
-  if (afi == AFI_IP6)
-    return bgp_nexthop_lookup_ipv6 (peer, ri, changed, metricchanged);
+  else if (p.family == AF_INET6)
+    {
+      afi = AFI_IP6;
+      p.prefixlen = IPV6_MAX_BITLEN;
+      stream_get (&p.u.prefix6, s, 16);
+    }
 #endif /* HAVE_IPV6 */
+  else
+    return 0;
 
-  addr = ri->attr->nexthop;
+  rn = bgp_node_lookup (bgp_nexthop_cache_table[afi], &p);
+  if (! rn)
+    return 0;
+  bnc = rn->info;
+  bgp_unlock_node (rn);
+  if (! bnc)
+    return 0;
 
-  memset (&p, 0, sizeof (struct prefix));
-  p.family = AF_INET;
-  p.prefixlen = IPV4_MAX_BITLEN;
-  p.u.prefix4 = addr;
+  memset (&new, 0, sizeof (struct bgp_nexthop_cache));
+  bgp_nexthop_read (s, &new);
 
-  /* IBGP or ebgp-multihop */
-  rn = bgp_node_get (bgp_nexthop_cache_table[AFI_IP], &p);
+  changed = (new.valid != bnc->valid
+	     || bgp_nexthop_cache_changed (&new, bnc));
+  if (! changed && new.metric == bnc->metric)
+    {
+      bnc_nexthop_free (&new);
+      return 0;
+    }
 
-  if (rn->info)
+  if (BGP_DEBUG (events, EVENTS))
     {
-      bnc = rn->info;
-      bgp_unlock_node (rn);
+      char buf[INET6_ADDRSTRLEN];
+
+      zlog_debug ("nexthop %s %s [IGP metric %u], %u routes to update",
+		  inet_ntop (p.family, &p.u.prefix, buf, INET6_ADDRSTRLEN),
+		  new.valid ? "valid" : "invalid", new.metric, bnc->refcnt);
     }
-  else
+
+  bnc_nexthop_free (bnc);
+  bnc->valid = new.valid;
+  bnc->metric = new.metric;
+  bnc->nexthop_num = new.nexthop_num;
+  bnc->nexthop = new.nexthop;
+
+  for (ri = bnc->routes; ri; ri = next)
     {
-      bnc = zlookup_query (addr);
-      if (bnc)
-	{
-	  struct bgp_table *old;
-	  struct bgp_node *oldrn;
-	  struct bgp_nexthop_cache *oldbnc;
+      next = ri->extra->bnc_next;
+      bgp_nexthop_route_update (bnc, ri, changed);
+    }
 
-	  if (changed)
-	    {
-	      if (bgp_nexthop_cache_table[AFI_IP] == cache1_table[AFI_IP])
-		old = cache2_table[AFI_IP];
-	      else
-		old = cache1_table[AFI_IP];
+  return 0;
+}
 
-	      oldrn = bgp_node_lookup (old, &p);
-	      if (oldrn)
-		{
-		  oldbnc = oldrn->info;
+/* (Re)connected to zebra, which needs to be told all the nexthops
+   again. */
+void
+bgp_nexthop_register_all (void)
+{
+  struct bgp_node *rn;
+  afi_t afi;
 
-		  bnc->changed = bgp_nexthop_cache_changed (bnc, oldbnc);
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    if (bgp_nexthop_cache_table[afi])
+      for (rn = bgp_table_top (bgp_nexthop_cache_table[afi]); rn;
+	   rn = bgp_route_next (rn))
+	if (rn->info)
+	  bgp_nexthop_register (rn->info);
+}
 
-		  if (bnc->metric != oldbnc->metric)
-		    bnc->metricchanged = 1;
-		}
-	    }
-	}
-      else
+/* Check directly connected EBGP routes again, as connected networks
+   changed. */
+static void
+bgp_connected_scan (afi_t afi)
+{
+  struct bgp *bgp;
+  struct bgp_node *rn;
+  struct bgp_info *bi;
+  int valid;
+
+  bgp = bgp_get_default ();
+  if (bgp == NULL)
+    return;
+
+  for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
+       rn = bgp_route_next (rn))
+    {
+      int changed = 0;
+
+      for (bi = rn->info; bi; bi = bi->next)
 	{
-	  bnc = bnc_new ();
-	  bnc->valid = 0;
+	  if (bi->type != ZEBRA_ROUTE_BGP || bi->sub_type != BGP_ROUTE_NORMAL
+	      || peer_sort (bi->peer) != BGP_PEER_EBGP || bi->peer->ttl != 1
+	      || (bi->extra && bi->extra->bnc))
+	    continue;
+
+	  valid = bgp_nexthop_check_ebgp (afi, bi->attr);
+	  if (valid == (CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0))
+	    continue;
+
+	  if (valid)
+	    {
+	      bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
+	      bgp_aggregate_increment (bgp, &rn->p, bi, afi, SAFI_UNICAST);
+	    }
+	  else
+	    {
+	      bgp_aggregate_decrement (bgp, &rn->p, bi, afi, SAFI_UNICAST);
+	      bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
+	    }
+	  changed = 1;
 	}
-      rn->info = bnc;
+      if (changed)
+	bgp_process (bgp, rn, afi, SAFI_UNICAST);
     }
+}
 
-  if (changed)
-    *changed = bnc->changed;
+static int
+bgp_connected_scan_event (struct thread *t)
+{
+  bgp_connected_thread = NULL;
 
-  if (metricchanged)
-    *metricchanged = bnc->metricchanged;
+  if (BGP_DEBUG (events, EVENTS))
+    zlog_debug ("Connected networks changed, checking EBGP nexthops");
 
-  if (bnc->valid && bnc->metric)
-    (bgp_info_extra_get(ri))->igpmetric = bnc->metric;
-  else if (ri->extra)
-    ri->extra->igpmetric = 0;
+  bgp_connected_scan (AFI_IP);
+#ifdef HAVE_IPV6
+  bgp_connected_scan (AFI_IP6);
+#endif /* HAVE_IPV6 */
 
-  return bnc->valid;
+  return 0;
 }
 
-/* Reset and free all BGP nexthop cache. */
 static void
-bgp_nexthop_cache_reset (struct bgp_table *table)
+bgp_connected_changed (void)
 {
-  struct bgp_node *rn;
-  struct bgp_nexthop_cache *bnc;
-
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
-    if ((bnc = rn->info) != NULL)
-      {
-	bnc_free (bnc);
-	rn->info = NULL;
-	bgp_unlock_node (rn);
-      }
+  if (! bgp_connected_thread)
+    bgp_connected_thread = thread_add_event (master, bgp_connected_scan_event,
+					     NULL, 0);
 }
 
+/* Reachability of nexthops is kept up to date by zebra, so the
+   scanner is left with maximum prefix and dampening housekeeping. */
 static void
 bgp_scan (afi_t afi, safi_t safi)
 {
@@ -419,16 +633,7 @@ bgp_scan (afi_t afi, safi_t safi)
   struct bgp_info *next;
   struct peer *peer;
   struct listnode *node, *nnode;
-  int valid;
-  int current;
-  int changed;
-  int metricchanged;
-
-  /* Change cache. */
-  if (bgp_nexthop_cache_table[afi] == cache1_table[afi])
-    bgp_nexthop_cache_table[afi] = cache2_table[afi];
-  else
-    bgp_nexthop_cache_table[afi] = cache1_table[afi];
+  int scanned;
 
   /* Get default bgp. */
   bgp = bgp_get_default ();
@@ -449,64 +654,30 @@ bgp_scan (afi_t afi, safi_t safi)
 	bgp_maximum_prefix_overflow (peer, afi, SAFI_MPLS_VPN, 1);
     }
 
+  if (! CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST], BGP_CONFIG_DAMPENING))
+    return;
+
   for (rn = bgp_table_top (bgp->rib[afi][SAFI_UNICAST]); rn;
        rn = bgp_route_next (rn))
     {
+      scanned = 0;
       for (bi = rn->info; bi; bi = next)
 	{
 	  next = bi->next;
 
-	  if (bi->type == ZEBRA_ROUTE_BGP && bi->sub_type == BGP_ROUTE_NORMAL)
+	  if (bi->type == ZEBRA_ROUTE_BGP && bi->sub_type == BGP_ROUTE_NORMAL
+	      && bi->extra && bi->extra->damp_info)
 	    {
-	      changed = 0;
-	      metricchanged = 0;
-
-	      if (peer_sort (bi->peer) == BGP_PEER_EBGP && bi->peer->ttl == 1)
-		valid = bgp_nexthop_check_ebgp (afi, bi->attr);
-	      else
-		valid = bgp_nexthop_lookup (afi, bi->peer, bi,
-					    &changed, &metricchanged);
-
-	      current = CHECK_FLAG (bi->flags, BGP_INFO_VALID) ? 1 : 0;
-
-	      if (changed)
-		SET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-	      else
-		UNSET_FLAG (bi->flags, BGP_INFO_IGP_CHANGED);
-
-	      if (valid != current)
-		{
-		  if (CHECK_FLAG (bi->flags, BGP_INFO_VALID))
-		    {
-		      bgp_aggregate_decrement (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		      bgp_info_unset_flag (rn, bi, BGP_INFO_VALID);
-		    }
-		  else
-		    {
-		      bgp_info_set_flag (rn, bi, BGP_INFO_VALID);
-		      bgp_aggregate_increment (bgp, &rn->p, bi,
-					       afi, SAFI_UNICAST);
-		    }
-		}
-
-              if (CHECK_FLAG (bgp->af_flags[afi][SAFI_UNICAST],
-		  BGP_CONFIG_DAMPENING)
-                  &&  bi->extra && bi->extra->damp_info )
-                if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
-		  bgp_aggregate_increment (bgp, &rn->p, bi,
-					   afi, SAFI_UNICAST);
+	      scanned = 1;
+	      if (bgp_damp_scan (bi, afi, SAFI_UNICAST))
+		bgp_aggregate_increment (bgp, &rn->p, bi,
+					 afi, SAFI_UNICAST);
 	    }
 	}
-      bgp_process (bgp, rn, afi, SAFI_UNICAST);
+      if (scanned)
+	bgp_process (bgp, rn, afi, SAFI_UNICAST);
     }
 
-  /* Flash old cache. */
-  if (bgp_nexthop_cache_table[afi] == cache1_table[afi])
-    bgp_nexthop_cache_reset (cache2_table[afi]);
-  else
-    bgp_nexthop_cache_reset (cache1_table[afi]);
-
   if (BGP_DEBUG (events, EVENTS))
     {
       if (afi == AFI_IP)
@@ -516,7 +687,7 @@ bgp_scan (afi_t afi, safi_t safi)
     }
 }
 
-/* BGP scan thread.  This thread check nexthop reachability. */
+/* BGP scan thread.  This thread does periodic housekeeping. */
 static int
 bgp_scan_timer (struct thread *t)
 {
@@ -534,7 +705,7 @@ bgp_scan_timer (struct thread *t)
 
   return 0;
 }
-
+
 struct bgp_connected_ref
 {
   unsigned int refcnt;
@@ -579,6 +750,7 @@ bgp_connected_add (struct connected *ifc)
 	  memset (bc, 0, sizeof (struct bgp_connected_ref));
 	  bc->refcnt = 1;
 	  rn->info = bc;
+	  bgp_connected_changed ();
 	}
     }
 #ifdef HAVE_IPV6
@@ -605,6 +777,7 @@ bgp_connected_add (struct connected *ifc)
 	  memset (bc, 0, sizeof (struct bgp_connected_ref));
 	  bc->refcnt = 1;
 	  rn->info = bc;
+	  bgp_connected_changed ();
 	}
     }
 #endif /* HAVE_IPV6 */
@@ -644,6 +817,7 @@ bgp_connected_delete (struct connected *ifc)
 	{
 	  XFREE (0, bc);
 	  rn->info = NULL;
+	  bgp_connected_changed ();
 	}
       bgp_unlock_node (rn);
       bgp_unlock_node (rn);
@@ -670,6 +844,7 @@ bgp_connected_delete (struct connected *ifc)
 	{
 	  XFREE (0, bc);
 	  rn->info = NULL;
+	  bgp_connected_changed ();
 	}
       bgp_unlock_node (rn);
       bgp_unlock_node (rn);
@@ -1223,11 +1398,12 @@ DEFUN (show_ip_bgp_scan,
     if ((bnc = rn->info) != NULL)
       {
 	if (bnc->valid)
-	  vty_out (vty, " %s valid [IGP metric %d]%s",
-		   inet_ntoa (rn->p.u.prefix4), bnc->metric, VTY_NEWLINE);
+	  vty_out (vty, " %s valid [IGP metric %d], %u routes%s",
+		   inet_ntoa (rn->p.u.prefix4), bnc->metric, bnc->refcnt,
+		   VTY_NEWLINE);
 	else
-	  vty_out (vty, " %s invalid%s",
-		   inet_ntoa (rn->p.u.prefix4), VTY_NEWLINE);
+	  vty_out (vty, " %s invalid, %u routes%s",
+		   inet_ntoa (rn->p.u.prefix4), bnc->refcnt, VTY_NEWLINE);
       }
 
 #ifdef HAVE_IPV6
@@ -1239,13 +1415,13 @@ DEFUN (show_ip_bgp_scan,
       if ((bnc = rn->info) != NULL)
 	{
 	  if (bnc->valid)
-	    vty_out (vty, " %s valid [IGP metric %d]%s",
+	    vty_out (vty, " %s valid [IGP metric %d], %u routes%s",
 		     inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, BUFSIZ),
-		     bnc->metric, VTY_NEWLINE);
+		     bnc->metric, bnc->refcnt, VTY_NEWLINE);
 	  else
-	    vty_out (vty, " %s invalid%s",
+	    vty_out (vty, " %s invalid, %u routes%s",
 		     inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, BUFSIZ),
-		     VTY_NEWLINE);
+		     bnc->refcnt, VTY_NEWLINE);
 	}
   }
 #endif /* HAVE_IPV6 */
@@ -1296,16 +1472,12 @@ bgp_scan_init ()
   bgp_scan_interval = BGP_SCAN_INTERVAL_DEFAULT;
   bgp_import_interval = BGP_IMPORT_INTERVAL_DEFAULT;
 
-  cache1_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
-  cache2_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
-  bgp_nexthop_cache_table[AFI_IP] = cache1_table[AFI_IP];
+  bgp_nexthop_cache_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
 
   bgp_connected_table[AFI_IP] = bgp_table_init (AFI_IP, SAFI_UNICAST);
 
 #ifdef HAVE_IPV6
-  cache1_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
-  cache2_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
-  bgp_nexthop_cache_table[AFI_IP6] = cache1_table[AFI_IP6];
+  bgp_nexthop_cache_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
   bgp_connected_table[AFI_IP6] = bgp_table_init (AFI_IP6, SAFI_UNICAST);
 #endif /* HAVE_IPV6 */
 
@@ -23,20 +23,20 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 
 #include "if.h"
 
+struct zclient;
+
 #define BGP_SCAN_INTERVAL_DEFAULT   60
 #define BGP_IMPORT_INTERVAL_DEFAULT 15
 
-/* BGP nexthop cache value structure. */
+/* BGP nexthop cache value structure.  Entries are kept for as long as
+   routes use them, and zebra is asked to tell us when they change.  */
 struct bgp_nexthop_cache
 {
   /* This nexthop exists in IGP. */
   u_char valid;
 
-  /* Nexthop is changed. */
-  u_char changed;
-
-  /* Nexthop is changed. */
-  u_char metricchanged;
+  /* Registered with zebra for updates. */
+  u_char registered;
 
   /* IGP route's metric. */
   u_int32_t metric;
@@ -44,11 +44,22 @@ struct bgp_nexthop_cache
   /* Nexthop number and nexthop linked list.*/
   u_char nexthop_num;
   struct nexthop *nexthop;
+
+  /* Routes using this nexthop, linked through their extra
+     information. */
+  struct bgp_info *routes;
+  unsigned int refcnt;
+
+  /* Back pointer to the cache table node. */
+  struct bgp_node *node;
 };
 
 extern void bgp_scan_init (void);
-extern int bgp_nexthop_lookup (afi_t, struct peer *peer, struct bgp_info *,
-			int *, int *);
+extern int bgp_nexthop_lookup (afi_t, struct peer *peer, struct bgp_node *,
+			       struct bgp_info *);
+extern void bgp_nexthop_unlink (struct bgp_info *);
+extern int bgp_nexthop_update (int, struct zclient *, zebra_size_t);
+extern void bgp_nexthop_register_all (void);
 extern void bgp_connected_add (struct connected *c);
 extern void bgp_connected_delete (struct connected *c);
 extern int bgp_multiaccess_check_v4 (struct in_addr, char *);
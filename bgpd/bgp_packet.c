@@ -47,8 +47,12 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_latency.h"
 
 int stream_put_prefix (struct stream *, struct prefix *);
+
+static void bgp_read_resume (struct peer *);
 
 /* Set up BGP packet marker and packet type. */
 static int
@@ -90,6 +94,9 @@ bgp_packet_add (struct peer *peer, struct stream *s)
 {
   /* Add packet to the end of list. */
   stream_fifo_push (peer->obuf, s);
+
+  if (peer->obuf->count > peer->latency->obuf_high)
+    peer->latency->obuf_high = peer->obuf->count;
 }
 
 /* Free first packet. */
@@ -137,6 +144,65 @@ bgp_connect_check (struct peer *peer)
     }
 }
 
+/* Find the MP_REACH_NLRI among the LEN bytes of attributes at START
+   in S.  Returns where it ends, with where its length is in *LENP, or
+   0 if it is not there with an extended length.  */
+size_t
+bgp_packet_mpattr_find (struct stream *s, size_t start, size_t len,
+			size_t *lenp)
+{
+  u_char *data = STREAM_DATA (s);
+  size_t pos = start;
+  size_t alen;
+  size_t hlen;
+
+  while (pos + 3 <= start + len)
+    {
+      if (CHECK_FLAG (data[pos], BGP_ATTR_FLAG_EXTLEN))
+	{
+	  alen = stream_getw_from (s, pos + 2);
+	  hlen = 4;
+	}
+      else
+	{
+	  alen = data[pos + 2];
+	  hlen = 3;
+	}
+
+      if (data[pos + 1] == BGP_ATTR_MP_REACH_NLRI)
+	{
+	  if (hlen != 4)
+	    return 0;
+	  *lenp = pos + 2;
+	  return pos + hlen + alen;
+	}
+      pos += hlen + alen;
+    }
+  return 0;
+}
+
+/* Make the UPDATE in S into a packet, with the prefixes in NLRI put
+   on the end of its MP_REACH_NLRI, found by bgp_packet_mpattr_find.  */
+static struct stream *
+bgp_packet_mpattr_join (struct stream *s, struct stream *nlri,
+			size_t lenp, size_t end)
+{
+  struct stream *packet;
+  size_t extra = stream_get_endp (nlri);
+
+  packet = stream_new (stream_get_endp (s) + extra);
+  stream_put (packet, STREAM_DATA (s), end);
+  stream_put (packet, STREAM_DATA (nlri), extra);
+  stream_put (packet, STREAM_DATA (s) + end, stream_get_endp (s) - end);
+
+  stream_putw_at (packet, lenp, stream_getw_from (packet, lenp) + extra);
+  stream_putw_at (packet, BGP_HEADER_SIZE + BGP_UNFEASIBLE_LEN,
+		  stream_getw_from (packet, BGP_HEADER_SIZE
+					    + BGP_UNFEASIBLE_LEN) + extra);
+  bgp_packet_set_size (packet);
+  return packet;
+}
+
 /* Make BGP update packet.  */
 static struct stream *
 bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
@@ -147,15 +213,34 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
   struct stream *packet;
   struct bgp_node *rn = NULL;
   struct bgp_info *binfo = NULL;
+  struct peer *from = NULL;
+  struct attr *attr = NULL;
+  struct stream *cached = NULL;
+  struct prefix *first = NULL;
+  unsigned int count = 0;
+  unsigned int nlri = 0;
   bgp_size_t total_attr_len = 0;
   unsigned long pos;
+  size_t mpattr_lenp = 0;
+  size_t mpattr_end = 0;
+  static struct stream *mp_nlri;
   char buf[BUFSIZ];
 
   s = peer->work;
   stream_reset (s);
 
+  /* Prefixes after the first for the MP_REACH_NLRI, which sits among
+     the other attributes rather than at the end of the packet.  */
+  if (! mp_nlri)
+    mp_nlri = stream_new (BGP_MAX_PACKET_SIZE);
+  stream_reset (mp_nlri);
+
   adv = FIFO_HEAD (&peer->sync[afi][safi]->update);
 
+  /* Another peer of the update-group may have had the same UPDATE. */
+  if (adv)
+    cached = update_group_packet_lookup (peer, afi, safi, adv, &count);
+
   while (adv)
     {
       assert (adv->rn);
@@ -164,16 +249,27 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
       if (adv->binfo)
         binfo = adv->binfo;
 
+      if (cached)
+	{
+	  if (count-- == 0)
+	    break;
+	}
       /* When remaining space can't include NLRI and it's length.  */
-      if (STREAM_REMAIN (s) <= BGP_NLRI_LENGTH + PSIZE (rn->p.prefixlen))
+      else if (STREAM_REMAIN (s) <= BGP_NLRI_LENGTH + PSIZE (rn->p.prefixlen))
+	break;
+      else if (! (afi == AFI_IP && safi == SAFI_UNICAST)
+	       && ! stream_empty (s)
+	       && (! mpattr_end
+		   || (stream_get_endp (s) + stream_get_endp (mp_nlri)
+		       + bgp_packet_mpattr_prefix_size (safi, &rn->p)
+		       > BGP_MAX_PACKET_SIZE)))
 	break;
 
       /* If packet is empty, set attribute. */
-      if (stream_empty (s))
+      if (! cached && stream_empty (s))
 	{
 	  struct prefix_rd *prd = NULL;
 	  u_char *tag = NULL;
-	  struct peer *from = NULL;
 	  
 	  if (rn->prn)
 	    prd = (struct prefix_rd *) &rn->prn->p;
@@ -192,10 +288,30 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 	                                         &rn->p, afi, safi, 
 	                                         from, prd, tag);
 	  stream_putw_at (s, pos, total_attr_len);
+	  attr = adv->baa->attr;
+	  first = &rn->p;
+
+	  if (! (afi == AFI_IP && safi == SAFI_UNICAST))
+	    mpattr_end = bgp_packet_mpattr_find (s, pos + BGP_TOTAL_ATTR_LEN,
+						 total_attr_len,
+						 &mpattr_lenp);
 	}
+      else if (! cached && ! (afi == AFI_IP && safi == SAFI_UNICAST))
+	{
+	  struct prefix_rd *prd = NULL;
+	  u_char *tag = NULL;
 
-      if (afi == AFI_IP && safi == SAFI_UNICAST)
+	  if (rn->prn)
+	    prd = (struct prefix_rd *) &rn->prn->p;
+	  if (adv->binfo && adv->binfo->extra)
+	    tag = adv->binfo->extra->tag;
+
+	  bgp_packet_mpattr_prefix (mp_nlri, &rn->p, safi, prd, tag);
+	}
+
+      if (! cached && afi == AFI_IP && safi == SAFI_UNICAST)
 	stream_put_prefix (s, &rn->p);
+      nlri++;
       
       if (BGP_DEBUG (update, UPDATE_OUT))
 	zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d",
@@ -211,16 +327,35 @@ bgp_update_packet (struct peer *peer, afi_t afi, safi_t safi)
 
       adj->attr = bgp_attr_intern (adv->baa->attr);
 
-      adv = bgp_advertise_clean (peer, adj, afi, safi);
+      if (adv->received.tv_sec && adv->binfo)
+	bgp_latency_add (adv->binfo->peer->latency, BGP_LATENCY_ADVERTISE,
+			 bgp_latency_elapsed (&adv->received));
 
-      if (! (afi == AFI_IP && safi == SAFI_UNICAST))
-	break;
+      adv = bgp_advertise_clean (peer, adj, afi, safi);
     }
 	 
+  if (cached)
+    {
+      packet = cached;
+      peer->announce_packets[afi][safi]++;
+      peer->announce_prefixes[afi][safi] += nlri;
+      bgp_packet_add (peer, packet);
+      BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
+      return packet;
+    }
   if (! stream_empty (s))
     {
-      bgp_packet_set_size (s);
-      packet = stream_dup (s);
+      if (stream_get_endp (mp_nlri))
+	packet = bgp_packet_mpattr_join (s, mp_nlri, mpattr_lenp, mpattr_end);
+      else
+	{
+	  bgp_packet_set_size (s);
+	  packet = stream_dup (s);
+	}
+      peer->announce_packets[afi][safi]++;
+      peer->announce_prefixes[afi][safi] += nlri;
+      update_group_packet_save (peer, afi, safi, packet, first, attr,
+				from);
       bgp_packet_add (peer, packet);
       BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
       stream_reset (s);
@@ -281,9 +416,10 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
   struct bgp_adj_out *adj;
   struct bgp_advertise *adv;
   struct bgp_node *rn;
-  unsigned long pos;
+  unsigned long pos = 0;
+  unsigned int nlri = 0;
   bgp_size_t unfeasible_len;
-  bgp_size_t total_attr_len;
+  bgp_size_t total_attr_len = 0;
   char buf[BUFSIZ];
 
   s = peer->work;
@@ -298,6 +434,9 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
       if (STREAM_REMAIN (s) 
 	  < (BGP_NLRI_LENGTH + BGP_TOTAL_ATTR_LEN + PSIZE (rn->p.prefixlen)))
 	break;
+      if (! (afi == AFI_IP && safi == SAFI_UNICAST)
+	  && STREAM_REMAIN (s) < bgp_packet_mpattr_prefix_size (safi, &rn->p))
+	break;
 
       if (stream_empty (s))
 	{
@@ -313,14 +452,31 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 	  
 	  if (rn->prn)
 	    prd = (struct prefix_rd *) &rn->prn->p;
-	  pos = stream_get_endp (s);
-	  stream_putw (s, 0);
-	  total_attr_len
-	    = bgp_packet_withdraw (peer, s, &rn->p, afi, safi, prd, NULL);
+
+	  if (! total_attr_len)
+	    {
+	      pos = stream_get_endp (s);
+	      stream_putw (s, 0);
+	      total_attr_len
+		= bgp_packet_withdraw (peer, s, &rn->p, afi, safi, prd, NULL);
+	    }
+	  else
+	    {
+	      /* MP_UNREACH_NLRI is the only attribute, so the prefix
+		 goes on the end of the packet.  */
+	      size_t size = bgp_packet_mpattr_prefix_size (safi, &rn->p);
+
+	      bgp_packet_mpattr_prefix (s, &rn->p, safi, prd, NULL);
+	      stream_putw_at (s, pos + BGP_TOTAL_ATTR_LEN + 2,
+			      stream_getw_from (s, pos + BGP_TOTAL_ATTR_LEN + 2)
+			      + size);
+	      total_attr_len += size;
+	    }
       
 	  /* Set total path attribute length. */
 	  stream_putw_at (s, pos, total_attr_len);
 	}
+      nlri++;
 
       if (BGP_DEBUG (update, UPDATE_OUT))
 	zlog (peer->log, LOG_DEBUG, "%s send UPDATE %s/%d -- unreachable",
@@ -332,9 +488,6 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 
       bgp_adj_out_remove (rn, adj, peer, afi, safi);
       bgp_unlock_node (rn);
-
-      if (! (afi == AFI_IP && safi == SAFI_UNICAST))
-	break;
     }
 
   if (! stream_empty (s))
@@ -348,6 +501,8 @@ bgp_withdraw_packet (struct peer *peer, afi_t afi, safi_t safi)
 	}
       bgp_packet_set_size (s);
       packet = stream_dup (s);
+      peer->withdraw_packets[afi][safi]++;
+      peer->withdraw_prefixes[afi][safi] += nlri;
       bgp_packet_add (peer, packet);
       stream_reset (s);
       return packet;
@@ -497,7 +652,8 @@ bgp_default_withdraw_send (struct peer *peer, afi_t afi, safi_t safi)
   BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 }
 
-/* Get next packet to be written.  */
+/* Make the next packet to be written, which is queued on obuf.
+   Returns NULL when there is nothing more to send right now.  */
 static struct stream *
 bgp_write_packet (struct peer *peer)
 {
@@ -506,10 +662,6 @@ bgp_write_packet (struct peer *peer)
   struct stream *s = NULL;
   struct bgp_advertise *adv;
 
-  s = stream_fifo_head (peer->obuf);
-  if (s)
-    return s;
-
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
       {
@@ -588,16 +740,21 @@ bgp_write_proceed (struct peer *peer)
   return 0;
 }
 
-/* Write packet to the peer. */
+/* Write packets to the peer.  Up to BGP_WRITE_PACKET_MAX packets
+   are queued on obuf and handed to the kernel in a single writev(),
+   then those fully written are accounted for and freed.  */
 int
 bgp_write (struct thread *thread)
 {
   struct peer *peer;
   u_char type;
   struct stream *s; 
-  int num;
-  unsigned int count = 0;
+  struct iovec iov[BGP_WRITE_PACKET_MAX];
+  int iovcnt;
+  ssize_t num;
+  size_t writenum;
   int write_errno;
+  int val;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
@@ -610,51 +767,64 @@ bgp_write (struct thread *thread)
       return 0;
     }
 
-    /* Nonblocking write until TCP output buffer is full.  */
-  while (1)
+  /* Top up the output queue, then gather it.  */
+  while (peer->obuf->count < BGP_WRITE_PACKET_MAX)
+    if (! bgp_write_packet (peer))
+      break;
+
+  iovcnt = 0;
+  for (s = stream_fifo_head (peer->obuf);
+       s && iovcnt < BGP_WRITE_PACKET_MAX; s = s->next)
     {
-      int writenum;
-      int val;
+      iov[iovcnt].iov_base = STREAM_PNT (s);
+      iov[iovcnt].iov_len = stream_get_endp (s) - stream_get_getp (s);
+      iovcnt++;
+    }
 
-      s = bgp_write_packet (peer);
-      if (! s)
-	return 0;
-      
-      /* XXX: FIXME, the socket should be NONBLOCK from the start
-       * status shouldnt need to be toggled on each write
-       */
-      val = fcntl (peer->fd, F_GETFL, 0);
-      fcntl (peer->fd, F_SETFL, val|O_NONBLOCK);
+  if (iovcnt == 0)
+    return 0;
 
-      /* Number of bytes to be sent.  */
-      writenum = stream_get_endp (s) - stream_get_getp (s);
+  /* XXX: FIXME, the socket should be NONBLOCK from the start
+   * status shouldnt need to be toggled on each write
+   */
+  val = fcntl (peer->fd, F_GETFL, 0);
+  fcntl (peer->fd, F_SETFL, val|O_NONBLOCK);
 
-      /* Call write() system call.  */
-      num = write (peer->fd, STREAM_PNT (s), writenum);
-      write_errno = errno;
-      fcntl (peer->fd, F_SETFL, val);
-      if (num <= 0)
-	{
-	  /* Partial write. */
-	  if (write_errno == EWOULDBLOCK || write_errno == EAGAIN)
-	      break;
+  num = writev (peer->fd, iov, iovcnt);
+  write_errno = errno;
+  fcntl (peer->fd, F_SETFL, val);
+
+  peer->write_calls++;
 
-	  BGP_EVENT_ADD (peer, TCP_fatal_error);
+  if (num <= 0)
+    {
+      if (num < 0 && (write_errno == EWOULDBLOCK || write_errno == EAGAIN
+		      || write_errno == EINTR))
+	{
+	  BGP_WRITE_ON (peer->t_write, bgp_write, peer->fd);
 	  return 0;
 	}
-      if (num != writenum)
-	{
-	  stream_forward_getp (s, num);
 
-	  if (write_errno == EAGAIN)
-	    break;
+      BGP_EVENT_ADD (peer, TCP_fatal_error);
+      return 0;
+    }
+
+  peer->write_bytes += num;
 
-	  continue;
+  /* Retire the packets written, leaving any partially written one at
+     the head of obuf to be continued next time.  */
+  while (num > 0 && (s = stream_fifo_head (peer->obuf)) != NULL)
+    {
+      writenum = stream_get_endp (s) - stream_get_getp (s);
+      if ((size_t) num < writenum)
+	{
+	  stream_forward_getp (s, num);
+	  break;
 	}
+      num -= writenum;
 
       /* Retrieve BGP packet type. */
-      stream_set_getp (s, BGP_MARKER_SIZE + 2);
-      type = stream_getc (s);
+      type = stream_getc_from (s, BGP_MARKER_SIZE + 2);
 
       switch (type)
 	{
@@ -663,6 +833,7 @@ bgp_write (struct thread *thread)
 	  break;
 	case BGP_MSG_UPDATE:
 	  peer->update_out++;
+	  peer->latency->update_out++;
 	  break;
 	case BGP_MSG_NOTIFY:
 	  peer->notify_out++;
@@ -690,9 +861,6 @@ bgp_write (struct thread *thread)
 
       /* OK we send packet so delete it. */
       bgp_packet_delete (peer);
-
-      if (++count >= BGP_WRITE_PACKET_MAX)
-	break;
     }
   
   if (bgp_write_proceed (peer))
@@ -1332,6 +1500,9 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
       realpeer->ibuf = peer->ibuf;
       realpeer->packet_size = peer->packet_size;
       peer->ibuf = NULL;
+      stream_free (realpeer->ibuf_work);
+      realpeer->ibuf_work = peer->ibuf_work;
+      peer->ibuf_work = NULL;
 
       /* Transfer status. */
       realpeer->status = peer->status;
@@ -1458,6 +1629,9 @@ bgp_open_receive (struct peer *peer, bgp_size_t size)
   if (peer->ibuf)
     stream_reset (peer->ibuf);
 
+  /* Anything the peer sent after the OPEN waits for the event. */
+  bgp_read_resume (peer);
+
   return 0;
 }
 
@@ -1791,6 +1965,32 @@ bgp_update_receive (struct peer *peer, bgp_size_t size)
   return 0;
 }
 
+/* bgp_update_receive, timed as threads are.  The routes it processes
+   are tagged with when the UPDATE was received, for the time they take
+   to reach zebra and the other peers.  */
+static void
+bgp_read_update (struct peer *peer, bgp_size_t size)
+{
+  RUSAGE_T before;
+  RUSAGE_T after;
+  unsigned long realtime;
+  unsigned long cputime;
+
+  GETRUSAGE (&before);
+
+  bgp_latency_peer = peer;
+  bgp_latency_received = before.real;
+  bgp_update_receive (peer, size);
+  bgp_latency_peer = NULL;
+
+  GETRUSAGE (&after);
+  realtime = thread_consumed_time (&after, &before, &cputime);
+
+  peer->latency->update_in++;
+  bgp_latency_add (peer->latency, BGP_LATENCY_PARSE, realtime);
+  bgp_latency_add (peer->latency, BGP_LATENCY_PARSE_CPU, cputime);
+}
+
 /* Notify message treatment function. */
 static void
 bgp_notify_receive (struct peer *peer, bgp_size_t size)
@@ -2198,21 +2398,28 @@ bgp_capability_receive (struct peer *peer, bgp_size_t size)
   return bgp_capability_msg_parse (peer, pnt, size);
 }
 
-/* BGP read utility function. */
+/* BGP read utility function.  Reads as much as the socket has, and
+   there is room for, into ibuf_work behind any partial message left
+   over from last time.  */
 static int
 bgp_read_packet (struct peer *peer)
 {
+  struct stream *s;
   int nbytes;
-  int readsize;
 
-  readsize = peer->packet_size - stream_get_endp (peer->ibuf);
+  s = peer->ibuf_work;
 
-  /* If size is zero then return. */
-  if (! readsize)
+  /* Move the partial message, if any, to the front to make room. */
+  if (stream_get_getp (s))
+    stream_pulldown (s);
+
+  /* If there is no room then return. */
+  if (! STREAM_WRITEABLE (s))
     return 0;
 
   /* Read packet from fd. */
-  nbytes = stream_read_unblock (peer->ibuf, peer->fd, readsize);
+  nbytes = stream_read_unblock (s, peer->fd, STREAM_WRITEABLE (s));
+  peer->read_calls++;
 
   /* If read byte is smaller than zero then error occured. */
   if (nbytes < 0) 
@@ -2260,13 +2467,44 @@ bgp_read_packet (struct peer *peer)
       return -1;
     }
 
-  /* We read partial packet. */
-  if (stream_get_endp (peer->ibuf) != peer->packet_size)
-    return -1;
+  peer->read_bytes += nbytes;
 
   return 0;
 }
 
+/* Is there a whole message, or a header which will be rejected, at
+   the front of ibuf_work?  */
+static int
+bgp_read_complete (struct peer *peer)
+{
+  struct stream *s;
+  bgp_size_t size;
+
+  s = peer->ibuf_work;
+  if (! s || STREAM_READABLE (s) < BGP_HEADER_SIZE)
+    return 0;
+
+  size = stream_getw_from (s, stream_get_getp (s) + BGP_MARKER_SIZE);
+  if (size < BGP_HEADER_SIZE || size > BGP_MAX_PACKET_SIZE)
+    return 1;
+
+  return STREAM_READABLE (s) >= size;
+}
+
+/* bgp_read stopped with messages still buffered: have it called again
+   straight away, rather than waiting for the socket to become
+   readable, which it may not.  */
+static void
+bgp_read_resume (struct peer *peer)
+{
+  if (peer->t_read && peer->t_read->type != THREAD_EVENT
+      && bgp_read_complete (peer))
+    {
+      BGP_READ_OFF (peer->t_read);
+      peer->t_read = thread_add_event (master, bgp_read, peer, 0);
+    }
+}
+
 /* Marker check. */
 static int
 bgp_marker_all_one (struct stream *s, int length)
@@ -2274,13 +2512,90 @@ bgp_marker_all_one (struct stream *s, int length)
   int i;
 
   for (i = 0; i < length; i++)
-    if (s->data[i] != 0xff)
+    if (s->data[s->getp + i] != 0xff)
       return 0;
 
   return 1;
 }
 
-/* Starting point of packet process function. */
+/* Check the header of the message at the front of ibuf_work, sending
+   a NOTIFY if it is bad.  Returns the message size or 0.  */
+static bgp_size_t
+bgp_read_header (struct peer *peer)
+{
+  struct stream *s;
+  u_char type;
+  bgp_size_t size;
+  char notify_data_length[2];
+
+  s = peer->ibuf_work;
+
+  /* Get size and type. */
+  memcpy (notify_data_length, stream_pnt (s) + BGP_MARKER_SIZE, 2);
+  size = stream_getw_from (s, stream_get_getp (s) + BGP_MARKER_SIZE);
+  type = stream_getc_from (s, stream_get_getp (s) + BGP_MARKER_SIZE + 2);
+
+  if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
+    zlog_debug ("%s rcv message type %d, length (excl. header) %d",
+	       peer->host, type, size - BGP_HEADER_SIZE);
+
+  /* Marker check */
+  if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
+      && ! bgp_marker_all_one (s, BGP_MARKER_SIZE))
+    {
+      bgp_notify_send (peer,
+		       BGP_NOTIFY_HEADER_ERR, 
+		       BGP_NOTIFY_HEADER_NOT_SYNC);
+      return 0;
+    }
+
+  /* BGP type check. */
+  if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
+      && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
+      && type != BGP_MSG_ROUTE_REFRESH_NEW
+      && type != BGP_MSG_ROUTE_REFRESH_OLD
+      && type != BGP_MSG_CAPABILITY)
+    {
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s unknown message type 0x%02x",
+		  peer->host, type);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESTYPE,
+				 &type, 1);
+      return 0;
+    }
+  /* Mimimum packet length check. */
+  if ((size < BGP_HEADER_SIZE)
+      || (size > BGP_MAX_PACKET_SIZE)
+      || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
+      || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
+      || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
+      || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
+      || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
+    {
+      if (BGP_DEBUG (normal, NORMAL))
+	plog_debug (peer->log,
+		  "%s bad message length - %d for %s",
+		  peer->host, size, 
+		  type == 128 ? "ROUTE-REFRESH" :
+		  bgp_type_str[(int) type]);
+      bgp_notify_send_with_data (peer,
+				 BGP_NOTIFY_HEADER_ERR,
+				 BGP_NOTIFY_HEADER_BAD_MESLEN,
+				 (u_char *) notify_data_length, 2);
+      return 0;
+    }
+
+  return size;
+}
+
+/* Starting point of packet process function.  Reads whatever the
+   socket has into ibuf_work, then handles each whole message found
+   there in turn, copying it to ibuf for the receive functions.  */
 int
 bgp_read (struct thread *thread)
 {
@@ -2288,7 +2603,8 @@ bgp_read (struct thread *thread)
   u_char type = 0;
   struct peer *peer;
   bgp_size_t size;
-  char notify_data_length[2];
+  u_int32_t notify_in;
+  u_int32_t notify_out;
 
   /* Yes first of all get peer pointer. */
   peer = THREAD_ARG (thread);
@@ -2310,129 +2626,92 @@ bgp_read (struct thread *thread)
       BGP_READ_ON (peer->t_read, bgp_read, peer->fd);
     }
 
-  /* Read packet header to determine type of the packet */
-  if (peer->packet_size == 0)
-    peer->packet_size = BGP_HEADER_SIZE;
-
-  if (stream_get_endp (peer->ibuf) < BGP_HEADER_SIZE)
+  /* Only go to the socket once what was read before is used up. */
+  if (! bgp_read_complete (peer))
     {
       ret = bgp_read_packet (peer);
 
-      /* Header read error or partial read packet. */
+      /* Read error or nothing to read. */
       if (ret < 0) 
 	goto done;
+    }
 
-      /* Get size and type. */
-      stream_forward_getp (peer->ibuf, BGP_MARKER_SIZE);
-      memcpy (notify_data_length, stream_pnt (peer->ibuf), 2);
-      size = stream_getw (peer->ibuf);
-      type = stream_getc (peer->ibuf);
+  while (STREAM_READABLE (peer->ibuf_work) >= BGP_HEADER_SIZE)
+    {
+      size = bgp_read_header (peer);
+      if (! size)
+	goto done;
 
-      if (BGP_DEBUG (normal, NORMAL) && type != 2 && type != 0)
-	zlog_debug ("%s rcv message type %d, length (excl. header) %d",
-		   peer->host, type, size - BGP_HEADER_SIZE);
+      /* Partial read packet. */
+      if (STREAM_READABLE (peer->ibuf_work) < size)
+	break;
 
-      /* Marker check */
-      if (((type == BGP_MSG_OPEN) || (type == BGP_MSG_KEEPALIVE))
-	  && ! bgp_marker_all_one (peer->ibuf, BGP_MARKER_SIZE))
-	{
-	  bgp_notify_send (peer,
-			   BGP_NOTIFY_HEADER_ERR, 
-			   BGP_NOTIFY_HEADER_NOT_SYNC);
-	  goto done;
-	}
+      /* Hand the message over in ibuf, positioned after the header. */
+      stream_reset (peer->ibuf);
+      stream_put (peer->ibuf, stream_pnt (peer->ibuf_work), size);
+      stream_forward_getp (peer->ibuf_work, size);
+      stream_forward_getp (peer->ibuf, BGP_HEADER_SIZE);
+      peer->packet_size = size;
 
-      /* BGP type check. */
-      if (type != BGP_MSG_OPEN && type != BGP_MSG_UPDATE 
-	  && type != BGP_MSG_NOTIFY && type != BGP_MSG_KEEPALIVE 
-	  && type != BGP_MSG_ROUTE_REFRESH_NEW
-	  && type != BGP_MSG_ROUTE_REFRESH_OLD
-	  && type != BGP_MSG_CAPABILITY)
-	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s unknown message type 0x%02x",
-		      peer->host, type);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			 	     BGP_NOTIFY_HEADER_BAD_MESTYPE,
-				     &type, 1);
-	  goto done;
-	}
-      /* Mimimum packet length check. */
-      if ((size < BGP_HEADER_SIZE)
-	  || (size > BGP_MAX_PACKET_SIZE)
-	  || (type == BGP_MSG_OPEN && size < BGP_MSG_OPEN_MIN_SIZE)
-	  || (type == BGP_MSG_UPDATE && size < BGP_MSG_UPDATE_MIN_SIZE)
-	  || (type == BGP_MSG_NOTIFY && size < BGP_MSG_NOTIFY_MIN_SIZE)
-	  || (type == BGP_MSG_KEEPALIVE && size != BGP_MSG_KEEPALIVE_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_NEW && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_ROUTE_REFRESH_OLD && size < BGP_MSG_ROUTE_REFRESH_MIN_SIZE)
-	  || (type == BGP_MSG_CAPABILITY && size < BGP_MSG_CAPABILITY_MIN_SIZE))
+      type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
+
+      /* BGP packet dump function. */
+      bgp_dump_packet (peer, type, peer->ibuf);
+  
+      size = (peer->packet_size - BGP_HEADER_SIZE);
+
+      notify_in = peer->notify_in;
+      notify_out = peer->notify_out;
+
+      /* Read rest of the packet and call each sort of packet routine */
+      switch (type) 
 	{
-	  if (BGP_DEBUG (normal, NORMAL))
-	    plog_debug (peer->log,
-		      "%s bad message length - %d for %s",
-		      peer->host, size, 
-		      type == 128 ? "ROUTE-REFRESH" :
-		      bgp_type_str[(int) type]);
-	  bgp_notify_send_with_data (peer,
-				     BGP_NOTIFY_HEADER_ERR,
-			  	     BGP_NOTIFY_HEADER_BAD_MESLEN,
-				     (u_char *) notify_data_length, 2);
-	  goto done;
+	case BGP_MSG_OPEN:
+	  peer->open_in++;
+	  bgp_open_receive (peer, size); /* XXX return value ignored! */
+	  break;
+	case BGP_MSG_UPDATE:
+	  peer->readtime = time(NULL);    /* Last read timer reset */
+	  bgp_read_update (peer, size);
+	  break;
+	case BGP_MSG_NOTIFY:
+	  bgp_notify_receive (peer, size);
+	  break;
+	case BGP_MSG_KEEPALIVE:
+	  peer->readtime = time(NULL);    /* Last read timer reset */
+	  bgp_keepalive_receive (peer, size);
+	  break;
+	case BGP_MSG_ROUTE_REFRESH_NEW:
+	case BGP_MSG_ROUTE_REFRESH_OLD:
+	  peer->refresh_in++;
+	  bgp_route_refresh_receive (peer, size);
+	  break;
+	case BGP_MSG_CAPABILITY:
+	  peer->dynamic_cap_in++;
+	  bgp_capability_receive (peer, size);
+	  break;
 	}
 
-      /* Adjust size to message length. */
-      peer->packet_size = size;
-    }
-
-  ret = bgp_read_packet (peer);
-  if (ret < 0) 
-    goto done;
+      /* Clear input buffer. */
+      peer->packet_size = 0;
+      if (peer->ibuf)
+	stream_reset (peer->ibuf);
 
-  /* Get size and type again. */
-  size = stream_getw_from (peer->ibuf, BGP_MARKER_SIZE);
-  type = stream_getc_from (peer->ibuf, BGP_MARKER_SIZE + 2);
+      /* The connection went over to the existing peer with the OPEN. */
+      if (! peer->ibuf_work)
+	goto done;
 
-  /* BGP packet dump function. */
-  bgp_dump_packet (peer, type, peer->ibuf);
-  
-  size = (peer->packet_size - BGP_HEADER_SIZE);
+      /* Messages before Established, and NOTIFYs, drive the FSM through
+	 events, which must run before the next message is looked at.  */
+      if (peer->status != Established
+	  || peer->notify_in != notify_in || peer->notify_out != notify_out)
+	break;
 
-  /* Read rest of the packet and call each sort of packet routine */
-  switch (type) 
-    {
-    case BGP_MSG_OPEN:
-      peer->open_in++;
-      bgp_open_receive (peer, size); /* XXX return value ignored! */
-      break;
-    case BGP_MSG_UPDATE:
-      peer->readtime = time(NULL);    /* Last read timer reset */
-      bgp_update_receive (peer, size);
-      break;
-    case BGP_MSG_NOTIFY:
-      bgp_notify_receive (peer, size);
-      break;
-    case BGP_MSG_KEEPALIVE:
-      peer->readtime = time(NULL);    /* Last read timer reset */
-      bgp_keepalive_receive (peer, size);
-      break;
-    case BGP_MSG_ROUTE_REFRESH_NEW:
-    case BGP_MSG_ROUTE_REFRESH_OLD:
-      peer->refresh_in++;
-      bgp_route_refresh_receive (peer, size);
-      break;
-    case BGP_MSG_CAPABILITY:
-      peer->dynamic_cap_in++;
-      bgp_capability_receive (peer, size);
-      break;
+      if (thread_should_yield (thread))
+	break;
     }
 
-  /* Clear input buffer. */
-  peer->packet_size = 0;
-  if (peer->ibuf)
-    stream_reset (peer->ibuf);
+  bgp_read_resume (peer);
 
  done:
   if (CHECK_FLAG (peer->sflags, PEER_STATUS_ACCEPT_PEER))
@@ -51,5 +51,7 @@ extern void bgp_capability_send (struct peer *, afi_t, safi_t, int, int);
 extern void bgp_default_update_send (struct peer *, struct attr *,
 			      afi_t, safi_t, struct peer *);
 extern void bgp_default_withdraw_send (struct peer *, afi_t, safi_t);
+extern size_t bgp_packet_mpattr_find (struct stream *, size_t, size_t,
+				      size_t *);
 
 #endif /* _QUAGGA_BGP_PACKET_H */
@@ -28,6 +28,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "filter.h"
 #include "str.h"
 #include "log.h"
+#include "hash.h"
 #include "routemap.h"
 #include "buffer.h"
 #include "sockunion.h"
@@ -54,6 +55,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_zebra.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_latency.h"
 
 /* Extern from bgp_dump.c */
 extern char *bgp_origin_str[];
@@ -144,6 +147,7 @@ bgp_info_free (struct bgp_info *binfo)
   if (binfo->attr)
     bgp_attr_unintern (binfo->attr);
   
+  bgp_nexthop_unlink (binfo);
   bgp_info_extra_free (&binfo->extra);
 
   peer_unlock (binfo->peer); /* bgp_info peer reference */
@@ -197,6 +201,7 @@ bgp_info_add (struct bgp_node *rn, struct bgp_info *ri)
   if (top)
     top->prev = ri;
   rn->info = ri;
+  SET_FLAG (ri->flags, BGP_INFO_CHANGED);
   
   bgp_info_lock (ri);
   bgp_lock_node (rn);
@@ -283,6 +288,11 @@ void
 bgp_info_set_flag (struct bgp_node *rn, struct bgp_info *ri, u_int32_t flag)
 {
   SET_FLAG (ri->flags, flag);
+
+  /* Best path selection needs to look at the path again? */
+  if (CHECK_FLAG (flag, ~(BGP_INFO_SELECTED|BGP_INFO_DMED_CHECK
+			  |BGP_INFO_DMED_SELECTED)))
+    SET_FLAG (ri->flags, BGP_INFO_CHANGED);
   
   /* early bath if we know it's not a flag that changes useability state */
   if (!CHECK_FLAG (flag, BGP_INFO_VALID|BGP_INFO_UNUSEABLE))
@@ -295,6 +305,10 @@ void
 bgp_info_unset_flag (struct bgp_node *rn, struct bgp_info *ri, u_int32_t flag)
 {
   UNSET_FLAG (ri->flags, flag);
+
+  if (CHECK_FLAG (flag, ~(BGP_INFO_SELECTED|BGP_INFO_DMED_CHECK
+			  |BGP_INFO_DMED_SELECTED|BGP_INFO_ATTR_CHANGED)))
+    SET_FLAG (ri->flags, BGP_INFO_CHANGED);
   
   /* early bath if we know it's not a flag that changes useability state */
   if (!CHECK_FLAG (flag, BGP_INFO_VALID|BGP_INFO_UNUSEABLE))
@@ -726,22 +740,14 @@ bgp_import_modifier (struct peer *rsclient, struct peer *peer,
   return RMAP_PERMIT;
 }
 
+/* The checks of bgp_announce_check which turn on the individual peer,
+   rather than on its outbound policy.  */
 static int
-bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
-		    struct attr *attr, afi_t afi, safi_t safi)
+bgp_announce_check_peer (struct bgp_info *ri, struct peer *peer,
+			 struct prefix *p, afi_t afi, safi_t safi)
 {
-  int ret;
   char buf[SU_ADDRSTRLEN];
-  struct bgp_filter *filter;
-  struct peer *from;
-  struct bgp *bgp;
-  int transparent;
-  int reflect;
 
-  from = ri->peer;
-  filter = &peer->filter[afi][safi];
-  bgp = peer->bgp;
-  
   if (DISABLE_BGP_ANNOUNCE)
     return 0;
 
@@ -750,7 +756,7 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
     return 0;
 
   /* Do not send back route to sender. */
-  if (from == peer)
+  if (ri->peer == peer)
     return 0;
 
   /* If peer's id and route's nexthop are same. draft-ietf-idr-bgp4-23 5.1.3 */
@@ -763,11 +769,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
     return 0;
 #endif
 
-  /* Aggregate-address suppress check. */
-  if (ri->extra && ri->extra->suppress)
-    if (! UNSUPPRESS_MAP_NAME (filter))
-      return 0;
-
   /* Default route check.  */
   if (CHECK_FLAG (peer->af_sflags[afi][safi], PEER_STATUS_DEFAULT_ORIGINATE))
     {
@@ -779,17 +780,6 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
 #endif /* HAVE_IPV6 */
     }
 
-  /* Transparency check. */
-  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
-      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
-    transparent = 1;
-  else
-    transparent = 0;
-
-  /* If community is not disabled check the no-export and local. */
-  if (! transparent && bgp_community_filter (peer, ri->attr)) 
-    return 0;
-
   /* If the attribute has originator-id and it is same as remote
      peer's id. */
   if (ri->attr->flag & ATTR_FLAG_BIT (BGP_ATTR_ORIGINATOR_ID))
@@ -816,6 +806,44 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
           return 0;
       }
 
+  return 1;
+}
+
+/* The rest of bgp_announce_check, which comes out the same for all the
+   peers of an update-group.  */
+static int
+bgp_announce_check_policy (struct bgp_info *ri, struct peer *peer,
+			   struct prefix *p, struct attr *attr,
+			   afi_t afi, safi_t safi)
+{
+  int ret;
+  char buf[SU_ADDRSTRLEN];
+  struct bgp_filter *filter;
+  struct peer *from;
+  struct bgp *bgp;
+  int transparent;
+  int reflect;
+
+  from = ri->peer;
+  filter = &peer->filter[afi][safi];
+  bgp = peer->bgp;
+  
+  /* Aggregate-address suppress check. */
+  if (ri->extra && ri->extra->suppress)
+    if (! UNSUPPRESS_MAP_NAME (filter))
+      return 0;
+
+  /* Transparency check. */
+  if (CHECK_FLAG (peer->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT)
+      && CHECK_FLAG (from->af_flags[afi][safi], PEER_FLAG_RSERVER_CLIENT))
+    transparent = 1;
+  else
+    transparent = 0;
+
+  /* If community is not disabled check the no-export and local. */
+  if (! transparent && bgp_community_filter (peer, ri->attr)) 
+    return 0;
+
   /* Output filter check. */
   if (bgp_output_filter (peer, p, ri->attr, afi, safi) == FILTER_DENY)
     {
@@ -1079,6 +1107,40 @@ bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
   return 1;
 }
 
+static int
+bgp_announce_check (struct bgp_info *ri, struct peer *peer, struct prefix *p,
+		    struct attr *attr, afi_t afi, safi_t safi)
+{
+  return bgp_announce_check_peer (ri, peer, p, afi, safi)
+	 && bgp_announce_check_policy (ri, peer, p, attr, afi, safi);
+}
+
+/* bgp_announce_check, reusing the outbound attributes worked out for
+   another peer of the update-group where possible.  */
+static int
+bgp_announce_check_group (struct bgp_info *ri, struct peer *peer,
+			  struct bgp_node *rn, struct attr *attr,
+			  afi_t afi, safi_t safi)
+{
+  struct update_group *group;
+  int ret;
+
+  if (! bgp_announce_check_peer (ri, peer, &rn->p, afi, safi))
+    return 0;
+
+  group = update_group_peer (peer, afi, safi);
+  if (! UPDATE_GROUP_SHARED (group))
+    return bgp_announce_check_policy (ri, peer, &rn->p, attr, afi, safi);
+
+  ret = update_group_announce_lookup (group, rn, ri, attr);
+  if (ret >= 0)
+    return ret;
+
+  ret = bgp_announce_check_policy (ri, peer, &rn->p, attr, afi, safi);
+  update_group_announce_save (group, rn, ri, ret ? attr : NULL);
+  return ret;
+}
+
 static int
 bgp_announce_check_rsclient (struct bgp_info *ri, struct peer *rsclient,
         struct prefix *p, struct attr *attr, afi_t afi, safi_t safi)
@@ -1285,6 +1347,56 @@ struct bgp_info_pair
   struct bgp_info *new;
 };
 
+/* Compare only the paths changed since the last selection with the
+   path selected then, when that is still there and unchanged.  Paths
+   which were not selected and have not changed since still lose.  */
+static int
+bgp_best_selection_incremental (struct bgp *bgp, struct bgp_node *rn,
+				struct bgp_info_pair *result)
+{
+  struct bgp_info *new_select;
+  struct bgp_info *old_select;
+  struct bgp_info *ri;
+  struct bgp_info *nextri = NULL;
+
+  /* Deterministic MED compares paths by neighbouring AS first, which a
+     single path can't be compared to.  */
+  if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
+    return 0;
+
+  for (old_select = rn->info; old_select; old_select = old_select->next)
+    if (CHECK_FLAG (old_select->flags, BGP_INFO_SELECTED))
+      break;
+
+  if (! old_select
+      || BGP_INFO_HOLDDOWN (old_select)
+      || CHECK_FLAG (old_select->flags, BGP_INFO_CHANGED))
+    return 0;
+
+  new_select = old_select;
+  for (ri = rn->info; (ri != NULL) && (nextri = ri->next, 1); ri = nextri)
+    {
+      if (! CHECK_FLAG (ri->flags, BGP_INFO_CHANGED))
+	continue;
+      UNSET_FLAG (ri->flags, BGP_INFO_CHANGED);
+
+      if (BGP_INFO_HOLDDOWN (ri))
+	{
+	  if (CHECK_FLAG (ri->flags, BGP_INFO_REMOVED))
+	    bgp_info_reap (rn, ri);
+	  continue;
+	}
+
+      if (bgp_info_cmp (bgp, ri, new_select))
+	new_select = ri;
+    }
+
+  bgp->select_incremental++;
+  result->old = old_select;
+  result->new = new_select;
+  return 1;
+}
+
 static void
 bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *result)
 {
@@ -1295,6 +1407,10 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *
   struct bgp_info *ri2;
   struct bgp_info *nextri = NULL;
   
+  if (bgp_best_selection_incremental (bgp, rn, result))
+    return;
+  bgp->select_full++;
+
   /* bgp deterministic-med */
   new_select = NULL;
   if (bgp_flag_check (bgp, BGP_FLAG_DETERMINISTIC_MED))
@@ -1338,6 +1454,7 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *
     {
       if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
 	old_select = ri;
+      UNSET_FLAG (ri->flags, BGP_INFO_CHANGED);
 
       if (BGP_INFO_HOLDDOWN (ri))
         {
@@ -1370,6 +1487,52 @@ bgp_best_selection (struct bgp *bgp, struct bgp_node *rn, struct bgp_info_pair *
     return;
 }
 
+static void
+bgp_best_selection_table_reset (struct bgp_table *table)
+{
+  struct bgp_node *rn;
+  struct bgp_info *ri;
+
+  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn))
+    for (ri = rn->info; ri; ri = ri->next)
+      if (CHECK_FLAG (ri->flags, BGP_INFO_SELECTED))
+	SET_FLAG (ri->flags, BGP_INFO_CHANGED);
+}
+
+/* Paths compare differently from now on, the next selection for each
+   route has to look at all of its paths.  */
+void
+bgp_best_selection_reset (struct bgp *bgp)
+{
+  struct bgp_node *rn;
+  struct listnode *node, *nnode;
+  struct peer *rsclient;
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      {
+	if (! bgp->rib[afi][safi])
+	  continue;
+
+	/* VPN routes are in a table for each route distinguisher. */
+	if (safi == SAFI_MPLS_VPN)
+	  {
+	    for (rn = bgp_table_top (bgp->rib[afi][safi]); rn;
+		 rn = bgp_route_next (rn))
+	      if (rn->info)
+		bgp_best_selection_table_reset (rn->info);
+	  }
+	else
+	  bgp_best_selection_table_reset (bgp->rib[afi][safi]);
+
+	for (ALL_LIST_ELEMENTS (bgp->rsclient, node, nnode, rsclient))
+	  if (rsclient->rib[afi][safi])
+	    bgp_best_selection_table_reset (rsclient->rib[afi][safi]);
+      }
+}
+
 static int
 bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
                                struct bgp_node *rn, afi_t afi, safi_t safi)
@@ -1397,7 +1560,8 @@ bgp_process_announce_selected (struct peer *peer, struct bgp_info *selected,
       case BGP_TABLE_MAIN:
       /* Announcement to peer->conf.  If the route is filtered,
          withdraw it. */
-        if (selected && bgp_announce_check (selected, peer, p, &attr, afi, safi))
+        if (selected
+	    && bgp_announce_check_group (selected, peer, rn, &attr, afi, safi))
           bgp_adj_out_set (rn, peer, p, &attr, afi, safi, selected);
         else
           bgp_adj_out_unset (rn, peer, p, afi, safi);
@@ -1424,8 +1588,28 @@ struct bgp_process_queue
   struct bgp_node *rn;
   afi_t afi;
   safi_t safi;
+
+  /* When queued, and if for an UPDATE from a peer, which and when it
+     was received.  */
+  struct timeval queued;
+  struct peer *peer;
+  struct timeval received;
 };
 
+/* Time spent waiting in the queue, and make what PQ leads to
+   attributable to the UPDATE it came from.  */
+static void
+bgp_process_latency_begin (struct bgp_process_queue *pq)
+{
+  if (! pq->peer)
+    return;
+
+  bgp_latency_add (pq->peer->latency, BGP_LATENCY_PROCESS_QUEUE,
+		   bgp_latency_elapsed (&pq->queued));
+  bgp_latency_peer = pq->peer;
+  bgp_latency_received = pq->received;
+}
+
 static wq_item_status
 bgp_process_rsclient (struct work_queue *wq, void *data)
 {
@@ -1441,6 +1625,8 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
   struct listnode *node, *nnode;
   struct peer *rsclient = rn->table->owner;
   
+  bgp_process_latency_begin (pq);
+
   memset (&attr, 0, sizeof (struct attr));
   /* Best path selection. */
   bgp_best_selection (bgp, rn, &old_and_new);
@@ -1484,6 +1670,7 @@ bgp_process_rsclient (struct work_queue *wq, void *data)
   
   bgp_attr_extra_free (&attr);
   
+  bgp_latency_peer = NULL;
   UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
   return WQ_SUCCESS;
 }
@@ -1503,6 +1690,8 @@ bgp_process_main (struct work_queue *wq, void *data)
   struct listnode *node, *nnode;
   struct peer *peer;
   
+  bgp_process_latency_begin (pq);
+
   /* Best path selection. */
   bgp_best_selection (bgp, rn, &old_and_new);
   old_select = old_and_new.old;
@@ -1514,8 +1703,12 @@ bgp_process_main (struct work_queue *wq, void *data)
       if (! CHECK_FLAG (old_select->flags, BGP_INFO_ATTR_CHANGED))
         {
           if (CHECK_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED))
-            bgp_zebra_announce (p, old_select, bgp);
+            {
+              bgp_zebra_announce (p, old_select, bgp);
+              UNSET_FLAG (old_select->flags, BGP_INFO_IGP_CHANGED);
+            }
           
+          bgp_latency_peer = NULL;
           UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
           return WQ_SUCCESS;
         }
@@ -1531,6 +1724,7 @@ bgp_process_main (struct work_queue *wq, void *data)
 
 
   /* Check each BGP peer. */
+  update_group_announce_begin ();
   for (ALL_LIST_ELEMENTS (bgp->peer, node, nnode, peer))
     {
       bgp_process_announce_selected (peer, new_select, rn, afi, safi);
@@ -1543,7 +1737,14 @@ bgp_process_main (struct work_queue *wq, void *data)
       if (new_select 
 	  && new_select->type == ZEBRA_ROUTE_BGP 
 	  && new_select->sub_type == BGP_ROUTE_NORMAL)
-	bgp_zebra_announce (p, new_select, bgp);
+	{
+	  bgp_zebra_announce (p, new_select, bgp);
+	  UNSET_FLAG (new_select->flags, BGP_INFO_IGP_CHANGED);
+
+	  if (pq->peer && pq->peer == new_select->peer)
+	    bgp_latency_add (pq->peer->latency, BGP_LATENCY_ZEBRA,
+			     bgp_latency_elapsed (&pq->received));
+	}
       else
 	{
 	  /* Withdraw the route from the kernel. */
@@ -1558,6 +1759,7 @@ bgp_process_main (struct work_queue *wq, void *data)
   if (old_select && CHECK_FLAG (old_select->flags, BGP_INFO_REMOVED))
     bgp_info_reap (rn, old_select);
   
+  bgp_latency_peer = NULL;
   UNSET_FLAG (rn->flags, BGP_NODE_PROCESS_SCHEDULED);
   return WQ_SUCCESS;
 }
@@ -1566,8 +1768,13 @@ static void
 bgp_processq_del (struct work_queue *wq, void *data)
 {
   struct bgp_process_queue *pq = data;
+  struct bgp_table *table = pq->rn->table;
   
   bgp_unlock_node (pq->rn);
+  bgp_table_unlock (table);
+  bgp_unlock (pq->bgp);
+  if (pq->peer)
+    peer_unlock (pq->peer); /* bgp_process reference */
   XFREE (MTYPE_BGP_PROCESS_QUEUE, pq);
 }
 
@@ -1615,9 +1822,17 @@ bgp_process (struct bgp *bgp, struct bgp_node *rn, afi_t afi, safi_t safi)
     return;
   
   pqnode->rn = bgp_lock_node (rn); /* unlocked by bgp_processq_del */
-  pqnode->bgp = bgp;
+  bgp_table_lock (rn->table); /* as is the table, it may be deleted first */
+  pqnode->bgp = bgp_lock (bgp); /* unlocked by bgp_processq_del */
   pqnode->afi = afi;
   pqnode->safi = safi;
+
+  quagga_gettime (QUAGGA_CLK_MONOTONIC, &pqnode->queued);
+  if (bgp_latency_peer)
+    {
+      pqnode->peer = peer_lock (bgp_latency_peer); /* bgp_processq_del */
+      pqnode->received = bgp_latency_received;
+    }
   
   switch (rn->table->type)
     {
@@ -2221,13 +2436,16 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	      || (peer_sort (peer) == BGP_PEER_EBGP && peer->ttl != 1)
 	      || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
 	{
-	  if (bgp_nexthop_lookup (afi, peer, ri, NULL, NULL))
+	  if (bgp_nexthop_lookup (afi, peer, rn, ri))
 	    bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
 	  else
 	    bgp_info_unset_flag (rn, ri, BGP_INFO_VALID);
 	}
       else
-        bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+	{
+	  bgp_nexthop_unlink (ri);
+	  bgp_info_set_flag (rn, ri, BGP_INFO_VALID);
+	}
 
       /* Process change. */
       bgp_aggregate_increment (bgp, p, ri, afi, safi);
@@ -2267,7 +2485,7 @@ bgp_update_main (struct peer *peer, struct prefix *p, struct attr *attr,
 	  || (peer_sort (peer) == BGP_PEER_EBGP && peer->ttl != 1)
 	  || CHECK_FLAG (peer->flags, PEER_FLAG_DISABLE_CONNECTED_CHECK)))
     {
-      if (bgp_nexthop_lookup (afi, peer, new, NULL, NULL))
+      if (bgp_nexthop_lookup (afi, peer, rn, new))
 	bgp_info_set_flag (rn, new, BGP_INFO_VALID);
       else
         bgp_info_unset_flag (rn, new, BGP_INFO_VALID);
@@ -2669,8 +2887,10 @@ static void
 bgp_clear_node_queue_del (struct work_queue *wq, void *data)
 {
   struct bgp_node *rn = data;
+  struct bgp_table *table = rn->table;
   
   bgp_unlock_node (rn); 
+  bgp_table_unlock (table);
 }
 
 static void
@@ -2766,6 +2986,7 @@ bgp_clear_route_table (struct peer *peer, afi_t afi, safi_t safi,
         if (ri->peer == peer)
           {
             bgp_lock_node (rn); /* unlocked: bgp_clear_node_queue_del */
+            bgp_table_lock (table); /* likewise */
             work_queue_add (peer->clear_node_queue, rn);
           }
 
@@ -2851,9 +3072,11 @@ bgp_clear_route (struct peer *peer, afi_t afi, safi_t safi)
   else
     {
       /* clearing queue scheduled. Normal if in Established state
-       * (and about to transition out of it), but otherwise...
+       * (and about to transition out of it), or for the instance's own
+       * routes, withdrawn but not yet reaped, as it is deleted.  But
+       * otherwise...
        */
-      if (peer->status != Established)
+      if (peer->status != Established && peer != peer->bgp->peer_self)
         {
           plog_err (peer->log, "%s [Error] State %s is not Established,"
                     " but routes were cleared - bug!",
@@ -5036,6 +5259,34 @@ bgp_aggregate_unset (struct vty *vty, const char *prefix_str,
   return CMD_SUCCESS;
 }
 
+/* Remove every aggregate-address of the instance being deleted, so that
+   routes cleared after it do not make new aggregates. */
+void
+bgp_aggregate_delete_all (struct bgp *bgp)
+{
+  afi_t afi;
+  safi_t safi;
+  struct bgp_node *rn;
+  struct bgp_aggregate *aggregate;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      for (rn = bgp_table_top (bgp->aggregate[afi][safi]); rn;
+	   rn = bgp_route_next (rn))
+	if ((aggregate = rn->info) != NULL)
+	  {
+	    if (aggregate->safi & SAFI_UNICAST)
+	      bgp_aggregate_delete (bgp, &rn->p, afi, SAFI_UNICAST, aggregate);
+	    if (aggregate->safi & SAFI_MULTICAST)
+	      bgp_aggregate_delete (bgp, &rn->p, afi, SAFI_MULTICAST,
+				    aggregate);
+
+	    rn->info = NULL;
+	    bgp_aggregate_free (aggregate);
+	    bgp_unlock_node (rn);
+	  }
+}
+
 DEFUN (aggregate_address,
        aggregate_address_cmd,
        "aggregate-address A.B.C.D/M",
@@ -6142,22 +6393,158 @@ enum bgp_show_type
   bgp_show_type_damp_neighbor
 };
 
+/* Whether an AS path matches the regexp of 'show ip bgp regexp'. */
+struct bgp_regexp_match
+{
+  struct aspath *aspath;
+  int result;
+};
+
+static unsigned int
+bgp_regexp_match_key (void *arg)
+{
+  struct bgp_regexp_match *match = arg;
+
+  return (unsigned long) match->aspath >> 4;
+}
+
 static int
-bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
-	  enum bgp_show_type type, void *output_arg)
+bgp_regexp_match_cmp (void *arg1, void *arg2)
+{
+  struct bgp_regexp_match *match1 = arg1;
+  struct bgp_regexp_match *match2 = arg2;
+
+  return match1->aspath == match2->aspath;
+}
+
+static void *
+bgp_regexp_match_alloc (void *arg)
+{
+  struct bgp_regexp_match *match;
+
+  match = XMALLOC (MTYPE_TMP, sizeof (struct bgp_regexp_match));
+  match->aspath = ((struct bgp_regexp_match *) arg)->aspath;
+  match->result = -1;
+  return match;
+}
+
+static void
+bgp_regexp_match_free (void *arg)
+{
+  XFREE (MTYPE_TMP, arg);
+}
+
+/* Many routes share each AS path, so run the regexp once per path.
+   The matches are kept for a chunk of output, no path is freed
+   meanwhile.  */
+static int
+bgp_show_regexp_match (struct hash **matches, regex_t *regex,
+		       struct aspath *aspath)
 {
+  struct bgp_regexp_match key;
+  struct bgp_regexp_match *match;
+
+  if (! *matches)
+    *matches = hash_create (bgp_regexp_match_key, bgp_regexp_match_cmp);
+
+  key.aspath = aspath;
+  match = hash_get (*matches, &key, bgp_regexp_match_alloc);
+  if (match->result < 0)
+    match->result = (bgp_regexec (regex, aspath) != REG_NOMATCH);
+  return match->result;
+}
+
+/* Where "show ip bgp" output has got to, kept with the vty while it is
+   made a chunk at a time.  What the routes are filtered by is copied
+   from the command, filters configured by name are looked up again for
+   each chunk in case they are changed meanwhile.  */
+struct bgp_show_state
+{
+  struct bgp_table *table;
+
+  /* Next node to look at, locked. */
+  struct bgp_node *rn;
+
+  struct in_addr router_id;
+  enum bgp_show_type type;
+
+  struct prefix p;
+  union sockunion su;
+  regex_t *regex;
+  struct community *com;
+  char *name;
+
+  int header;
+  unsigned long output_count;
+};
+
+/* Nodes looked at for each chunk of output. */
+#define BGP_SHOW_CHUNK 500
+
+/* What bgp_show_table's loop filters routes by, or NULL if a filter
+   has been deleted since.  */
+static void *
+bgp_show_filter (struct bgp_show_state *state)
+{
+  switch (state->type)
+    {
+    case bgp_show_type_regexp:
+    case bgp_show_type_flap_regexp:
+      return state->regex;
+    case bgp_show_type_prefix_list:
+    case bgp_show_type_flap_prefix_list:
+      return prefix_list_lookup (state->table->afi, state->name);
+    case bgp_show_type_filter_list:
+    case bgp_show_type_flap_filter_list:
+      return as_list_lookup (state->name);
+    case bgp_show_type_route_map:
+    case bgp_show_type_flap_route_map:
+      return route_map_lookup_by_name (state->name);
+    case bgp_show_type_community_list:
+    case bgp_show_type_community_list_exact:
+      return community_list_lookup (bgp_clist, state->name,
+				    COMMUNITY_LIST_MASTER);
+    case bgp_show_type_community:
+    case bgp_show_type_community_exact:
+      return state->com;
+    case bgp_show_type_neighbor:
+    case bgp_show_type_flap_neighbor:
+    case bgp_show_type_damp_neighbor:
+      return &state->su;
+    case bgp_show_type_prefix_longer:
+    case bgp_show_type_flap_prefix_longer:
+    case bgp_show_type_flap_address:
+    case bgp_show_type_flap_prefix:
+      return &state->p;
+    default:
+      return state;
+    }
+}
+
+/* Show the routes in the next chunk of the table.  Returns 0 once the
+   whole table has been shown.  */
+static int
+bgp_show_table_more (struct vty *vty)
+{
+  struct bgp_show_state *state = vty->output_arg;
+  enum bgp_show_type type = state->type;
   struct bgp_info *ri;
   struct bgp_node *rn;
-  int header = 1;
   int display;
-  unsigned long output_count;
+  int i;
+  void *output_arg;
+  struct hash *regexp_matches = NULL;
 
-  /* This is first entry point, so reset total line. */
-  output_count = 0;
+  output_arg = bgp_show_filter (state);
+  if (! output_arg)
+    {
+      vty_out (vty, "%% %s has been deleted%s", state->name, VTY_NEWLINE);
+      return 0;
+    }
 
-  /* Start processing of routes. */
-  for (rn = bgp_table_top (table); rn; rn = bgp_route_next (rn)) 
-    if (rn->info != NULL)
+  for (i = 0; state->rn && i < BGP_SHOW_CHUNK;
+       state->rn = bgp_route_next (state->rn), i++)
+    if ((rn = state->rn)->info != NULL)
       {
 	display = 0;
 
@@ -6184,7 +6571,8 @@ bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router
 	      {
 		regex_t *regex = output_arg;
 		    
-		if (bgp_regexec (regex, ri->attr->aspath) == REG_NOMATCH)
+		if (! bgp_show_regexp_match (&regexp_matches, regex,
+					     ri->attr->aspath))
 		  continue;
 	      }
 	    if (type == bgp_show_type_prefix_list
@@ -6307,9 +6695,9 @@ bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router
 		  continue;
 	      }
 
-	    if (header)
+	    if (state->header)
 	      {
-		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (*router_id), VTY_NEWLINE);
+		vty_out (vty, "BGP table version is 0, local router ID is %s%s", inet_ntoa (state->router_id), VTY_NEWLINE);
 		vty_out (vty, BGP_SHOW_SCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
 		vty_out (vty, BGP_SHOW_OCODE_HEADER, VTY_NEWLINE, VTY_NEWLINE);
 		if (type == bgp_show_type_dampend_paths
@@ -6328,7 +6716,7 @@ bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router
 		  vty_out (vty, BGP_SHOW_FLAP_HEADER, VTY_NEWLINE);
 		else
 		  vty_out (vty, BGP_SHOW_HEADER, VTY_NEWLINE);
-		header = 0;
+		state->header = 0;
 	      }
 
 	    if (type == bgp_show_type_dampend_paths
@@ -6350,19 +6738,103 @@ bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router
 	    display++;
 	  }
 	if (display)
-	  output_count++;
+	  state->output_count++;
       }
 
+  if (regexp_matches)
+    {
+      hash_clean (regexp_matches, bgp_regexp_match_free);
+      hash_free (regexp_matches);
+    }
+
+  if (state->rn)
+    return 1;
+
   /* No route is displayed */
-  if (output_count == 0)
+  if (state->output_count == 0)
     {
       if (type == bgp_show_type_normal)
 	vty_out (vty, "No BGP network exists%s", VTY_NEWLINE);
     }
   else
     vty_out (vty, "%sTotal number of prefixes %ld%s",
-	     VTY_NEWLINE, output_count, VTY_NEWLINE);
+	     VTY_NEWLINE, state->output_count, VTY_NEWLINE);
+
+  return 0;
+}
+
+static void
+bgp_show_table_clean (struct vty *vty)
+{
+  struct bgp_show_state *state = vty->output_arg;
+
+  if (state->rn)
+    bgp_unlock_node (state->rn);
+  bgp_table_unlock (state->table);
+
+  if (state->regex)
+    bgp_regex_free (state->regex);
+  if (state->com)
+    community_free (state->com);
+  if (state->name)
+    XFREE (MTYPE_TMP, state->name);
+  XFREE (MTYPE_BGP_SHOW, state);
+}
+
+/* Show the routes in TABLE, a chunk at a time as the vty takes them.
+   OUTPUT_ARG, what they are filtered by, is as for the types of show
+   command except that regexps and filters are given by their name; it
+   is copied.  */
+static int
+bgp_show_table (struct vty *vty, struct bgp_table *table, struct in_addr *router_id,
+	  enum bgp_show_type type, void *output_arg)
+{
+  struct bgp_show_state *state;
+
+  state = XCALLOC (MTYPE_BGP_SHOW, sizeof (struct bgp_show_state));
+  state->table = bgp_table_lock (table);
+  state->rn = bgp_table_top (table);
+  state->router_id = *router_id;
+  state->type = type;
+  state->header = 1;
 
+  switch (type)
+    {
+    case bgp_show_type_regexp:
+    case bgp_show_type_flap_regexp:
+      state->name = XSTRDUP (MTYPE_TMP, output_arg);
+      state->regex = bgp_regcomp (output_arg);
+      break;
+    case bgp_show_type_prefix_list:
+    case bgp_show_type_flap_prefix_list:
+    case bgp_show_type_filter_list:
+    case bgp_show_type_flap_filter_list:
+    case bgp_show_type_route_map:
+    case bgp_show_type_flap_route_map:
+    case bgp_show_type_community_list:
+    case bgp_show_type_community_list_exact:
+      state->name = XSTRDUP (MTYPE_TMP, output_arg);
+      break;
+    case bgp_show_type_community:
+    case bgp_show_type_community_exact:
+      state->com = community_dup (output_arg);
+      break;
+    case bgp_show_type_neighbor:
+    case bgp_show_type_flap_neighbor:
+    case bgp_show_type_damp_neighbor:
+      state->su = *(union sockunion *) output_arg;
+      break;
+    case bgp_show_type_prefix_longer:
+    case bgp_show_type_flap_prefix_longer:
+    case bgp_show_type_flap_address:
+    case bgp_show_type_flap_prefix:
+      prefix_copy (&state->p, output_arg);
+      break;
+    default:
+      break;
+    }
+
+  vty_output_more (vty, bgp_show_table_more, bgp_show_table_clean, state);
   return CMD_SUCCESS;
 }
 
@@ -7030,16 +7502,17 @@ bgp_show_regexp (struct vty *vty, int argc, const char **argv, afi_t afi,
   buffer_free (b);
 
   regex = bgp_regcomp (regstr);
-  XFREE(MTYPE_TMP, regstr);
   if (! regex)
     {
+      XFREE(MTYPE_TMP, regstr);
       vty_out (vty, "Can't compile regexp %s%s", argv[0],
 	       VTY_NEWLINE);
       return CMD_WARNING;
     }
-
-  rc = bgp_show (vty, NULL, afi, safi, type, regex);
   bgp_regex_free (regex);
+
+  rc = bgp_show (vty, NULL, afi, safi, type, regstr);
+  XFREE(MTYPE_TMP, regstr);
   return rc;
 }
 
@@ -7155,7 +7628,7 @@ bgp_show_prefix_list (struct vty *vty, const char *prefix_list_str, afi_t afi,
       return CMD_WARNING;
     }
 
-  return bgp_show (vty, NULL, afi, safi, type, plist);
+  return bgp_show (vty, NULL, afi, safi, type, (void *) prefix_list_str);
 }
 
 DEFUN (show_ip_bgp_prefix_list, 
@@ -7269,7 +7742,7 @@ bgp_show_filter_list (struct vty *vty, const char *filter, afi_t afi,
       return CMD_WARNING;
     }
 
-  return bgp_show (vty, NULL, afi, safi, type, as_list);
+  return bgp_show (vty, NULL, afi, safi, type, (void *) filter);
 }
 
 DEFUN (show_ip_bgp_filter_list, 
@@ -7384,7 +7857,7 @@ bgp_show_route_map (struct vty *vty, const char *rmap_str, afi_t afi,
       return CMD_WARNING;
     }
 
-  return bgp_show (vty, NULL, afi, safi, type, rmap);
+  return bgp_show (vty, NULL, afi, safi, type, (void *) rmap_str);
 }
 
 DEFUN (show_ip_bgp_route_map, 
@@ -7586,6 +8059,7 @@ bgp_show_community (struct vty *vty, int argc, const char **argv, int exact,
   int i;
   char *str;
   int first = 0;
+  int ret;
 
   b = buffer_new (1024);
   for (i = 0; i < argc; i++)
@@ -7614,9 +8088,11 @@ bgp_show_community (struct vty *vty, int argc, const char **argv, int exact,
       return CMD_WARNING;
     }
 
-  return bgp_show (vty, NULL, afi, safi,
-                   (exact ? bgp_show_type_community_exact :
-		            bgp_show_type_community), com);
+  ret = bgp_show (vty, NULL, afi, safi,
+                  (exact ? bgp_show_type_community_exact :
+		           bgp_show_type_community), com);
+  community_free (com);
+  return ret;
 }
 
 DEFUN (show_ip_bgp_community,
@@ -8593,7 +9069,7 @@ bgp_show_community_list (struct vty *vty, const char *com, int exact,
 
   return bgp_show (vty, NULL, afi, safi,
                    (exact ? bgp_show_type_community_list_exact :
-		            bgp_show_type_community_list), list);
+		            bgp_show_type_community_list), (void *) com);
 }
 
 DEFUN (show_ip_bgp_community_list,
@@ -38,6 +38,13 @@ struct bgp_info_extra
   /* Nexthop reachability check.  */
   u_int32_t igpmetric;
 
+  /* Nexthop cache entry tracking this route, the node the route is
+     in, and the other routes using the entry.  */
+  struct bgp_nexthop_cache *bnc;
+  struct bgp_node *rn;
+  struct bgp_info *bnc_next;
+  struct bgp_info *bnc_prev;
+
   /* MPLS label.  */
   u_char tag[3];  
 };
@@ -76,6 +83,7 @@ struct bgp_info
 #define BGP_INFO_STALE          (1 << 8)
 #define BGP_INFO_REMOVED        (1 << 9)
 #define BGP_INFO_COUNTED	(1 << 10)
+#define BGP_INFO_CHANGED	(1 << 11)
 
   /* BGP route type.  This can be static, RIP, OSPF, BGP etc.  */
   u_char type;
@@ -192,6 +200,7 @@ extern void bgp_redistribute_delete (struct prefix *, u_char);
 extern void bgp_redistribute_withdraw (struct bgp *, afi_t, int);
 
 extern void bgp_static_delete (struct bgp *);
+extern void bgp_aggregate_delete_all (struct bgp *);
 extern void bgp_static_update (struct bgp *, struct prefix *, struct bgp_static *,
 			afi_t, safi_t);
 extern void bgp_static_withdraw (struct bgp *, struct prefix *, afi_t, safi_t);
@@ -211,6 +220,7 @@ extern int bgp_withdraw (struct peer *, struct prefix *, struct attr *,
 
 /* for bgp_nexthop and bgp_damp */
 extern void bgp_process (struct bgp *, struct bgp_node *, afi_t, safi_t);
+extern void bgp_best_selection_reset (struct bgp *);
 extern int bgp_config_write_network (struct vty *, struct bgp *, afi_t, safi_t, int *);
 extern int bgp_config_write_distance (struct vty *, struct bgp *);
 
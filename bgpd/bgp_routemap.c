@@ -48,6 +48,7 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_mplsvpn.h"
 #include "bgpd/bgp_ecommunity.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
 
 /* Memo of route-map commands.
 
@@ -2311,6 +2312,8 @@ bgp_route_map_update (const char *unused)
   struct bgp_node *bn;
   struct bgp_static *bgp_static;
 
+  update_group_route_map_changed ();
+
   /* For neighbor route-map updates. */
   for (ALL_LIST_ELEMENTS (bm->bgp, mnode, mnnode, bgp))
     {
@@ -2411,6 +2414,27 @@ bgp_route_map_update (const char *unused)
     }
 }
 
+/* Hook function for rules added to or deleted from a route_map. */
+static void
+bgp_route_map_event (route_map_event_t event, const char *name)
+{
+  update_group_route_map_changed ();
+}
+
+/* Does what the route map does to a route depend on the peer it is
+   sent to or came from?  */
+int
+bgp_route_map_peer_dependent (struct route_map *map)
+{
+  return route_map_uses_rule (map, &route_match_peer_cmd, NULL)
+	 || route_map_uses_rule (map, &route_match_ip_route_source_cmd, NULL)
+	 || route_map_uses_rule (map,
+				 &route_match_ip_route_source_prefix_list_cmd,
+				 NULL)
+	 || route_map_uses_rule (map, &route_set_ip_nexthop_cmd,
+				 "peer-address");
+}
+
 DEFUN (match_peer,
        match_peer_cmd,
        "match peer (A.B.C.D|X:X::X:X)",
@@ -3818,6 +3842,7 @@ bgp_route_map_init (void)
   route_map_init_vty ();
   route_map_add_hook (bgp_route_map_update);
   route_map_delete_hook (bgp_route_map_update);
+  route_map_event_hook (bgp_route_map_event);
 
   route_map_install_match (&route_match_peer_cmd);
   route_map_install_match (&route_match_ip_address_cmd);
@@ -42,24 +42,46 @@ bgp_table_init (afi_t afi, safi_t safi)
   rt->type = BGP_TABLE_MAIN;
   rt->afi = afi;
   rt->safi = safi;
+  rt->lock = 1;
   
   return rt;
 }
 
+struct bgp_table *
+bgp_table_lock (struct bgp_table *rt)
+{
+  rt->lock++;
+  return rt;
+}
+
+void
+bgp_table_unlock (struct bgp_table *rt)
+{
+  assert (rt->lock > 0);
+  rt->lock--;
+
+  if (rt->lock == 0)
+    bgp_table_free (rt);
+}
+
+/* Drop the owner's lock, the table goes once nothing else has it. */
 void
 bgp_table_finish (struct bgp_table **rt)
 {
-  bgp_table_free (*rt);
+  bgp_table_unlock (*rt);
   *rt = NULL;
 }
 
 static struct bgp_node *
-bgp_node_create ()
+bgp_node_create (u_char family)
 {
   struct bgp_node *rn;
 
-  rn = (struct bgp_node *) XMALLOC (MTYPE_BGP_NODE, sizeof (struct bgp_node));
-  memset (rn, 0, sizeof (struct bgp_node));
+  if (family == AF_INET)
+    rn = XCALLOC (MTYPE_BGP_NODE_IPV4, BGP_NODE_IPV4_SIZE);
+  else
+    rn = XCALLOC (MTYPE_BGP_NODE, sizeof (struct bgp_node));
+  rn->p.family = family;
   return rn;
 }
 
@@ -69,7 +91,7 @@ bgp_node_set (struct bgp_table *table, struct prefix *prefix)
 {
   struct bgp_node *node;
   
-  node = bgp_node_create ();
+  node = bgp_node_create (prefix->family);
 
   prefix_copy (&node->p, prefix);
   node->table = table;
@@ -81,7 +103,10 @@ bgp_node_set (struct bgp_table *table, struct prefix *prefix)
 static void
 bgp_node_free (struct bgp_node *node)
 {
-  XFREE (MTYPE_BGP_NODE, node);
+  if (node->p.family == AF_INET)
+    XFREE (MTYPE_BGP_NODE_IPV4, node);
+  else
+    XFREE (MTYPE_BGP_NODE, node);
 }
 
 /* Free route table. */
@@ -335,9 +360,8 @@ bgp_node_get (struct bgp_table *const table, struct prefix *p)
     }
   else
     {
-      new = bgp_node_create ();
+      new = bgp_node_create (p->family);
       route_common (&node->p, p, &new->p);
-      new->p.family = p->family;
       new->table = table;
       set_link (new, node);
 
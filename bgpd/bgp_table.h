@@ -41,19 +41,16 @@ struct bgp_table
   struct bgp_node *top;
   
   unsigned long count;
+
+  /* Freed when the last user unlocks it. */
+  int lock;
 };
 
+/* As struct route_node: the prefix last, cut short in nodes of IPv4
+   prefixes, with what lookups and walks use just before it.  */
 struct bgp_node
 {
-  struct prefix p;
-
   struct bgp_table *table;
-  struct bgp_node *parent;
-  struct bgp_node *link[2];
-#define l_left   link[0]
-#define l_right  link[1]
-
-  void *info;
 
   struct bgp_adj_out *adj_out;
 
@@ -61,14 +58,28 @@ struct bgp_node
 
   struct bgp_node *prn;
 
-  unsigned int lock;
-
   u_char flags;
 #define BGP_NODE_PROCESS_SCHEDULED	(1 << 0)
+
+  unsigned int lock;
+
+  void *info;
+
+  struct bgp_node *parent;
+  struct bgp_node *link[2];
+#define l_left   link[0]
+#define l_right  link[1]
+
+  struct prefix p;
 };
 
+#define BGP_NODE_IPV4_SIZE \
+  (offsetof (struct bgp_node, p) + sizeof (struct prefix_ipv4))
+
 extern struct bgp_table *bgp_table_init (afi_t, safi_t);
 extern void bgp_table_finish (struct bgp_table **);
+extern struct bgp_table *bgp_table_lock (struct bgp_table *);
+extern void bgp_table_unlock (struct bgp_table *);
 extern void bgp_unlock_node (struct bgp_node *node);
 extern struct bgp_node *bgp_table_top (const struct bgp_table *const);
 extern struct bgp_node *bgp_route_next (struct bgp_node *);
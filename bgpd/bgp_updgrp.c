@@ -0,0 +1,565 @@
+/* BGP update-groups
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+/* Established peers which would be sent exactly the same UPDATEs, because
+   everything about them that goes into the outbound attributes and
+   their encoding is the same, are put in an update-group, whether or
+   not they are configured in a peer-group.  The group lets one member's
+   work be reused by the others: the outbound attributes worked out for
+   a route as bgp_process announces it to each peer in turn, and the
+   UPDATE built from a member's queue of advertisements, which is copied
+   for the others when theirs start with the same prefixes.
+
+   Membership is checked against the peer's current configuration each
+   time it is used, so it never goes stale, whatever is changed.  */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "linklist.h"
+#include "memory.h"
+#include "command.h"
+#include "stream.h"
+#include "hash.h"
+#include "jhash.h"
+#include "routemap.h"
+#include "filter.h"
+#include "log.h"
+
+#include "bgpd/bgpd.h"
+#include "bgpd/bgp_table.h"
+#include "bgpd/bgp_route.h"
+#include "bgpd/bgp_attr.h"
+#include "bgpd/bgp_advertise.h"
+#include "bgpd/bgp_packet.h"
+#include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+
+/* All update-groups, of all BGP instances. */
+static struct hash *update_group_hash;
+
+static unsigned int update_group_id;
+
+/* Bumped for every bgp_process run, as the announce cache is only good
+   for the peers of one run.  */
+static unsigned long update_group_announce_gen;
+
+/* Route-maps which look at the peer make for solo groups.  As working
+   that out means walking the route-map, the answer is remembered until
+   a route-map changes.  */
+#define UPDATE_GROUP_RMAP_CACHE 16
+
+static struct
+{
+  struct route_map *map;
+  int dependent;
+} update_group_rmap_cache[UPDATE_GROUP_RMAP_CACHE];
+
+void
+update_group_route_map_changed (void)
+{
+  memset (update_group_rmap_cache, 0, sizeof (update_group_rmap_cache));
+}
+
+static int
+update_group_rmap_dependent (struct route_map *map)
+{
+  unsigned int i;
+
+  if (! map)
+    return 0;
+
+  i = ((unsigned long) map / sizeof (void *)) % UPDATE_GROUP_RMAP_CACHE;
+  if (update_group_rmap_cache[i].map != map)
+    {
+      update_group_rmap_cache[i].map = map;
+      update_group_rmap_cache[i].dependent = bgp_route_map_peer_dependent (map);
+    }
+  return update_group_rmap_cache[i].dependent;
+}
+
+static void
+update_group_key_make (struct peer *peer, afi_t afi, safi_t safi,
+		       struct update_group_key *key)
+{
+  struct bgp_filter *filter;
+
+  filter = &peer->filter[afi][safi];
+
+  memset (key, 0, sizeof (struct update_group_key));
+  key->bgp = peer->bgp;
+  key->afi = afi;
+  key->safi = safi;
+
+  key->sort = peer_sort (peer);
+  key->as = peer->as;
+  key->local_as = peer->local_as;
+  key->change_local_as = peer->change_local_as;
+  key->flags = peer->flags;
+  key->af_flags = peer->af_flags[afi][safi];
+  key->cap = peer->cap;
+  key->af_cap = peer->af_cap[afi][safi];
+
+  /* A name with nothing behind it still makes a difference. */
+  key->filter_set = (DISTRIBUTE_OUT_NAME (filter) ? 0x01 : 0)
+		    | (PREFIX_LIST_OUT_NAME (filter) ? 0x02 : 0)
+		    | (FILTER_LIST_OUT_NAME (filter) ? 0x04 : 0)
+		    | (ROUTE_MAP_OUT_NAME (filter) ? 0x08 : 0)
+		    | (UNSUPPRESS_MAP_NAME (filter) ? 0x10 : 0);
+  key->dlist = DISTRIBUTE_OUT (filter);
+  key->plist = PREFIX_LIST_OUT (filter);
+  key->aslist = FILTER_LIST_OUT (filter);
+  key->rmap = ROUTE_MAP_OUT (filter);
+  key->usmap = UNSUPPRESS_MAP (filter);
+
+  key->nexthop = peer->nexthop.v4;
+#ifdef HAVE_IPV6
+  key->nexthop_global = peer->nexthop.v6_global;
+  key->nexthop_local = peer->nexthop.v6_local;
+#endif /* HAVE_IPV6 */
+  key->shared_network = peer->shared_network;
+
+  /* EBGP next-hop handling depends on the peer's own address, ORFs
+     are per peer, and so are route-maps matching on the peer. */
+  if (key->sort == BGP_PEER_EBGP
+      || peer->orf_plist[afi][safi]
+      || update_group_rmap_dependent (ROUTE_MAP_OUT (filter))
+      || update_group_rmap_dependent (UNSUPPRESS_MAP (filter)))
+    key->solo = peer;
+}
+
+static unsigned int
+update_group_hash_key (void *p)
+{
+  return jhash (p, sizeof (struct update_group_key), 0);
+}
+
+static int
+update_group_hash_cmp (void *p1, void *p2)
+{
+  return memcmp (p1, p2, sizeof (struct update_group_key)) == 0;
+}
+
+static unsigned int
+update_group_packet_hash_key (void *p)
+{
+  struct update_group_packet *gp = p;
+
+  return jhash (&gp->first.u.prefix, PSIZE (gp->first.prefixlen),
+		jhash_2words ((uintptr_t) gp->attr, gp->first.prefixlen, 0));
+}
+
+static int
+update_group_packet_hash_cmp (void *p1, void *p2)
+{
+  struct update_group_packet *gp1 = p1;
+  struct update_group_packet *gp2 = p2;
+
+  return gp1->attr == gp2->attr && prefix_same (&gp1->first, &gp2->first);
+}
+
+static void *
+update_group_alloc (void *p)
+{
+  struct update_group *group;
+
+  group = XCALLOC (MTYPE_BGP_UPDATE_GROUP, sizeof (struct update_group));
+  group->key = *(struct update_group_key *) p;
+  group->id = ++update_group_id;
+  group->peers = list_new ();
+  group->packets = hash_create (update_group_packet_hash_key,
+				update_group_packet_hash_cmp);
+  group->packets->name = "BGP update-group packets";
+  return group;
+}
+
+static void
+update_group_packet_free (struct update_group *group,
+			  struct update_group_packet *gp)
+{
+  hash_release (group->packets, gp);
+
+  if (gp->prev)
+    gp->prev->next = gp->next;
+  else
+    group->packet_head = gp->next;
+  if (gp->next)
+    gp->next->prev = gp->prev;
+  else
+    group->packet_tail = gp->prev;
+
+  stream_free (gp->packet);
+  bgp_attr_unintern (gp->attr);
+  XFREE (MTYPE_BGP_UPDATE_GROUP, gp);
+}
+
+static void
+update_group_free (struct update_group *group)
+{
+  if (group->announce_attr)
+    bgp_attr_unintern (group->announce_attr);
+  while (group->packet_head)
+    update_group_packet_free (group, group->packet_head);
+  hash_free (group->packets);
+  list_free (group->peers);
+  XFREE (MTYPE_BGP_UPDATE_GROUP, group);
+}
+
+static void
+update_group_leave_afi (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group *group;
+
+  group = peer->update_group[afi][safi];
+  if (! group)
+    return;
+
+  peer->update_group[afi][safi] = NULL;
+  listnode_delete (group->peers, peer);
+
+  if (listcount (group->peers) == 0)
+    {
+      hash_release (update_group_hash, group);
+      update_group_free (group);
+    }
+}
+
+/* Take the peer out of its groups, when it goes down or away. */
+void
+update_group_leave (struct peer *peer)
+{
+  afi_t afi;
+  safi_t safi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+      update_group_leave_afi (peer, afi, safi);
+}
+
+/* The peer's update-group, moving it to another if its configuration
+   has changed since last time. */
+struct update_group *
+update_group_peer (struct peer *peer, afi_t afi, safi_t safi)
+{
+  struct update_group_key key;
+  struct update_group *group;
+
+  update_group_key_make (peer, afi, safi, &key);
+
+  group = peer->update_group[afi][safi];
+  if (group && update_group_hash_cmp (&group->key, &key))
+    return group;
+
+  update_group_leave_afi (peer, afi, safi);
+
+  group = hash_get (update_group_hash, &key, update_group_alloc);
+  listnode_add (group->peers, peer);
+  peer->update_group[afi][safi] = group;
+  return group;
+}
+
+/* Start of announcing one route to all peers. */
+void
+update_group_announce_begin (void)
+{
+  update_group_announce_gen++;
+}
+
+/* Outbound attributes for the route, if already worked out for another
+   member while announcing it.  Returns -1 if not, otherwise whether the
+   route is to be sent, with attr filled in if so.  */
+int
+update_group_announce_lookup (struct update_group *group,
+			      struct bgp_node *rn, struct bgp_info *ri,
+			      struct attr *attr)
+{
+  if (group->announce_gen != update_group_announce_gen
+      || group->announce_rn != rn || group->announce_ri != ri)
+    return -1;
+
+  group->announce_shared++;
+
+  if (! group->announce_attr)
+    return 0;
+
+  bgp_attr_dup (attr, group->announce_attr);
+  return 1;
+}
+
+/* Remember the outbound attributes worked out for the route, NULL if
+   it is not to be sent. */
+void
+update_group_announce_save (struct update_group *group,
+			    struct bgp_node *rn, struct bgp_info *ri,
+			    struct attr *attr)
+{
+  if (group->announce_attr)
+    bgp_attr_unintern (group->announce_attr);
+
+  group->announce_gen = update_group_announce_gen;
+  group->announce_rn = rn;
+  group->announce_ri = ri;
+  group->announce_attr = attr ? bgp_attr_intern (attr) : NULL;
+  group->announce_computed++;
+}
+
+/* The advertisement which bgp_update_packet would take after adv, the
+   first being first.  */
+static struct bgp_advertise *
+update_group_adv_next (struct bgp_advertise *adv, struct bgp_advertise *first)
+{
+  struct bgp_advertise *next;
+
+  next = (adv == first) ? first->baa->adv : adv->next;
+  if (next == first)
+    next = first->next;
+  return next;
+}
+
+/* Does the UPDATE carry the advertisements starting at adv?  If so,
+   returns the number of prefixes in it. */
+static unsigned int
+update_group_packet_match (struct update_group_packet *gp, afi_t afi,
+			   safi_t safi, struct bgp_advertise *adv,
+			   struct peer *from)
+{
+  static struct stream *work;
+  struct bgp_advertise *first;
+  struct prefix_rd *prd;
+  u_char *tag;
+  struct stream *s;
+  size_t pos;
+  size_t end;
+  size_t lenp;
+  size_t size;
+  unsigned int count;
+
+  /* Encoded the same way. */
+  if ((from ? peer_sort (from) : 0) != gp->from_sort
+      || (from && ! IPV4_ADDR_SAME (&from->remote_id, &gp->from_id)))
+    return 0;
+
+  /* Same prefixes, in the same order.  The UPDATE has no withdrawn
+     routes, so IPv4 unicast NLRI follow the attributes.  Those of the
+     other families end the MP_REACH_NLRI, after its AFI, SAFI, next
+     hop and SNPA. */
+  s = gp->packet;
+  pos = BGP_HEADER_SIZE + 4;
+  end = pos + stream_getw_from (s, BGP_HEADER_SIZE + 2);
+  if (afi == AFI_IP && safi == SAFI_UNICAST)
+    {
+      pos = end;
+      end = stream_get_endp (s);
+    }
+  else
+    {
+      end = bgp_packet_mpattr_find (s, pos, end - pos, &lenp);
+      if (! end)
+	return 0;
+      pos = lenp + 2 + 3;
+      pos += 1 + stream_getc_from (s, pos) + 1;
+    }
+
+  if (! work)
+    work = stream_new (BGP_MAX_PACKET_SIZE);
+  count = 0;
+
+  for (first = adv; pos < end; adv = update_group_adv_next (adv, first))
+    {
+      if (! adv)
+	return 0;
+
+      prd = adv->rn->prn ? (struct prefix_rd *) &adv->rn->prn->p : NULL;
+      tag = (adv->binfo && adv->binfo->extra) ? adv->binfo->extra->tag : NULL;
+      stream_reset (work);
+      bgp_packet_mpattr_prefix (work, &adv->rn->p, safi, prd, tag);
+
+      size = stream_get_endp (work);
+      if (pos + size > end
+	  || memcmp (STREAM_DATA (s) + pos, STREAM_DATA (work), size))
+	return 0;
+
+      pos += size;
+      count++;
+    }
+  return count;
+}
+
+/* An UPDATE already built for another member which can be sent for the
+   advertisements starting at adv.  Sets count to the number of prefixes
+   in it.  The UPDATE returned is the caller's copy. */
+struct stream *
+update_group_packet_lookup (struct peer *peer, afi_t afi, safi_t safi,
+			    struct bgp_advertise *adv, unsigned int *count)
+{
+  struct update_group *group;
+  struct update_group_packet ref;
+  struct update_group_packet *gp;
+  struct peer *from;
+  struct stream *packet;
+
+  group = update_group_peer (peer, afi, safi);
+  if (! UPDATE_GROUP_SHARED (group))
+    return NULL;
+
+  memset (&ref, 0, sizeof (struct update_group_packet));
+  ref.attr = adv->baa->attr;
+  prefix_copy (&ref.first, &adv->rn->p);
+
+  gp = hash_lookup (group->packets, &ref);
+  if (! gp)
+    return NULL;
+
+  from = (adv->binfo && adv->binfo->extra) ? adv->binfo->peer : NULL;
+  *count = update_group_packet_match (gp, afi, safi, adv, from);
+  if (! *count)
+    return NULL;
+
+  group->packet_shared++;
+
+  packet = stream_dup (gp->packet);
+  if (--gp->users == 0)
+    update_group_packet_free (group, gp);
+  return packet;
+}
+
+/* Keep the UPDATE just built for the peer, for the rest of its group.
+   first is its first prefix. */
+void
+update_group_packet_save (struct peer *peer, afi_t afi, safi_t safi,
+			  struct stream *packet, struct prefix *first,
+			  struct attr *attr, struct peer *from)
+{
+  struct update_group *group;
+  struct update_group_packet *gp;
+  struct update_group_packet *old;
+
+  group = update_group_peer (peer, afi, safi);
+  group->packet_built++;
+
+  if (! UPDATE_GROUP_SHARED (group))
+    return;
+
+  gp = XCALLOC (MTYPE_BGP_UPDATE_GROUP, sizeof (struct update_group_packet));
+  gp->attr = bgp_attr_intern (attr);
+  prefix_copy (&gp->first, first);
+  gp->packet = stream_dup (packet);
+  gp->from_sort = from ? peer_sort (from) : 0;
+  gp->from_id.s_addr = from ? from->remote_id.s_addr : 0;
+  gp->users = listcount (group->peers) - 1;
+
+  /* A newer UPDATE starting the same way replaces the old one. */
+  old = hash_lookup (group->packets, gp);
+  if (old)
+    update_group_packet_free (group, old);
+  else if (group->packets->count >= UPDATE_GROUP_PACKETS_MAX)
+    update_group_packet_free (group, group->packet_head);
+
+  hash_get (group->packets, gp, hash_alloc_intern);
+  gp->prev = group->packet_tail;
+  if (group->packet_tail)
+    group->packet_tail->next = gp;
+  else
+    group->packet_head = gp;
+  group->packet_tail = gp;
+}
+
+struct update_group_show
+{
+  struct vty *vty;
+  struct bgp *bgp;
+};
+
+static void
+update_group_show_one (struct hash_backet *backet, void *arg)
+{
+  struct update_group *group = backet->data;
+  struct update_group_show *show = arg;
+  struct vty *vty = show->vty;
+  struct listnode *node;
+  struct peer *peer;
+  int n = 0;
+
+  if (group->key.bgp != show->bgp)
+    return;
+
+  vty_out (vty, "Update-group %u, %s, %d peer%s%s", group->id,
+	   afi_safi_print (group->key.afi, group->key.safi),
+	   listcount (group->peers), listcount (group->peers) == 1 ? "" : "s",
+	   VTY_NEWLINE);
+  vty_out (vty, "  Outbound attributes: %lu worked out, %lu shared%s",
+	   group->announce_computed, group->announce_shared, VTY_NEWLINE);
+  vty_out (vty, "  UPDATEs: %lu built, %lu shared, %lu kept%s",
+	   group->packet_built, group->packet_shared, group->packets->count,
+	   VTY_NEWLINE);
+  vty_out (vty, "  Peers:");
+  for (ALL_LIST_ELEMENTS_RO (group->peers, node, peer))
+    {
+      if (n++ % 4 == 0)
+	vty_out (vty, "%s   ", VTY_NEWLINE);
+      vty_out (vty, " %s", peer->host);
+    }
+  vty_out (vty, "%s", VTY_NEWLINE);
+}
+
+DEFUN (show_ip_bgp_update_groups,
+       show_ip_bgp_update_groups_cmd,
+       "show ip bgp update-groups",
+       SHOW_STR
+       IP_STR
+       BGP_STR
+       "Groups of peers sent the same updates\n")
+{
+  struct update_group_show show;
+  struct listnode *node;
+  struct peer *peer;
+  afi_t afi;
+  safi_t safi;
+
+  show.vty = vty;
+  show.bgp = bgp_get_default ();
+  if (! show.bgp)
+    {
+      vty_out (vty, "No BGP process is configured%s", VTY_NEWLINE);
+      return CMD_WARNING;
+    }
+
+  /* Bring the groups up to date with the configuration first. */
+  for (ALL_LIST_ELEMENTS_RO (show.bgp->peer, node, peer))
+    if (peer->status == Established)
+      for (afi = AFI_IP; afi < AFI_MAX; afi++)
+	for (safi = SAFI_UNICAST; safi < SAFI_MAX; safi++)
+	  if (peer->afc_nego[afi][safi])
+	    update_group_peer (peer, afi, safi);
+
+  hash_iterate (update_group_hash, update_group_show_one, &show);
+
+  return CMD_SUCCESS;
+}
+
+void
+bgp_update_group_init (void)
+{
+  update_group_hash = hash_create (update_group_hash_key,
+				   update_group_hash_cmp);
+  update_group_hash->name = "BGP update-groups";
+
+  install_element (VIEW_NODE, &show_ip_bgp_update_groups_cmd);
+  install_element (ENABLE_NODE, &show_ip_bgp_update_groups_cmd);
+}
@@ -0,0 +1,145 @@
+/* BGP update-groups
+
+This file is part of GNU Zebra.
+
+GNU Zebra is free software; you can redistribute it and/or modify it
+under the terms of the GNU General Public License as published by the
+Free Software Foundation; either version 2, or (at your option) any
+later version.
+
+GNU Zebra is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Zebra; see the file COPYING.  If not, write to the Free
+Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.  */
+
+#ifndef _QUAGGA_BGP_UPDGRP_H
+#define _QUAGGA_BGP_UPDGRP_H
+
+struct bgp_node;
+struct bgp_info;
+struct bgp_advertise;
+
+/* Everything about a peer which goes into working out and encoding
+   the routes sent to it, for one address family.  Peers with the same
+   key get the same UPDATEs.  */
+struct update_group_key
+{
+  struct bgp *bgp;
+  afi_t afi;
+  safi_t safi;
+
+  /* Set to the peer itself if what it is sent depends on more than
+     this, for example EBGP peers and peers sending ORFs.  */
+  struct peer *solo;
+
+  int sort;
+  as_t as;
+  as_t local_as;
+  as_t change_local_as;
+  u_int32_t flags;
+  u_int32_t af_flags;
+  u_int16_t cap;
+  u_int16_t af_cap;
+
+  /* Outbound filters, by what they resolved to. */
+  u_char filter_set;
+  void *dlist;
+  void *plist;
+  void *aslist;
+  void *rmap;
+  void *usmap;
+
+  /* Our end of the session, for next-hop-self. */
+  struct in_addr nexthop;
+#ifdef HAVE_IPV6
+  struct in6_addr nexthop_global;
+  struct in6_addr nexthop_local;
+#endif /* HAVE_IPV6 */
+  int shared_network;
+};
+
+/* An UPDATE built for a member, with what it was built from, kept
+   until the other members have sent it too.  */
+struct update_group_packet
+{
+  /* Looked up by attributes and first prefix. */
+  struct attr *attr;
+  struct prefix first;
+
+  struct stream *packet;
+  int from_sort;
+  struct in_addr from_id;
+
+  /* Members yet to send it. */
+  unsigned int users;
+
+  /* Oldest first. */
+  struct update_group_packet *next;
+  struct update_group_packet *prev;
+};
+
+/* Most UPDATEs kept per group, for when some members fall far behind
+   the others.  */
+#define UPDATE_GROUP_PACKETS_MAX 1024
+
+struct update_group
+{
+  struct update_group_key key;
+
+  /* Number shown by 'show ip bgp update-groups'. */
+  unsigned int id;
+
+  /* Established peers in the group. */
+  struct list *peers;
+
+  /* Outbound attributes of the route last worked out for a member,
+     for the others to reuse while the same route is announced.
+     announce_attr is interned, or NULL if the route was filtered.  */
+  unsigned long announce_gen;
+  struct bgp_node *announce_rn;
+  struct bgp_info *announce_ri;
+  struct attr *announce_attr;
+
+  /* UPDATEs built for members, for the others to send when they
+     have the same prefixes queued.  */
+  struct hash *packets;
+  struct update_group_packet *packet_head;
+  struct update_group_packet *packet_tail;
+
+  /* Statistics. */
+  unsigned long announce_computed;
+  unsigned long announce_shared;
+  unsigned long packet_built;
+  unsigned long packet_shared;
+};
+
+/* Worth sharing work within the group? */
+#define UPDATE_GROUP_SHARED(G) ((G) && listcount ((G)->peers) > 1)
+
+extern void bgp_update_group_init (void);
+extern struct update_group *update_group_peer (struct peer *, afi_t, safi_t);
+extern void update_group_leave (struct peer *);
+extern void update_group_route_map_changed (void);
+
+extern void update_group_announce_begin (void);
+extern int update_group_announce_lookup (struct update_group *,
+					 struct bgp_node *, struct bgp_info *,
+					 struct attr *);
+extern void update_group_announce_save (struct update_group *,
+					struct bgp_node *, struct bgp_info *,
+					struct attr *);
+
+extern struct stream *update_group_packet_lookup (struct peer *, afi_t,
+						  safi_t,
+						  struct bgp_advertise *,
+						  unsigned int *);
+extern void update_group_packet_save (struct peer *, afi_t, safi_t,
+				      struct stream *, struct prefix *,
+				      struct attr *, struct peer *);
+
+#endif /* _QUAGGA_BGP_UPDGRP_H */
@@ -6520,10 +6520,14 @@ DEFUN (show_bgp_memory,
   unsigned long count;
   
   /* RIB related usage stats */
-  count = mtype_stats_alloc (MTYPE_BGP_NODE);
+  count = mtype_stats_alloc (MTYPE_BGP_NODE)
+          + mtype_stats_alloc (MTYPE_BGP_NODE_IPV4);
   vty_out (vty, "%ld RIB nodes, using %s of memory%s", count,
            mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                         count * sizeof (struct bgp_node)),
+                         mtype_stats_alloc (MTYPE_BGP_NODE)
+                         * sizeof (struct bgp_node)
+                         + mtype_stats_alloc (MTYPE_BGP_NODE_IPV4)
+                         * BGP_NODE_IPV4_SIZE),
            VTY_NEWLINE);
   
   count = mtype_stats_alloc (MTYPE_BGP_ROUTE);
@@ -6675,7 +6679,10 @@ bgp_show_summary (struct vty *vty, struct bgp *bgp, int afi, int safi)
               ents = bgp_table_count (bgp->rib[afi][safi]);
               vty_out (vty, "RIB entries %ld, using %s of memory%s", ents,
                        mtype_memstr (memstrbuf, sizeof (memstrbuf),
-                                     ents * sizeof (struct bgp_node)),
+                                     ents * (afi == AFI_IP
+                                             && safi != SAFI_MPLS_VPN
+                                             ? BGP_NODE_IPV4_SIZE
+                                             : sizeof (struct bgp_node))),
                        VTY_NEWLINE);
               
               /* Peer related usage */
@@ -6699,6 +6706,10 @@ bgp_show_summary (struct vty *vty, struct bgp *bgp, int afi, int safi)
                                        ents * sizeof (struct peer_group)),
                          VTY_NEWLINE);
 
+              vty_out (vty, "Best path selections %lu full, %lu incremental%s",
+                       bgp->select_full, bgp->select_incremental,
+                       VTY_NEWLINE);
+
               if (CHECK_FLAG (bgp->af_flags[afi][safi], BGP_CONFIG_DAMPENING))
                 vty_out (vty, "Dampening enabled.%s", VTY_NEWLINE);
               vty_out (vty, "%s", VTY_NEWLINE);
@@ -7197,6 +7208,18 @@ bgp_show_peer_afi (struct vty *vty, struct peer *p, afi_t afi, safi_t safi)
   /* Receive prefix count */
   vty_out (vty, "  %ld accepted prefixes%s", p->pcount[afi][safi], VTY_NEWLINE);
 
+  /* How full the UPDATEs sent were. */
+  if (p->announce_packets[afi][safi])
+    vty_out (vty, "  %lu prefixes announced in %lu UPDATEs, %.1f per UPDATE%s",
+	     p->announce_prefixes[afi][safi], p->announce_packets[afi][safi],
+	     (double) p->announce_prefixes[afi][safi]
+	     / p->announce_packets[afi][safi], VTY_NEWLINE);
+  if (p->withdraw_packets[afi][safi])
+    vty_out (vty, "  %lu prefixes withdrawn in %lu UPDATEs, %.1f per UPDATE%s",
+	     p->withdraw_prefixes[afi][safi], p->withdraw_packets[afi][safi],
+	     (double) p->withdraw_prefixes[afi][safi]
+	     / p->withdraw_packets[afi][safi], VTY_NEWLINE);
+
   /* Maximum prefix */
   if (CHECK_FLAG (p->af_flags[afi][safi], PEER_FLAG_MAX_PREFIX))
     {
@@ -7459,6 +7482,10 @@ bgp_show_peer (struct vty *vty, struct peer *p)
 	   p->update_out + p->keepalive_out + p->refresh_out + p->dynamic_cap_out,
 	   p->open_in + p->notify_in + p->update_in + p->keepalive_in + p->refresh_in +
 	   p->dynamic_cap_in, VTY_NEWLINE);
+  vty_out (vty, "    Reads:         %10u calls, %llu bytes%s", p->read_calls,
+	   (unsigned long long) p->read_bytes, VTY_NEWLINE);
+  vty_out (vty, "    Writes:        %10u calls, %llu bytes%s", p->write_calls,
+	   (unsigned long long) p->write_bytes, VTY_NEWLINE);
 
   /* advertisement-interval */
   vty_out (vty, "  Minimum time between advertisement runs is %d seconds%s",
@@ -921,6 +921,32 @@ bgp_zebra_withdraw (struct prefix *p, struct bgp_info *info)
     }
 #endif /* HAVE_IPV6 */
 }
+
+/* Send zebra the routes announced and withdrawn so far now. */
+void
+bgp_zebra_flush (void)
+{
+  if (zclient && zclient->sock >= 0)
+    zclient_bulk_flush (zclient);
+}
+
+/* Ask zebra to tell us when the resolution of a nexthop changes
+   (ZEBRA_NEXTHOP_REGISTER), or to stop (ZEBRA_NEXTHOP_UNREGISTER).
+   Returns whether the request was sent. */
+int
+bgp_zebra_nexthop_register (int command, struct prefix *p)
+{
+  if (! zclient || zclient->sock < 0)
+    return 0;
+
+  return zebra_nexthop_register_send (command, zclient, p) == 0;
+}
+
+static void
+bgp_zebra_connected (struct zclient *zclient)
+{
+  bgp_nexthop_register_all ();
+}
 
 /* Other routes redistribution into BGP. */
 int
@@ -1073,6 +1099,8 @@ bgp_zebra_init (void)
   zclient->ipv6_route_add = zebra_read_ipv6;
   zclient->ipv6_route_delete = zebra_read_ipv6;
 #endif /* HAVE_IPV6 */
+  zclient->nexthop_update = bgp_nexthop_update;
+  zclient->zebra_connected = bgp_zebra_connected;
 
   /* Interface related init. */
   if_init ();
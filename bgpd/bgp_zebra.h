@@ -27,6 +27,8 @@ extern int bgp_config_write_redistribute (struct vty *, struct bgp *, afi_t, saf
 				   int *);
 extern void bgp_zebra_announce (struct prefix *, struct bgp_info *, struct bgp *);
 extern void bgp_zebra_withdraw (struct prefix *, struct bgp_info *);
+extern int bgp_zebra_nexthop_register (int, struct prefix *);
+extern void bgp_zebra_flush (void);
 
 extern int bgp_redistribute_set (struct bgp *, afi_t, int);
 extern int bgp_redistribute_rmap_set (struct bgp *, afi_t, int, const char *);
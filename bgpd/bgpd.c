@@ -57,6 +57,8 @@ Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
 #include "bgpd/bgp_advertise.h"
 #include "bgpd/bgp_network.h"
 #include "bgpd/bgp_vty.h"
+#include "bgpd/bgp_updgrp.h"
+#include "bgpd/bgp_latency.h"
 #ifdef HAVE_SNMP
 #include "bgpd/bgp_snmp.h"
 #endif /* HAVE_SNMP */
@@ -118,6 +120,8 @@ bgp_option_check (int flag)
 int
 bgp_flag_set (struct bgp *bgp, int flag)
 {
+  if (CHECK_FLAG (flag, BGP_FLAG_BESTPATH) && ! CHECK_FLAG (bgp->flags, flag))
+    bgp_best_selection_reset (bgp);
   SET_FLAG (bgp->flags, flag);
   return 0;
 }
@@ -125,6 +129,8 @@ bgp_flag_set (struct bgp *bgp, int flag)
 int
 bgp_flag_unset (struct bgp *bgp, int flag)
 {
+  if (CHECK_FLAG (flag, BGP_FLAG_BESTPATH) && CHECK_FLAG (bgp->flags, flag))
+    bgp_best_selection_reset (bgp);
   UNSET_FLAG (bgp->flags, flag);
   return 0;
 }
@@ -480,6 +486,8 @@ bgp_default_local_preference_set (struct bgp *bgp, u_int32_t local_pref)
   if (! bgp)
     return -1;
 
+  if (bgp->default_local_pref != local_pref)
+    bgp_best_selection_reset (bgp);
   bgp->default_local_pref = local_pref;
 
   return 0;
@@ -491,6 +499,8 @@ bgp_default_local_preference_unset (struct bgp *bgp)
   if (! bgp)
     return -1;
 
+  if (bgp->default_local_pref != BGP_DEFAULT_LOCAL_PREF)
+    bgp_best_selection_reset (bgp);
   bgp->default_local_pref = BGP_DEFAULT_LOCAL_PREF;
 
   return 0;
@@ -687,6 +697,8 @@ peer_sort (struct peer *peer)
 static inline void
 peer_free (struct peer *peer)
 {
+  struct bgp *bgp = peer->bgp;
+
   assert (peer->status == Deleted);
   
   /* this /ought/ to have been done already through bgp_stop earlier,
@@ -715,9 +727,15 @@ peer_free (struct peer *peer)
     work_queue_free (peer->clear_node_queue);
   
   bgp_sync_delete (peer);
+
+  if (peer->latency)
+    XFREE (MTYPE_BGP_PEER_LATENCY, peer->latency);
+
   memset (peer, 0, sizeof (struct peer));
   
   XFREE (MTYPE_BGP_PEER, peer);
+
+  bgp_unlock (bgp); /* peer_new reference */
 }
                                                 
 /* increase reference count on a struct peer */
@@ -779,6 +797,9 @@ peer_new (struct bgp *bgp)
   
   /* Allocate new peer. */
   peer = XCALLOC (MTYPE_BGP_PEER, sizeof (struct peer));
+  peer->latency = XCALLOC (MTYPE_BGP_PEER_LATENCY,
+			   sizeof (struct bgp_latency));
+  bgp_latency_reset (peer->latency);
 
   /* Set default value. */
   peer->fd = -1;
@@ -789,7 +810,7 @@ peer_new (struct bgp *bgp)
   peer->ostatus = Idle;
   peer->weight = 0;
   peer->password = NULL;
-  peer->bgp = bgp;
+  peer->bgp = bgp_lock (bgp); /* unlocked by peer_free */
   peer = peer_lock (peer); /* initial reference */
 
   /* Set default flags.  */
@@ -807,6 +828,7 @@ peer_new (struct bgp *bgp)
 
   /* Create buffers.  */
   peer->ibuf = stream_new (BGP_MAX_PACKET_SIZE);
+  peer->ibuf_work = stream_new (BGP_READ_BUFFER_SIZE);
   peer->obuf = stream_fifo_new ();
   peer->work = stream_new (BGP_MAX_PACKET_SIZE);
 
@@ -1245,12 +1267,14 @@ peer_delete (struct peer *peer)
   /* Buffers.  */
   if (peer->ibuf)
     stream_free (peer->ibuf);
+  if (peer->ibuf_work)
+    stream_free (peer->ibuf_work);
   if (peer->obuf)
     stream_fifo_free (peer->obuf);
   if (peer->work)
     stream_free (peer->work);
   peer->obuf = NULL;
-  peer->work = peer->ibuf = NULL;
+  peer->work = peer->ibuf = peer->ibuf_work = NULL;
 
   /* Local and remote addresses. */
   if (peer->su_local)
@@ -1909,8 +1933,9 @@ bgp_create (as_t *as, const char *name)
   if ( (bgp = XCALLOC (MTYPE_BGP, sizeof (struct bgp))) == NULL)
     return NULL;
   
+  bgp_lock (bgp); /* initial reference, dropped by bgp_delete */
   bgp->peer_self = peer_new (bgp);
-  bgp->peer_self->host = strdup ("Static announcement");
+  bgp->peer_self->host = XSTRDUP (MTYPE_BGP_PEER_HOST, "Static announcement");
 
   bgp->peer = list_new ();
   bgp->peer->cmp = (int (*)(void *, void *)) peer_cmp;
@@ -2045,12 +2070,16 @@ bgp_delete (struct bgp *bgp)
   struct listnode *node;
   struct listnode *next;
   afi_t afi;
-  safi_t safi;
   int i;
 
+  bgp_dump_routes_stop (bgp);
+
   /* Delete static route. */
   bgp_static_delete (bgp);
 
+  /* Delete aggregate address. */
+  bgp_aggregate_delete_all (bgp);
+
   /* Unset redistribution. */
   for (afi = AFI_IP; afi < AFI_MAX; afi++)
     for (i = 0; i < ZEBRA_ROUTE_MAX; i++) 
@@ -2059,18 +2088,35 @@ bgp_delete (struct bgp *bgp)
 
   for (ALL_LIST_ELEMENTS (bgp->group, node, next, group))
     peer_group_delete (group);
-  list_delete (bgp->group);
 
   for (ALL_LIST_ELEMENTS (bgp->peer, node, next, peer))
     peer_delete (peer);
-  list_delete (bgp->peer);
 
   for (ALL_LIST_ELEMENTS (bgp->rsclient, node, next, peer))
     peer_delete (peer);
-  list_delete (bgp->rsclient);
+
+  peer_delete (bgp->peer_self);
+  bgp->peer_self = NULL;
 
   listnode_delete (bm->bgp, bgp);
-  
+
+  bgp_unlock (bgp); /* initial reference */
+
+  return 0;
+}
+
+/* Free the instance once its peers and the routes queued for processing
+   in it, which go on after bgp_delete, are done with it.  */
+static void
+bgp_free (struct bgp *bgp)
+{
+  afi_t afi;
+  safi_t safi;
+
+  list_delete (bgp->group);
+  list_delete (bgp->peer);
+  list_delete (bgp->rsclient);
+
   if (bgp->name)
     free (bgp->name);
   
@@ -2082,11 +2128,25 @@ bgp_delete (struct bgp *bgp)
 	if (bgp->aggregate[afi][safi])
 	  XFREE (MTYPE_ROUTE_TABLE,bgp->aggregate[afi][safi]) ;
 	if (bgp->rib[afi][safi])
-	  XFREE (MTYPE_ROUTE_TABLE,bgp->rib[afi][safi]);
+	  bgp_table_finish (&bgp->rib[afi][safi]);
       }
   XFREE (MTYPE_BGP, bgp);
+}
 
-  return 0;
+struct bgp *
+bgp_lock (struct bgp *bgp)
+{
+  bgp->lock++;
+  return bgp;
+}
+
+void
+bgp_unlock (struct bgp *bgp)
+{
+  assert (bgp->lock > 0);
+
+  if (--bgp->lock == 0)
+    bgp_free (bgp);
 }
 
 struct peer *
@@ -5107,8 +5167,10 @@ bgp_init (void)
   bgp_attr_init ();
   bgp_debug_init ();
   bgp_dump_init ();
+  bgp_latency_init ();
   bgp_route_init ();
   bgp_route_map_init ();
+  bgp_update_group_init ();
   bgp_scan_init ();
   bgp_mplsvpn_init ();
 
@@ -5150,6 +5212,7 @@ bgp_terminate ()
                            BGP_NOTIFY_CEASE_PEER_UNCONFIG);
   
   bgp_cleanup_routes ();
+  bgp_zebra_flush ();
   if (bm->process_main_queue)
     work_queue_free (bm->process_main_queue);
   if (bm->process_rsclient_queue)
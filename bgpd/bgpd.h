@@ -70,6 +70,10 @@ struct bgp
   /* Name of this BGP instance.  */
   char *name;
   
+  /* Reference count, held by its peers and queued route processing,
+     which may outlast bgp_delete.  */
+  int lock;
+
   /* Self peer.  */
   struct peer *peer_self;
 
@@ -117,6 +121,15 @@ struct bgp
 #define BGP_FLAG_GRACEFUL_RESTART         (1 << 12)
 #define BGP_FLAG_ASPATH_CONFED            (1 << 13)
 
+/* Flags changing how paths compare in best path selection. */
+#define BGP_FLAG_BESTPATH (BGP_FLAG_ALWAYS_COMPARE_MED \
+			   | BGP_FLAG_DETERMINISTIC_MED \
+			   | BGP_FLAG_MED_MISSING_AS_WORST \
+			   | BGP_FLAG_MED_CONFED \
+			   | BGP_FLAG_COMPARE_ROUTER_ID \
+			   | BGP_FLAG_ASPATH_IGNORE \
+			   | BGP_FLAG_ASPATH_CONFED)
+
   /* BGP Per AF flags */
   u_int16_t af_flags[AFI_MAX][SAFI_MAX];
 #define BGP_CONFIG_DAMPENING              (1 << 0)
@@ -159,6 +172,11 @@ struct bgp
   /* BGP graceful restart */
   u_int32_t restart_time;
   u_int32_t stalepath_time;
+
+  /* Best path selections, comparing all paths or only those changed
+     since the last.  */
+  unsigned long select_full;
+  unsigned long select_incremental;
 };
 
 /* BGP peer-group support. */
@@ -287,6 +305,7 @@ struct peer
 
   /* Packet receive and send buffer. */
   struct stream *ibuf;
+  struct stream *ibuf_work;	/* Read from fd, not yet split up.  */
   struct stream_fifo *obuf;
   struct stream *work;
 
@@ -294,8 +313,10 @@ struct peer
   int status;
   int ostatus;
 
-  /* Peer index, used for dumping TABLE_DUMP_V2 format */
+  /* Peer index, used for dumping TABLE_DUMP_V2 format, and the number
+     of the dump whose PEER_INDEX_TABLE it is from. */
   uint16_t table_dump_index;
+  unsigned int table_dump_seq;
 
   /* Peer information */
   int fd;			/* File descriptor */
@@ -464,6 +485,10 @@ struct peer
   u_int32_t refresh_out;	/* Route Refresh output count */
   u_int32_t dynamic_cap_in;	/* Dynamic Capability input count.  */
   u_int32_t dynamic_cap_out;	/* Dynamic Capability output count.  */
+  u_int32_t read_calls;		/* Input system calls.  */
+  uint64_t read_bytes;		/* Input bytes.  */
+  u_int32_t write_calls;	/* Output system calls.  */
+  uint64_t write_bytes;		/* Output bytes.  */
 
   /* BGP state count */
   u_int32_t established;	/* Established */
@@ -476,6 +501,15 @@ struct peer
   /* Send prefix count. */
   unsigned long scount[AFI_MAX][SAFI_MAX];
 
+  /* UPDATEs made from the sync queues, and the prefixes in them. */
+  unsigned long announce_packets[AFI_MAX][SAFI_MAX];
+  unsigned long announce_prefixes[AFI_MAX][SAFI_MAX];
+  unsigned long withdraw_packets[AFI_MAX][SAFI_MAX];
+  unsigned long withdraw_prefixes[AFI_MAX][SAFI_MAX];
+
+  /* Message rates and latencies, see bgp_latency.c. */
+  struct bgp_latency *latency;
+
   /* Announcement attribute hash.  */
   struct hash *hash[AFI_MAX][SAFI_MAX];
 
@@ -491,6 +525,9 @@ struct peer
   /* ORF Prefix-list */
   struct prefix_list *orf_plist[AFI_MAX][SAFI_MAX];
 
+  /* Update-group, while Established. */
+  struct update_group *update_group[AFI_MAX][SAFI_MAX];
+
   /* Prefix count. */
   unsigned long pcount[AFI_MAX][SAFI_MAX];
 
@@ -570,6 +607,7 @@ struct bgp_nlri
 #define BGP_MARKER_SIZE		                16
 #define BGP_HEADER_SIZE		                19
 #define BGP_MAX_PACKET_SIZE                   4096
+#define BGP_READ_BUFFER_SIZE          (16 * BGP_MAX_PACKET_SIZE)
 
 /* BGP minimum message size.  */
 #define BGP_MSG_OPEN_MIN_SIZE                   (BGP_HEADER_SIZE + 10)
@@ -831,6 +869,7 @@ extern void bgp_master_init (void);
 
 extern void bgp_init (void);
 extern void bgp_route_map_init (void);
+extern int bgp_route_map_peer_dependent (struct route_map *);
 
 extern int bgp_option_set (int);
 extern int bgp_option_unset (int);
@@ -838,6 +877,8 @@ extern int bgp_option_check (int);
 
 extern int bgp_get (struct bgp **, as_t *, const char *);
 extern int bgp_delete (struct bgp *);
+extern struct bgp *bgp_lock (struct bgp *);
+extern void bgp_unlock (struct bgp *);
 
 extern int bgp_flag_set (struct bgp *, int);
 extern int bgp_flag_unset (struct bgp *, int);
@@ -127,6 +127,18 @@ buffer_empty (struct buffer *b)
   return (b->head == NULL);
 }
 
+/* Return the number of bytes waiting to be flushed. */
+size_t
+buffer_pending (struct buffer *b)
+{
+  struct buffer_data *data;
+  size_t total = 0;
+
+  for (data = b->head; data; data = data->next)
+    total += data->cp - data->sp;
+  return total;
+}
+
 /* Clear and free all allocated data. */
 void
 buffer_reset (struct buffer *b)
@@ -28,6 +28,7 @@
 #include "sockunion.h"
 #include "buffer.h"
 #include "log.h"
+#include "table.h"
 
 struct filter_cisco
 {
@@ -66,6 +67,12 @@ struct filter
       struct filter_cisco cfilter;
       struct filter_zebra zfilter;
     } u;
+
+  /* Position in the access_list, filters are only ever appended. */
+  unsigned long seq;
+
+  /* Next filter in the same index chain. */
+  struct filter *index_next;
 };
 
 /* List of access_list. */
@@ -213,17 +220,157 @@ filter_match_zebra (struct filter *mfilter, struct prefix *p)
 static struct access_list *
 access_list_new (void)
 {
-  return (struct access_list *) XCALLOC (MTYPE_ACCESS_LIST,
-					 sizeof (struct access_list));
+  struct access_list *access;
+
+  access = XCALLOC (MTYPE_ACCESS_LIST, sizeof (struct access_list));
+  access->ztrie = route_table_init ();
+  access->ctrie = route_table_init ();
+  return access;
 }
 
 /* Free allocated access_list. */
 static void
 access_list_free (struct access_list *access)
 {
+  route_table_finish (access->ztrie);
+  route_table_finish (access->ctrie);
   XFREE (MTYPE_ACCESS_LIST, access);
 }
 
+/* Work out where a filter is indexed.  Returns the route_table and sets
+   key, or returns NULL for cisco filters whose wildcard is not of the
+   0.0.0.255 form, which are kept on the irregular chain. */
+static struct route_table *
+filter_index_key (struct access_list *access, struct filter *filter,
+		  struct prefix *key)
+{
+  u_int32_t wildcard;
+  int len;
+
+  if (! filter->cisco)
+    {
+      prefix_copy (key, &filter->u.zfilter.prefix);
+      apply_mask (key);
+      return access->ztrie;
+    }
+
+  /* Contiguous wildcard, ie 2^n - 1, covers the low n address bits. */
+  wildcard = ntohl (filter->u.cfilter.addr_mask.s_addr);
+  if (wildcard & (wildcard + 1))
+    return NULL;
+
+  for (len = IPV4_MAX_BITLEN; wildcard; wildcard >>= 1)
+    len--;
+
+  memset (key, 0, sizeof (struct prefix));
+  key->family = AF_INET;
+  key->prefixlen = len;
+  key->u.prefix4 = filter->u.cfilter.addr;
+  return access->ctrie;
+}
+
+/* Insert filter into a chain kept in list order. */
+static void
+filter_chain_add (struct filter **head, struct filter *filter)
+{
+  struct filter **pp;
+
+  for (pp = head; *pp; pp = &(*pp)->index_next)
+    if ((*pp)->seq > filter->seq)
+      break;
+
+  filter->index_next = *pp;
+  *pp = filter;
+}
+
+static void
+filter_chain_delete (struct filter **head, struct filter *filter)
+{
+  struct filter **pp;
+
+  for (pp = head; *pp; pp = &(*pp)->index_next)
+    if (*pp == filter)
+      {
+	*pp = filter->index_next;
+	filter->index_next = NULL;
+	return;
+      }
+}
+
+static void
+filter_index_add (struct access_list *access, struct filter *filter)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct prefix key;
+
+  table = filter_index_key (access, filter, &key);
+  if (! table)
+    {
+      filter_chain_add (&access->irregular, filter);
+      return;
+    }
+
+  /* The node keeps a lock for each filter chained on it. */
+  rn = route_node_get (table, &key);
+  filter_chain_add ((struct filter **) &rn->info, filter);
+}
+
+static void
+filter_index_delete (struct access_list *access, struct filter *filter)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct prefix key;
+
+  table = filter_index_key (access, filter, &key);
+  if (! table)
+    {
+      filter_chain_delete (&access->irregular, filter);
+      return;
+    }
+
+  rn = route_node_lookup (table, &key);
+  assert (rn);
+  filter_chain_delete ((struct filter **) &rn->info, filter);
+
+  /* Once for the lookup, once for the filter. */
+  route_unlock_node (rn);
+  route_unlock_node (rn);
+}
+
+/* Find the earliest filter matching p along the trie path to key.
+   Only filters earlier than best are of interest. */
+static struct filter *
+filter_index_match (struct route_table *table, struct prefix *key,
+		    struct prefix *p, struct filter *best)
+{
+  struct route_node *match;
+  struct route_node *rn;
+  struct filter *filter;
+
+  match = route_node_match (table, key);
+  if (! match)
+    return best;
+
+  for (rn = match; rn; rn = rn->parent)
+    for (filter = rn->info; filter; filter = filter->index_next)
+      {
+	if (best && filter->seq > best->seq)
+	  break;
+
+	if (filter->cisco ? filter_match_cisco (filter, p)
+			  : filter_match_zebra (filter, p))
+	  {
+	    best = filter;
+	    break;
+	  }
+      }
+
+  route_unlock_node (match);
+  return best;
+}
+
 /* Delete access_list from access_master and free it. */
 static void
 access_list_delete (struct access_list *access)
@@ -395,33 +542,48 @@ access_list_get (afi_t afi, const char *name)
   return access;
 }
 
-/* Apply access list to object (which should be struct prefix *). */
+/* Apply access list to object (which should be struct prefix *).  The
+   first filter in list order that matches decides.  Rather than trying
+   every filter, only those on the index paths for the prefix (zebra
+   filters) and for its address (cisco filters) are tried, along with
+   any cisco filters using irregular wildcards. */
 enum filter_type
 access_list_apply (struct access_list *access, void *object)
 {
   struct filter *filter;
+  struct filter *best;
   struct prefix *p;
+  struct prefix host;
 
   p = (struct prefix *) object;
 
   if (access == NULL)
     return FILTER_DENY;
 
-  for (filter = access->head; filter; filter = filter->next)
+  best = filter_index_match (access->ztrie, p, p, NULL);
+
+  /* Cisco filters look at the IPv4 address, whatever the prefix. */
+  if (access->ctrie->top)
     {
-      if (filter->cisco)
-	{
-	  if (filter_match_cisco (filter, p))
-	    return filter->type;
-	}
-      else
+      memset (&host, 0, sizeof (struct prefix));
+      host.family = AF_INET;
+      host.prefixlen = IPV4_MAX_BITLEN;
+      host.u.prefix4 = p->u.prefix4;
+      best = filter_index_match (access->ctrie, &host, p, best);
+    }
+
+  for (filter = access->irregular; filter; filter = filter->index_next)
+    {
+      if (best && filter->seq > best->seq)
+	break;
+      if (filter_match_cisco (filter, p))
 	{
-	  if (filter_match_zebra (filter, p))
-	    return filter->type;
+	  best = filter;
+	  break;
 	}
     }
 
-  return FILTER_DENY;
+  return best ? best->type : FILTER_DENY;
 }
 
 /* Add hook function. */
@@ -457,6 +619,9 @@ access_list_filter_add (struct access_list *access, struct filter *filter)
     access->head = filter;
   access->tail = filter;
 
+  filter->seq = access->seq++;
+  filter_index_add (access, filter);
+
   /* Run hook function. */
   if (access->master->add_hook)
     (*access->master->add_hook) (access);
@@ -481,6 +646,8 @@ access_list_filter_delete (struct access_list *access, struct filter *filter)
 
   master = access->master;
 
+  filter_index_delete (access, filter);
+
   if (filter->next)
     filter->next->prev = filter->prev;
   else
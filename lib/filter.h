@@ -54,6 +54,17 @@ struct access_list
 
   struct filter *head;
   struct filter *tail;
+
+  /* Index of the filters for access_list_apply.  Zebra filters are kept
+     by prefix, cisco filters with a contiguous wildcard by the address
+     prefix they describe; each node's info is a chain of filters in list
+     order.  Cisco filters with other wildcards are chained in irregular. */
+  struct route_table *ztrie;
+  struct route_table *ctrie;
+  struct filter *irregular;
+
+  /* Order stamp for the next filter added. */
+  unsigned long seq;
 };
 
 /* Prototypes for access-list. */
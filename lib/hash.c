@@ -23,6 +23,11 @@
 
 #include "hash.h"
 #include "memory.h"
+#include "linklist.h"
+#include "command.h"
+
+/* master list of hash tables */
+static struct list hashes;
 
 /* Allocate a new hash.  */
 struct hash *
@@ -31,15 +36,18 @@ hash_create_size (unsigned int size, unsigned int (*hash_key) (void *),
 {
   struct hash *hash;
 
-  hash = XMALLOC (MTYPE_HASH, sizeof (struct hash));
+  hash = XCALLOC (MTYPE_HASH, sizeof (struct hash));
   hash->index = XMALLOC (MTYPE_HASH_INDEX, 
 			 sizeof (struct hash_backet *) * size);
   memset (hash->index, 0, sizeof (struct hash_backet *) * size);
   hash->size = size;
+  hash->min_size = size;
   hash->hash_key = hash_key;
   hash->hash_cmp = hash_cmp;
   hash->count = 0;
 
+  listnode_add (&hashes, hash);
+
   return hash;
 }
 
@@ -60,6 +68,54 @@ hash_alloc_intern (void *arg)
   return arg;
 }
 
+/* Rehash all backets into a table of the given size.  The key is kept
+   in the backet, so the hash function need not be called again.  */
+static void
+hash_resize (struct hash *hash, unsigned int new_size)
+{
+  struct hash_backet **new_index;
+  struct hash_backet *hb;
+  struct hash_backet *hbnext;
+  unsigned int i;
+
+  new_index = XCALLOC (MTYPE_HASH_INDEX,
+                       sizeof (struct hash_backet *) * new_size);
+
+  for (i = 0; i < hash->size; i++)
+    for (hb = hash->index[i]; hb; hb = hbnext)
+      {
+        unsigned int index = hb->key % new_size;
+
+        hbnext = hb->next;
+        hb->next = new_index[index];
+        new_index[index] = hb;
+      }
+
+  XFREE (MTYPE_HASH_INDEX, hash->index);
+  hash->index = new_index;
+  hash->size = new_size;
+}
+
+/* Grow or shrink the table according to its load factor. */
+static void
+hash_check_load (struct hash *hash)
+{
+  if (hash->walking)
+    return;
+
+  if (hash->count > (unsigned long) hash->size * HASH_LOAD_MAX)
+    {
+      hash_resize (hash, hash->size * 2);
+      hash->grows++;
+    }
+  else if (hash->size / 2 >= hash->min_size
+           && hash->count * HASH_LOAD_MIN < hash->size)
+    {
+      hash_resize (hash, hash->size / 2);
+      hash->shrinks++;
+    }
+}
+
 /* Lookup and return hash backet in hash.  If there is no
    corresponding hash backet and alloc_func is specified, create new
    hash backet.  */
@@ -90,6 +146,7 @@ hash_get (struct hash *hash, void *data, void * (*alloc_func) (void *))
       backet->next = hash->index[index];
       hash->index[index] = backet;
       hash->count++;
+      hash_check_load (hash);
       return backet->data;
     }
   return NULL;
@@ -129,6 +186,7 @@ hash_release (struct hash *hash, void *data)
 	  ret = backet->data;
 	  XFREE (MTYPE_HASH_BACKET, backet);
 	  hash->count--;
+	  hash_check_load (hash);
 	  return ret;
 	}
       pp = backet;
@@ -145,6 +203,8 @@ hash_iterate (struct hash *hash,
   struct hash_backet *hb;
   struct hash_backet *hbnext;
 
+  /* (*func) may add or release entries, don't resize under it. */
+  hash->walking++;
   for (i = 0; i < hash->size; i++)
     for (hb = hash->index[i]; hb; hb = hbnext)
       {
@@ -154,6 +214,7 @@ hash_iterate (struct hash *hash,
 	hbnext = hb->next;
 	(*func) (hb, arg);
       }
+  hash->walking--;
 }
 
 /* Clean up hash.  */
@@ -164,6 +225,7 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
   struct hash_backet *hb;
   struct hash_backet *next;
 
+  hash->walking++;
   for (i = 0; i < hash->size; i++)
     {
       for (hb = hash->index[i]; hb; hb = next)
@@ -178,6 +240,7 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 	}
       hash->index[i] = NULL;
     }
+  hash->walking--;
 }
 
 /* Free hash memory.  You may call hash_clean before call this
@@ -185,6 +248,57 @@ hash_clean (struct hash *hash, void (*free_func) (void *))
 void
 hash_free (struct hash *hash)
 {
+  listnode_delete (&hashes, hash);
   XFREE (MTYPE_HASH_INDEX, hash->index);
   XFREE (MTYPE_HASH, hash);
 }
+
+DEFUN (show_hash_stats,
+       show_hash_stats_cmd,
+       "show hashtable statistics",
+       SHOW_STR
+       "Hash table information\n"
+       "Hash table chain length statistics\n")
+{
+  struct listnode *node;
+  struct hash *hash;
+
+  vty_out (vty, "%-24s %8s %8s %6s %6s %5s %7s %6s %7s%s",
+           "Name", "Entries", "Buckets", "Load", "Empty", "Max",
+           "Avg", "Grows", "Shrinks", VTY_NEWLINE);
+  vty_out (vty, "%-24s %8s %8s %6s %6s %5s %7s%s",
+           "", "", "", "", "", "chain", "chain", VTY_NEWLINE);
+
+  for (ALL_LIST_ELEMENTS_RO ((&hashes), node, hash))
+    {
+      unsigned int i, len, used = 0, max = 0;
+      unsigned long load, avg;
+      struct hash_backet *hb;
+
+      if (!hash->name)
+        continue;
+
+      for (i = 0; i < hash->size; i++)
+        {
+          for (len = 0, hb = hash->index[i]; hb; hb = hb->next)
+            len++;
+          if (len)
+            used++;
+          if (len > max)
+            max = len;
+        }
+
+      /* load and average length of non-empty chains, in hundredths */
+      load = (hash->count * 100) / hash->size;
+      avg = used ? (hash->count * 100) / used : 0;
+
+      vty_out (vty, "%-24s %8lu %8u %3lu.%02lu %5lu%% %5u %4lu.%02lu %6lu %7lu%s",
+               hash->name, hash->count, hash->size,
+               load / 100, load % 100,
+               ((unsigned long) (hash->size - used) * 100) / hash->size,
+               max, avg / 100, avg % 100,
+               hash->grows, hash->shrinks, VTY_NEWLINE);
+    }
+
+  return CMD_SUCCESS;
+}
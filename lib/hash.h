@@ -24,6 +24,12 @@ Boston, MA 02111-1307, USA.  */
 /* Default hash table size.  */ 
 #define HASHTABSIZE     1024
 
+/* The table is doubled when the average chain length exceeds
+   HASH_LOAD_MAX, and halved (but never below its initial size) when
+   fewer than one in HASH_LOAD_MIN buckets would be in use.  */
+#define HASH_LOAD_MAX   2
+#define HASH_LOAD_MIN   8
+
 struct hash_backet
 {
   /* Linked list.  */
@@ -52,6 +58,20 @@ struct hash
 
   /* Backet alloc. */
   unsigned long count;
+
+  /* Initial table size, the table never shrinks below this. */
+  unsigned int min_size;
+
+  /* Resizing is deferred while hash_iterate/hash_clean walk the table. */
+  unsigned int walking;
+
+  /* Resize counters. */
+  unsigned long grows;
+  unsigned long shrinks;
+
+  /* Name to report the table under in 'show hashtable statistics',
+     tables without a name are not shown.  Owner may set this. */
+  const char *name;
 };
 
 extern struct hash *hash_create (unsigned int (*) (void *), 
@@ -70,4 +90,6 @@ extern void hash_iterate (struct hash *,
 extern void hash_clean (struct hash *, void (*) (void *));
 extern void hash_free (struct hash *);
 
+extern struct cmd_element show_hash_stats_cmd;
+
 #endif /* _ZEBRA_HASH_H */
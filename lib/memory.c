@@ -58,12 +58,197 @@ zerror (const char *fname, int type, size_t size)
   abort();
 }
 
+/* Objects of MEMORY_POOL types are carved out of slabs of
+   MEMORY_SLAB_SIZE bytes, aligned on their size so that the slab an
+   object belongs to is found by masking its address.  Each slab keeps
+   its own free list, a pool keeps the slabs which have room on a list,
+   and a slab with nothing left in use goes back to the system unless
+   it is the pool's only spare.  */
+#define MEMORY_SLAB_SIZE	262144
+#define MEMORY_ALIGN		8
+#define MEMORY_ROUND(S)		(((S) + MEMORY_ALIGN - 1) & ~(MEMORY_ALIGN - 1))
+
+struct memory_slab
+{
+  struct memory_slab *next;
+  struct memory_slab *prev;
+
+  /* Objects freed, then the ones never handed out. */
+  void *free;
+  char *fresh;
+
+  unsigned int used;
+};
+
+#define MEMORY_SLAB_HEAD	MEMORY_ROUND (sizeof (struct memory_slab))
+
+static struct memory_pool
+{
+  int enabled;
+
+  /* Object size, set by the first allocation, and objects per slab. */
+  size_t size;
+  unsigned int count;
+
+  /* Slabs with room. */
+  struct memory_slab *room;
+
+  /* Slab kept while nothing in it is in use. */
+  struct memory_slab *spare;
+
+  unsigned long slabs;
+  unsigned long used;
+} mpool[MTYPE_MAX];
+
+static int mpool_ready;
+
+static void
+mpool_init (void)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+  struct mlist *ml;
+  struct memory_list *m;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      if (m->index && (m->flags & MEMORY_POOL))
+	mpool[m->index].enabled = 1;
+#endif /* HAVE_POSIX_MEMALIGN */
+  mpool_ready = 1;
+}
+
+/* Pool for the type, or NULL if it is allocated by malloc. */
+static inline struct memory_pool *
+mpool_get (int type)
+{
+  if (! mpool_ready)
+    mpool_init ();
+  return mpool[type].enabled ? &mpool[type] : NULL;
+}
+
+static void
+mpool_room_add (struct memory_pool *pool, struct memory_slab *slab)
+{
+  slab->prev = NULL;
+  slab->next = pool->room;
+  if (pool->room)
+    pool->room->prev = slab;
+  pool->room = slab;
+}
+
+static void
+mpool_room_delete (struct memory_pool *pool, struct memory_slab *slab)
+{
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    pool->room = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+}
+
+static void *
+mpool_alloc (int type, struct memory_pool *pool, size_t size)
+{
+  struct memory_slab *slab;
+  void *memory;
+
+  if (pool->size == 0)
+    {
+      pool->size = MEMORY_ROUND (size > sizeof (void *)
+				 ? size : sizeof (void *));
+      pool->count = (MEMORY_SLAB_SIZE - MEMORY_SLAB_HEAD) / pool->size;
+
+      /* Not worth it for large objects, leave them to malloc. */
+      if (pool->count < 16)
+	{
+	  pool->enabled = 0;
+	  return NULL;
+	}
+    }
+  else if (size > pool->size)
+    zerror ("pool", type, size);
+
+  slab = pool->room;
+  if (slab == NULL)
+    {
+#ifdef HAVE_POSIX_MEMALIGN
+      if (posix_memalign ((void **) &slab, MEMORY_SLAB_SIZE,
+			  MEMORY_SLAB_SIZE) != 0)
+	slab = NULL;
+#endif /* HAVE_POSIX_MEMALIGN */
+      if (slab == NULL)
+	zerror ("posix_memalign", type, MEMORY_SLAB_SIZE);
+
+      slab->free = NULL;
+      slab->fresh = (char *) slab + MEMORY_SLAB_HEAD;
+      slab->used = 0;
+      mpool_room_add (pool, slab);
+      pool->slabs++;
+    }
+
+  if (slab->free)
+    {
+      memory = slab->free;
+      slab->free = *(void **) memory;
+    }
+  else
+    {
+      memory = slab->fresh;
+      slab->fresh += pool->size;
+    }
+
+  if (slab == pool->spare)
+    pool->spare = NULL;
+  if (++slab->used == pool->count)
+    mpool_room_delete (pool, slab);
+  pool->used++;
+
+  return memory;
+}
+
+static void
+mpool_free (struct memory_pool *pool, void *ptr)
+{
+  struct memory_slab *slab;
+
+  slab = (struct memory_slab *) ((uintptr_t) ptr
+				 & ~(uintptr_t) (MEMORY_SLAB_SIZE - 1));
+
+  *(void **) ptr = slab->free;
+  slab->free = ptr;
+
+  if (slab->used-- == pool->count)
+    mpool_room_add (pool, slab);
+  pool->used--;
+
+  if (slab->used == 0)
+    {
+      if (pool->spare == NULL)
+	pool->spare = slab;
+      else
+	{
+	  mpool_room_delete (pool, slab);
+	  free (slab);
+	  pool->slabs--;
+	}
+    }
+}
+
 /* Memory allocation. */
 void *
 zmalloc (int type, size_t size)
 {
+  struct memory_pool *pool;
   void *memory;
 
+  if ((pool = mpool_get (type)) != NULL
+      && (memory = mpool_alloc (type, pool, size)) != NULL)
+    {
+      alloc_inc (type);
+      return memory;
+    }
+
   memory = malloc (size);
 
   if (memory == NULL)
@@ -78,8 +263,17 @@ zmalloc (int type, size_t size)
 void *
 zcalloc (int type, size_t size)
 {
+  struct memory_pool *pool;
   void *memory;
 
+  if ((pool = mpool_get (type)) != NULL
+      && (memory = mpool_alloc (type, pool, size)) != NULL)
+    {
+      memset (memory, 0, size);
+      alloc_inc (type);
+      return memory;
+    }
+
   memory = calloc (1, size);
 
   if (memory == NULL)
@@ -94,8 +288,16 @@ zcalloc (int type, size_t size)
 void *
 zrealloc (int type, void *ptr, size_t size)
 {
+  struct memory_pool *pool;
   void *memory;
 
+  if ((pool = mpool_get (type)) != NULL)
+    {
+      if (size > pool->size)
+	zerror ("pool", type, size);
+      return ptr;
+    }
+
   memory = realloc (ptr, size);
   if (memory == NULL)
     zerror ("realloc", type, size);
@@ -106,8 +308,13 @@ zrealloc (int type, void *ptr, size_t size)
 void
 zfree (int type, void *ptr)
 {
+  struct memory_pool *pool;
+
   alloc_dec (type);
-  free (ptr);
+  if (ptr && (pool = mpool_get (type)) != NULL)
+    mpool_free (pool, ptr);
+  else
+    free (ptr);
 }
 
 /* String duplication. */
@@ -323,6 +530,39 @@ show_memory_mallinfo (struct vty *vty)
 }
 #endif /* HAVE_MALLINFO */
 
+static int
+show_memory_pools (struct vty *vty)
+{
+  struct mlist *ml;
+  struct memory_list *m;
+  struct memory_pool *pool;
+  char buf[MTYPE_MEMSTR_LEN];
+  int header = 1;
+
+  for (ml = mlists; ml->list; ml++)
+    for (m = ml->list; m->index >= 0; m++)
+      {
+	if (m->index == 0 || ! mpool[m->index].slabs)
+	  continue;
+	pool = &mpool[m->index];
+
+	if (header)
+	  {
+	    vty_out (vty, "Memory pools, in slabs of %s:%s",
+		     mtype_memstr (buf, MTYPE_MEMSTR_LEN, MEMORY_SLAB_SIZE),
+		     VTY_NEWLINE);
+	    vty_out (vty, "%-30s %6s %10s %10s %7s%s", "", "Size", "Used",
+		     "Free", "Slabs", VTY_NEWLINE);
+	    header = 0;
+	  }
+	vty_out (vty, "%-30s %6lu %10lu %10lu %7lu%s", m->format,
+		 (unsigned long) pool->size, pool->used,
+		 pool->slabs * pool->count - pool->used, pool->slabs,
+		 VTY_NEWLINE);
+      }
+  return ! header;
+}
+
 DEFUN (show_memory_all,
        show_memory_all_cmd,
        "show memory all",
@@ -336,6 +576,10 @@ DEFUN (show_memory_all,
 #ifdef HAVE_MALLINFO
   needsep = show_memory_mallinfo (vty);
 #endif /* HAVE_MALLINFO */
+
+  if (needsep)
+    show_separator (vty);
+  needsep = show_memory_pools (vty);
   
   for (ml = mlists; ml->list; ml++)
     {
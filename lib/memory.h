@@ -26,8 +26,15 @@ struct memory_list
 {
   int index;
   const char *format;
+  int flags;
 };
 
+/* Flags for memory_list.  MEMORY_POOL types are allocated from slabs
+   of same sized objects, rather than by malloc one at a time.  No
+   allocation of such a type may be larger than the first one, nor grow
+   by realloc.  */
+#define MEMORY_POOL	(1 << 0)
+
 struct mlist {
   struct memory_list *list;
   const char *name;
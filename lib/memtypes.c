@@ -20,10 +20,11 @@ struct memory_list memory_list_lib[] =
   { MTYPE_VECTOR_INDEX,		"Vector index"			},
   { MTYPE_LINK_LIST,		"Link List"			},
   { MTYPE_LINK_NODE,		"Link Node"			},
-  { MTYPE_THREAD,		"Thread"			},
+  { MTYPE_THREAD,		"Thread",			MEMORY_POOL },
   { MTYPE_THREAD_MASTER,	"Thread master"			},
   { MTYPE_THREAD_STATS,		"Thread stats"			},
   { MTYPE_THREAD_FUNCNAME,	"Thread function name" 		},
+  { MTYPE_THREAD_POLL,		"Thread poll state"		},
   { MTYPE_VTY,			"VTY"				},
   { MTYPE_VTY_OUT_BUF,		"VTY output buffer"		},
   { MTYPE_VTY_HIST,		"VTY history"			},
@@ -32,7 +33,7 @@ struct memory_list memory_list_lib[] =
   { MTYPE_CONNECTED_LABEL,	"Connected interface label"	},
   { MTYPE_BUFFER,		"Buffer"			},
   { MTYPE_BUFFER_DATA,		"Buffer data"			},
-  { MTYPE_STREAM,		"Stream"			},
+  { MTYPE_STREAM,		"Stream",			MEMORY_POOL },
   { MTYPE_STREAM_DATA,		"Stream data"			},
   { MTYPE_STREAM_FIFO,		"Stream FIFO"			},
   { MTYPE_PREFIX,		"Prefix"			},
@@ -42,7 +43,10 @@ struct memory_list memory_list_lib[] =
   { MTYPE_HASH_BACKET,		"Hash Bucket"			},
   { MTYPE_HASH_INDEX,		"Hash Index"			},
   { MTYPE_ROUTE_TABLE,		"Route table"			},
-  { MTYPE_ROUTE_NODE,		"Route node"			},
+  { MTYPE_ROUTE_NODE,		"Route node",			MEMORY_POOL },
+  { MTYPE_ROUTE_NODE_IPV4,	"IPv4 route node",		MEMORY_POOL },
+  { MTYPE_ROUTE_LPM,		"Route table index"		},
+  { MTYPE_ROUTE_LPM_CHUNK,	"Route table index chunk",	MEMORY_POOL },
   { MTYPE_DISTRIBUTE,		"Distribute list"		},
   { MTYPE_DISTRIBUTE_IFNAME,	"Dist-list ifname"		},
   { MTYPE_ACCESS_LIST,		"Access List"			},
@@ -80,11 +84,14 @@ struct memory_list memory_list_zebra[] =
   { MTYPE_RTADV_PREFIX,		"Router Advertisement Prefix"	},
   { MTYPE_VRF,			"VRF"				},
   { MTYPE_VRF_NAME,		"VRF name"			},
-  { MTYPE_NEXTHOP,		"Nexthop"			},
-  { MTYPE_RIB,			"RIB"				},
+  { MTYPE_NEXTHOP,		"Nexthop",			MEMORY_POOL },
+  { MTYPE_RIB,			"RIB",				MEMORY_POOL },
   { MTYPE_RIB_QUEUE,		"RIB process work queue"	},
   { MTYPE_STATIC_IPV4,		"Static IPv4 route"		},
   { MTYPE_STATIC_IPV6,		"Static IPv6 route"		},
+  { MTYPE_NEXTHOP_TRACK,	"Nexthop tracking"		},
+  { MTYPE_RIB_DEP,		"RIB nexthop dependency"	},
+  { MTYPE_NEXTHOP_GROUP,	"Nexthop group"			},
   { -1, NULL },
 };
 
@@ -93,30 +100,33 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP,			"BGP instance"			},
   { MTYPE_BGP_PEER,		"BGP peer"			},
   { MTYPE_BGP_PEER_HOST,	"BGP peer hostname"		},
+  { MTYPE_BGP_PEER_LATENCY,	"BGP peer latency"		},
   { MTYPE_PEER_GROUP,		"Peer group"			},
   { MTYPE_PEER_DESC,		"Peer description"		},
   { MTYPE_PEER_PASSWORD,	"Peer password string"		},
-  { MTYPE_ATTR,			"BGP attribute"			},
-  { MTYPE_ATTR_EXTRA,		"BGP extra attributes"		},
-  { MTYPE_AS_PATH,		"BGP aspath"			},
-  { MTYPE_AS_SEG,		"BGP aspath seg"		},
+  { MTYPE_ATTR,			"BGP attribute",			MEMORY_POOL },
+  { MTYPE_ATTR_EXTRA,		"BGP extra attributes",		MEMORY_POOL },
+  { MTYPE_AS_PATH,		"BGP aspath",			MEMORY_POOL },
+  { MTYPE_AS_SEG,		"BGP aspath seg",		MEMORY_POOL },
   { MTYPE_AS_SEG_DATA,		"BGP aspath segment data"	},
   { MTYPE_AS_STR,		"BGP aspath str"		},
   { 0, NULL },
   { MTYPE_BGP_TABLE,		"BGP table"			},
-  { MTYPE_BGP_NODE,		"BGP node"			},
-  { MTYPE_BGP_ROUTE,		"BGP route"			},
-  { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info"	},
+  { MTYPE_BGP_NODE,		"BGP node",			MEMORY_POOL },
+  { MTYPE_BGP_NODE_IPV4,	"BGP IPv4 node",		MEMORY_POOL },
+  { MTYPE_BGP_ROUTE,		"BGP route",			MEMORY_POOL },
+  { MTYPE_BGP_ROUTE_EXTRA,	"BGP ancillary route info",	MEMORY_POOL },
   { MTYPE_BGP_STATIC,		"BGP static"			},
-  { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr"			},
-  { MTYPE_BGP_ADVERTISE,	"BGP adv"			},
+  { MTYPE_BGP_ADVERTISE_ATTR,	"BGP adv attr",			MEMORY_POOL },
+  { MTYPE_BGP_ADVERTISE,	"BGP adv",			MEMORY_POOL },
   { MTYPE_BGP_SYNCHRONISE,	"BGP synchronise"		},
-  { MTYPE_BGP_ADJ_IN,		"BGP adj in"			},
-  { MTYPE_BGP_ADJ_OUT,		"BGP adj out"			},
+  { MTYPE_BGP_ADJ_IN,		"BGP adj in",			MEMORY_POOL },
+  { MTYPE_BGP_ADJ_OUT,		"BGP adj out",			MEMORY_POOL },
   { 0, NULL },
   { MTYPE_AS_LIST,		"BGP AS list"			},
   { MTYPE_AS_FILTER,		"BGP AS filter"			},
   { MTYPE_AS_FILTER_STR,	"BGP AS filter str"		},
+  { MTYPE_AS_LIST_MATCH,	"BGP AS list match"		},
   { 0, NULL },
   { MTYPE_COMMUNITY,		"community"			},
   { MTYPE_COMMUNITY_VAL,	"community val"			},
@@ -136,6 +146,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_CLUSTER_VAL,		"Cluster list val"		},
   { 0, NULL },
   { MTYPE_BGP_PROCESS_QUEUE,	"BGP Process queue"		},
+  { MTYPE_BGP_SHOW,		"BGP show state"		},
   { MTYPE_BGP_CLEAR_NODE_QUEUE, "BGP node clear queue"		},
   { 0, NULL },
   { MTYPE_TRANSIT,		"BGP transit attr"		},
@@ -149,6 +160,7 @@ struct memory_list memory_list_bgp[] =
   { MTYPE_BGP_DAMP_ARRAY,	"BGP Dampening array"		},
   { MTYPE_BGP_REGEXP,		"BGP regexp"			},
   { MTYPE_BGP_AGGREGATE,	"BGP aggregate"			},
+  { MTYPE_BGP_UPDATE_GROUP,	"BGP update-group"		},
   { -1, NULL }
 };
 
@@ -29,6 +29,7 @@
 #include "buffer.h"
 #include "stream.h"
 #include "log.h"
+#include "table.h"
 
 /* Each prefix-list's entry. */
 struct prefix_list_entry
@@ -48,6 +49,9 @@ struct prefix_list_entry
 
   struct prefix_list_entry *next;
   struct prefix_list_entry *prev;
+
+  /* Next entry with the same prefix, in the prefix_list's trie. */
+  struct prefix_list_entry *trie_next;
 };
 
 /* List of struct prefix_list. */
@@ -156,12 +160,14 @@ prefix_list_new (void)
   struct prefix_list *new;
 
   new = XCALLOC (MTYPE_PREFIX_LIST, sizeof (struct prefix_list));
+  new->trie = route_table_init ();
   return new;
 }
 
 static void
 prefix_list_free (struct prefix_list *plist)
 {
+  route_table_finish (plist->trie);
   XFREE (MTYPE_PREFIX_LIST, plist);
 }
 
@@ -430,6 +436,50 @@ prefix_list_entry_lookup (struct prefix_list *plist, struct prefix *prefix,
   return NULL;
 }
 
+/* Index entry in the prefix-list's trie, keeping entries of the same
+   prefix in sequence order.  The trie node keeps a lock per entry. */
+static void
+prefix_list_trie_add (struct prefix_list *plist,
+		      struct prefix_list_entry *pentry)
+{
+  struct route_node *rn;
+  struct prefix_list_entry **pp;
+
+  rn = route_node_get (plist->trie, &pentry->prefix);
+
+  for (pp = (struct prefix_list_entry **) &rn->info; *pp;
+       pp = &(*pp)->trie_next)
+    if ((*pp)->seq > pentry->seq)
+      break;
+
+  pentry->trie_next = *pp;
+  *pp = pentry;
+}
+
+static void
+prefix_list_trie_delete (struct prefix_list *plist,
+			 struct prefix_list_entry *pentry)
+{
+  struct route_node *rn;
+  struct prefix_list_entry **pp;
+
+  rn = route_node_lookup (plist->trie, &pentry->prefix);
+  assert (rn);
+
+  for (pp = (struct prefix_list_entry **) &rn->info; *pp;
+       pp = &(*pp)->trie_next)
+    if (*pp == pentry)
+      {
+	*pp = pentry->trie_next;
+	pentry->trie_next = NULL;
+	break;
+      }
+
+  /* Once for the lookup, once for the entry. */
+  route_unlock_node (rn);
+  route_unlock_node (rn);
+}
+
 static void
 prefix_list_entry_delete (struct prefix_list *plist, 
 			  struct prefix_list_entry *pentry,
@@ -437,6 +487,9 @@ prefix_list_entry_delete (struct prefix_list *plist,
 {
   if (plist == NULL || pentry == NULL)
     return;
+
+  prefix_list_trie_delete (plist, pentry);
+
   if (pentry->prev)
     pentry->prev->next = pentry->next;
   else
@@ -507,6 +560,8 @@ prefix_list_entry_add (struct prefix_list *plist,
       plist->tail = pentry;
     }
 
+  prefix_list_trie_add (plist, pentry);
+
   /* Increment count. */
   plist->count++;
 
@@ -560,10 +615,18 @@ prefix_list_entry_match (struct prefix_list_entry *pentry, struct prefix *p)
   return 1;
 }
 
+/* Find the first entry, in sequence order, matching the prefix.  Only
+   entries whose prefix covers p can match, and those all lie on the
+   path from the root of the trie to p's longest match, so just those
+   are checked, giving cost proportional to the prefix length rather
+   than the size of the list.  refcnt counts the entries checked. */
 enum prefix_list_type
 prefix_list_apply (struct prefix_list *plist, void *object)
 {
   struct prefix_list_entry *pentry;
+  struct prefix_list_entry *best = NULL;
+  struct route_node *match;
+  struct route_node *rn;
   struct prefix *p;
 
   p = (struct prefix *) object;
@@ -574,14 +637,31 @@ prefix_list_apply (struct prefix_list *plist, void *object)
   if (plist->count == 0)
     return PREFIX_PERMIT;
 
-  for (pentry = plist->head; pentry; pentry = pentry->next)
+  match = route_node_match (plist->trie, p);
+  if (match == NULL)
+    return PREFIX_DENY;
+
+  for (rn = match; rn; rn = rn->parent)
+    for (pentry = rn->info; pentry; pentry = pentry->trie_next)
+      {
+	/* Chain is in sequence order, nothing further can be earlier. */
+	if (best && pentry->seq > best->seq)
+	  break;
+
+	pentry->refcnt++;
+	if (prefix_list_entry_match (pentry, p))
+	  {
+	    best = pentry;
+	    break;
+	  }
+      }
+
+  route_unlock_node (match);
+
+  if (best)
     {
-      pentry->refcnt++;
-      if (prefix_list_entry_match (pentry, p))
-	{
-	  pentry->hitcnt++;
-	  return pentry->type;
-	}
+      best->hitcnt++;
+      return best->type;
     }
 
   return PREFIX_DENY;
@@ -52,6 +52,10 @@ struct prefix_list
   struct prefix_list_entry *head;
   struct prefix_list_entry *tail;
 
+  /* Entries indexed by prefix, for prefix_list_apply.  Each node's info
+     is the chain of entries with that prefix, in sequence order. */
+  struct route_table *trie;
+
   struct prefix_list *next;
   struct prefix_list *prev;
 };
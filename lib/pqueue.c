@@ -168,3 +168,21 @@ pqueue_dequeue (struct pqueue *queue)
   trickle_down (0, queue);
   return data;
 }
+
+void
+pqueue_remove_at (int index, struct pqueue *queue)
+{
+  assert (index >= 0 && index < queue->size);
+
+  queue->array[index] = queue->array[--queue->size];
+  if (index == queue->size)
+    return;
+
+  /* The node moved into the hole may belong above or below it. */
+  if (index > 0
+      && (*queue->cmp) (queue->array[index],
+                        queue->array[PARENT_OF (index)]) < 0)
+    trickle_up (index, queue);
+  else
+    trickle_down (index, queue);
+}
@@ -864,6 +864,54 @@ route_map_apply (struct route_map *map, struct prefix *prefix,
   return RMAP_DENYMATCH;
 }
 
+static int
+route_map_rule_list_uses (struct route_map_rule_list *list,
+                          struct route_map_rule_cmd *cmd,
+                          const char *rule_str)
+{
+  struct route_map_rule *rule;
+
+  for (rule = list->head; rule; rule = rule->next)
+    if (rule->cmd == cmd
+        && (! rule_str || (rule->rule_str
+                           && strcmp (rule->rule_str, rule_str) == 0)))
+      return 1;
+  return 0;
+}
+
+/* Does any entry of the route map, or of a route map it calls, have a
+   match or set rule of type cmd, with argument rule_str if that is
+   given?  Calls nested beyond RMAP_RECURSION_LIMIT are assumed to. */
+int
+route_map_uses_rule (struct route_map *map, struct route_map_rule_cmd *cmd,
+                     const char *rule_str)
+{
+  static int recursion = 0;
+  struct route_map_index *index;
+  int ret = 0;
+
+  if (map == NULL)
+    return 0;
+
+  if (recursion > RMAP_RECURSION_LIMIT)
+    return 1;
+
+  for (index = map->head; index && ! ret; index = index->next)
+    {
+      if (route_map_rule_list_uses (&index->match_list, cmd, rule_str)
+          || route_map_rule_list_uses (&index->set_list, cmd, rule_str))
+        ret = 1;
+      else if (index->nextrm)
+        {
+          recursion++;
+          ret = route_map_uses_rule (route_map_lookup_by_name (index->nextrm),
+                                     cmd, rule_str);
+          recursion--;
+        }
+    }
+  return ret;
+}
+
 void
 route_map_add_hook (void (*func) (const char *))
 {
@@ -189,6 +189,11 @@ extern route_map_result_t route_map_apply (struct route_map *map,
                                            route_map_object_t object_type,
                                            void *object);
 
+/* Does the route map, or one it calls, use a rule of this type? */
+extern int route_map_uses_rule (struct route_map *map,
+                                struct route_map_rule_cmd *cmd,
+                                const char *rule_str);
+
 extern void route_map_add_hook (void (*func) (const char *));
 extern void route_map_delete_hook (void (*func) (const char *));
 extern void route_map_event_hook (void (*func) (route_map_event_t, const char *));
@@ -29,6 +29,185 @@
 
 void route_node_delete (struct route_node *);
 void route_table_free (struct route_table *);
+
+/* Index for longest prefix match.
+
+   route_node_match () goes down the tree a bit at a time, which for a
+   full table is 20 or more nodes each far from the last.  The index
+   cuts addresses into a first stride of 16 bits and strides of 4 bits
+   after it.  Each slot holds the deepest node of the tree covering all
+   of the slot, or a chunk for the next stride if some node ends within
+   the slot.  A node is expanded over the slots it covers at the stride
+   it ends in, a /18 takes 4 slots of the chunk under its /16.
+
+   All nodes are indexed, not only those with info, as info is set and
+   cleared by callers without telling us.  A lookup finds the deepest
+   node covering the address and goes up the tree from there, the nodes
+   covering an address are all on one path of the tree.  */
+#define LPM_FIRST_BITS		16
+#define LPM_BITS		4
+#define LPM_LEVELS		(1 + (IPV6_MAX_BITLEN - LPM_FIRST_BITS) / LPM_BITS)
+
+/* A slot holds a node, or a chunk with the low bit set. */
+#define LPM_IS_CHUNK(S)		((S) & 1)
+#define LPM_CHUNK(S)		((struct route_lpm_chunk *) ((S) & ~(uintptr_t) 1))
+#define LPM_NODE(S)		((struct route_node *) (S))
+
+struct route_lpm_chunk
+{
+  uintptr_t slot[1 << LPM_BITS];
+};
+
+struct route_lpm
+{
+  /* Family of the nodes indexed. */
+  u_char family;
+
+  unsigned long chunks;
+
+  uintptr_t slot[1 << LPM_FIRST_BITS];
+};
+
+/* Slot of ADDR at the stride starting at bit START. */
+static inline unsigned int
+lpm_index (const u_char *addr, int start)
+{
+  if (start == 0)
+    return addr[0] << 8 | addr[1];
+  return (start % 8 ? addr[start / 8] : addr[start / 8] >> 4) & 0xf;
+}
+
+static void
+lpm_replace (uintptr_t *slot, struct route_node *from, struct route_node *to)
+{
+  struct route_lpm_chunk *chunk;
+  int i;
+
+  if (LPM_IS_CHUNK (*slot))
+    {
+      chunk = LPM_CHUNK (*slot);
+      for (i = 0; i < (1 << LPM_BITS); i++)
+	lpm_replace (&chunk->slot[i], from, to);
+    }
+  else if (LPM_NODE (*slot) == from)
+    *slot = (uintptr_t) to;
+}
+
+/* Give the slots covered by NODE which hold FROM to TO instead.  A node
+   is added with FROM its parent and TO itself, and removed the other
+   way round, the slots it covers hold either it, its parent or nodes
+   under it.  */
+static void
+lpm_update (struct route_lpm *lpm, struct route_node *node,
+	    struct route_node *from, struct route_node *to)
+{
+  const u_char *addr = &node->p.u.prefix;
+  int len = node->p.prefixlen;
+  uintptr_t *path[LPM_LEVELS];
+  uintptr_t *slots;
+  uintptr_t *slot;
+  uintptr_t first;
+  struct route_lpm_chunk *chunk;
+  unsigned int index;
+  int start;
+  int bits;
+  int depth;
+  int i;
+
+  /* Down to the stride the prefix ends in. */
+  slots = lpm->slot;
+  start = 0;
+  bits = LPM_FIRST_BITS;
+  depth = 0;
+  while (len > start + bits)
+    {
+      slot = &slots[lpm_index (addr, start)];
+      if (! LPM_IS_CHUNK (*slot))
+	{
+	  chunk = XMALLOC (MTYPE_ROUTE_LPM_CHUNK,
+			   sizeof (struct route_lpm_chunk));
+	  for (i = 0; i < (1 << LPM_BITS); i++)
+	    chunk->slot[i] = *slot;
+	  *slot = (uintptr_t) chunk | 1;
+	  lpm->chunks++;
+	}
+      path[depth++] = slot;
+      slots = LPM_CHUNK (*slot)->slot;
+      start += bits;
+      bits = LPM_BITS;
+    }
+
+  index = lpm_index (addr, start) & ~((1 << (start + bits - len)) - 1);
+  for (i = 0; i < (1 << (start + bits - len)); i++)
+    lpm_replace (&slots[index + i], from, to);
+
+  /* Fold chunks left with nothing ending in them back up. */
+  while (depth > 0)
+    {
+      chunk = LPM_CHUNK (*path[depth - 1]);
+      start = LPM_FIRST_BITS + (depth - 1) * LPM_BITS;
+      first = chunk->slot[0];
+
+      if (LPM_IS_CHUNK (first)
+	  || (first && LPM_NODE (first)->p.prefixlen > start))
+	break;
+      for (i = 1; i < (1 << LPM_BITS); i++)
+	if (chunk->slot[i] != first)
+	  break;
+      if (i < (1 << LPM_BITS))
+	break;
+
+      *path[--depth] = first;
+      XFREE (MTYPE_ROUTE_LPM_CHUNK, chunk);
+      lpm->chunks--;
+    }
+}
+
+/* Deepest node covering ADDR. */
+static struct route_node *
+lpm_lookup (struct route_lpm *lpm, const u_char *addr)
+{
+  uintptr_t slot;
+  int start;
+
+  slot = lpm->slot[lpm_index (addr, 0)];
+  for (start = LPM_FIRST_BITS; LPM_IS_CHUNK (slot); start += LPM_BITS)
+    slot = LPM_CHUNK (slot)->slot[lpm_index (addr, start)];
+
+  return LPM_NODE (slot);
+}
+
+static void
+lpm_add (struct route_table *table, struct route_node *node)
+{
+  if (table->lpm && node->p.family == table->lpm->family)
+    lpm_update (table->lpm, node, node->parent, node);
+}
+
+static void
+lpm_free_slot (uintptr_t slot)
+{
+  struct route_lpm_chunk *chunk;
+  int i;
+
+  if (! LPM_IS_CHUNK (slot))
+    return;
+
+  chunk = LPM_CHUNK (slot);
+  for (i = 0; i < (1 << LPM_BITS); i++)
+    lpm_free_slot (chunk->slot[i]);
+  XFREE (MTYPE_ROUTE_LPM_CHUNK, chunk);
+}
+
+static void
+lpm_free (struct route_lpm *lpm)
+{
+  int i;
+
+  for (i = 0; i < (1 << LPM_FIRST_BITS); i++)
+    lpm_free_slot (lpm->slot[i]);
+  XFREE (MTYPE_ROUTE_LPM, lpm);
+}
 
 struct route_table *
 route_table_init (void)
@@ -45,12 +224,41 @@ route_table_finish (struct route_table *rt)
   route_table_free (rt);
 }
 
+/* Index the nodes of FAMILY in TABLE for route_node_match (), worth it
+   for large tables which are looked up in a lot.  */
+void
+route_table_lpm (struct route_table *table, u_char family)
+{
+  struct route_node *node;
+
+  if (table->lpm)
+    return;
+
+  table->lpm = XCALLOC (MTYPE_ROUTE_LPM, sizeof (struct route_lpm));
+  table->lpm->family = family;
+
+  for (node = route_top (table); node; node = route_next (node))
+    lpm_add (table, node);
+}
+
+/* Number of chunks in the index of TABLE. */
+unsigned long
+route_table_lpm_chunks (struct route_table *table)
+{
+  return table->lpm ? table->lpm->chunks : 0;
+}
+
 /* Allocate new route node. */
 static struct route_node *
-route_node_new (void)
+route_node_new (u_char family)
 {
   struct route_node *node;
-  node = XCALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
+
+  if (family == AF_INET)
+    node = XCALLOC (MTYPE_ROUTE_NODE_IPV4, ROUTE_NODE_IPV4_SIZE);
+  else
+    node = XCALLOC (MTYPE_ROUTE_NODE, sizeof (struct route_node));
+  node->p.family = family;
   return node;
 }
 
@@ -60,7 +268,7 @@ route_node_set (struct route_table *table, struct prefix *prefix)
 {
   struct route_node *node;
   
-  node = route_node_new ();
+  node = route_node_new (prefix->family);
 
   prefix_copy (&node->p, prefix);
   node->table = table;
@@ -72,7 +280,10 @@ route_node_set (struct route_table *table, struct prefix *prefix)
 static void
 route_node_free (struct route_node *node)
 {
-  XFREE (MTYPE_ROUTE_NODE, node);
+  if (node->p.family == AF_INET)
+    XFREE (MTYPE_ROUTE_NODE_IPV4, node);
+  else
+    XFREE (MTYPE_ROUTE_NODE, node);
 }
 
 /* Free route table. */
@@ -119,6 +330,9 @@ route_table_free (struct route_table *rt)
 	  break;
 	}
     }
+
+  if (rt->lpm)
+    lpm_free (rt->lpm);
  
   XFREE (MTYPE_ROUTE_TABLE, rt);
   return;
@@ -243,6 +457,15 @@ route_node_match (struct route_table *table, struct prefix *p)
   struct route_node *node;
   struct route_node *matched;
 
+  if (table->lpm && table->lpm->family == p->family)
+    {
+      /* Up from the deepest node covering the address instead. */
+      node = lpm_lookup (table->lpm, &p->u.prefix);
+      while (node && (node->p.prefixlen > p->prefixlen || ! node->info))
+	node = node->parent;
+      return node ? route_lock_node (node) : NULL;
+    }
+
   matched = NULL;
   node = table->top;
 
@@ -340,12 +563,12 @@ route_node_get (struct route_table *table, struct prefix *p)
 	set_link (match, new);
       else
 	table->top = new;
+      lpm_add (table, new);
     }
   else
     {
-      new = route_node_new ();
+      new = route_node_new (p->family);
       route_common (&node->p, p, &new->p);
-      new->p.family = p->family;
       new->table = table;
       set_link (new, node);
 
@@ -353,12 +576,14 @@ route_node_get (struct route_table *table, struct prefix *p)
 	set_link (match, new);
       else
 	table->top = new;
+      lpm_add (table, new);
 
       if (new->p.prefixlen != p->prefixlen)
 	{
 	  match = new;
 	  new = route_node_set (table, p);
 	  set_link (match, new);
+	  lpm_add (table, new);
 	}
     }
   route_lock_node (new);
@@ -399,6 +624,9 @@ route_node_delete (struct route_node *node)
   else
     node->table->top = child;
 
+  if (node->table->lpm && node->p.family == node->table->lpm->family)
+    lpm_update (node->table->lpm, node, node, parent);
+
   route_node_free (node);
 
   /* If parent node is stub then delete it also. */
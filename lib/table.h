@@ -23,24 +23,27 @@
 #ifndef _ZEBRA_TABLE_H
 #define _ZEBRA_TABLE_H
 
+struct route_lpm;
+
 /* Routing table top structure. */
 struct route_table
 {
   struct route_node *top;
+
+  /* Index for route_node_match (), if asked for. */
+  struct route_lpm *lpm;
 };
 
-/* Each routing entry. */
+/* Each routing entry.  The prefix comes last and nodes of IPv4
+   prefixes are allocated without the rest of it, so p must not be
+   copied as a whole structure.  What lookups and walks use is kept
+   just before it, to share its cache line.  */
 struct route_node
 {
-  /* Actual prefix of this radix. */
-  struct prefix p;
-
-  /* Tree link. */
   struct route_table *table;
-  struct route_node *parent;
-  struct route_node *link[2];
-#define l_left   link[0]
-#define l_right  link[1]
+
+  /* Aggregation. */
+  void *aggregate;
 
   /* Lock of this radix */
   unsigned int lock;
@@ -48,13 +51,24 @@ struct route_node
   /* Each node of route. */
   void *info;
 
-  /* Aggregation. */
-  void *aggregate;
+  /* Tree link. */
+  struct route_node *parent;
+  struct route_node *link[2];
+#define l_left   link[0]
+#define l_right  link[1]
+
+  /* Actual prefix of this radix. */
+  struct prefix p;
 };
 
+#define ROUTE_NODE_IPV4_SIZE \
+  (offsetof (struct route_node, p) + sizeof (struct prefix_ipv4))
+
 /* Prototypes. */
 extern struct route_table *route_table_init (void);
 extern void route_table_finish (struct route_table *);
+extern void route_table_lpm (struct route_table *, u_char);
+extern unsigned long route_table_lpm_chunks (struct route_table *);
 extern void route_unlock_node (struct route_node *node);
 extern void route_node_delete (struct route_node *node);
 extern struct route_node *route_top (struct route_table *);
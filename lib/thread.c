@@ -29,6 +29,7 @@
 #include "hash.h"
 #include "command.h"
 #include "sigevent.h"
+#include "pqueue.h"
 
 /* Recent absolute time of day */
 struct timeval recent_time;
@@ -40,6 +41,8 @@ static struct timeval relative_time_base;
 static unsigned short timers_inited;
 
 static struct hash *cpu_record = NULL;
+
+static struct thread_timer_stats timer_stats;
 
 /* Struct timeval's tv_usec one second value.  */
 #define TIMER_SECOND_MICRO 1000000L
@@ -312,6 +315,12 @@ cpu_record_print(struct vty *vty, unsigned char filter)
 
   if (tmp.total_calls > 0)
     vty_out_cpu_thread_history(vty, &tmp);
+
+  if (filter & ((1 << THREAD_TIMER) | (1 << THREAD_BACKGROUND)))
+    vty_out(vty, "%sTimer queue: %u pending (max %u), %lu added,"
+            " %lu cancelled, %lu expired%s", VTY_NEWLINE,
+            timer_stats.pending, timer_stats.max_pending, timer_stats.added,
+            timer_stats.cancelled, timer_stats.expired, VTY_NEWLINE);
 }
 
 DEFUN(show_thread_cpu,
@@ -391,29 +400,75 @@ thread_master_debug (struct thread_master *m)
   thread_list_debug (&m->read);
   printf ("writelist : ");
   thread_list_debug (&m->write);
-  printf ("timerlist : ");
-  thread_list_debug (&m->timer);
+  printf ("timerqueue: %d\n", m->timer->size);
   printf ("eventlist : ");
   thread_list_debug (&m->event);
   printf ("unuselist : ");
   thread_list_debug (&m->unuse);
-  printf ("bgndlist : ");
-  thread_list_debug (&m->background);
+  printf ("bgndqueue : %d\n", m->background->size);
   printf ("total alloc: [%ld]\n", m->alloc);
   printf ("-----------\n");
 }
 
+static const struct thread_poller thread_poller_select;
+#ifdef HAVE_EPOLL
+static const struct thread_poller thread_poller_epoll;
+#endif /* HAVE_EPOLL */
+
+/* Timer queue ordering, earliest first. */
+static int
+thread_timer_cmp (void *a, void *b)
+{
+  struct thread *ta = a;
+  struct thread *tb = b;
+  long cmp = timeval_cmp (ta->u.sands, tb->u.sands);
+
+  return (cmp < 0) ? -1 : (cmp > 0);
+}
+
+/* Keep track of a timer's heap position, so it can be cancelled. */
+static void
+thread_timer_update (void *node, int actual_position)
+{
+  struct thread *thread = node;
+
+  thread->index = actual_position;
+}
+
 /* Allocate new thread master.  */
 struct thread_master *
 thread_master_create ()
 {
+  struct thread_master *m;
+
   if (cpu_record == NULL) 
-    cpu_record 
-      = hash_create_size (1011, (unsigned int (*) (void *))cpu_record_hash_key, 
-                          (int (*) (void *, void *))cpu_record_hash_cmp);
+    {
+      cpu_record 
+        = hash_create_size (1011, (unsigned int (*) (void *))cpu_record_hash_key, 
+                            (int (*) (void *, void *))cpu_record_hash_cmp);
+      cpu_record->name = "Thread CPU records";
+    }
     
-  return (struct thread_master *) XCALLOC (MTYPE_THREAD_MASTER,
-					   sizeof (struct thread_master));
+  m = XCALLOC (MTYPE_THREAD_MASTER, sizeof (struct thread_master));
+
+  m->timer = pqueue_create ();
+  m->timer->cmp = thread_timer_cmp;
+  m->timer->update = thread_timer_update;
+  m->background = pqueue_create ();
+  m->background->cmp = thread_timer_cmp;
+  m->background->update = thread_timer_update;
+
+#ifdef HAVE_EPOLL
+  m->poller = &thread_poller_epoll;
+  if (m->poller->init (m) == 0)
+    return m;
+  zlog_warn ("epoll unavailable, falling back to select(): %s",
+             safe_strerror (errno));
+#endif /* HAVE_EPOLL */
+  m->poller = &thread_poller_select;
+  m->poller->init (m);
+
+  return m;
 }
 
 /* Add a new thread to the list.  */
@@ -430,22 +485,6 @@ thread_list_add (struct thread_list *list, struct thread *thread)
   list->count++;
 }
 
-/* Add a new thread just before the point.  */
-static void
-thread_list_add_before (struct thread_list *list, 
-			struct thread *point, 
-			struct thread *thread)
-{
-  thread->next = point;
-  thread->prev = point->prev;
-  if (point->prev)
-    point->prev->next = thread;
-  else
-    list->head = thread;
-  point->prev = thread;
-  list->count++;
-}
-
 /* Delete a thread from the list. */
 static struct thread *
 thread_list_delete (struct thread_list *list, struct thread *thread)
@@ -492,18 +531,38 @@ thread_list_free (struct thread_master *m, struct thread_list *list)
     }
 }
 
+/* Free all threads in a timer queue, and the queue itself. */
+static void
+thread_queue_free (struct thread_master *m, struct pqueue *queue)
+{
+  int i;
+
+  for (i = 0; i < queue->size; i++)
+    {
+      struct thread *t = queue->array[i];
+
+      XFREE (MTYPE_THREAD_FUNCNAME, t->funcname);
+      XFREE (MTYPE_THREAD, t);
+      m->alloc--;
+    }
+  timer_stats.pending -= queue->size;
+  pqueue_delete (queue);
+}
+
 /* Stop thread scheduler. */
 void
 thread_master_free (struct thread_master *m)
 {
   thread_list_free (m, &m->read);
   thread_list_free (m, &m->write);
-  thread_list_free (m, &m->timer);
+  thread_queue_free (m, m->timer);
   thread_list_free (m, &m->event);
   thread_list_free (m, &m->ready);
   thread_list_free (m, &m->unuse);
-  thread_list_free (m, &m->background);
+  thread_queue_free (m, m->background);
   
+  m->poller->finish (m);
+
   XFREE (MTYPE_THREAD_MASTER, m);
 }
 
@@ -523,6 +582,326 @@ thread_trim_head (struct thread_list *list)
   return NULL;
 }
 
+/* select() backend.  Watched descriptors are kept in the master's
+ * fd_sets, ready threads are found by scanning the read/write lists.
+ */
+static int
+thread_select_init (struct thread_master *m)
+{
+  FD_ZERO (&m->readfd);
+  FD_ZERO (&m->writefd);
+  FD_ZERO (&m->exceptfd);
+  return 0;
+}
+
+static void
+thread_select_finish (struct thread_master *m)
+{
+  return;
+}
+
+static int
+thread_select_add (struct thread_master *m, struct thread *thread)
+{
+  fd_set *fdset = (thread->type == THREAD_READ) ? &m->readfd : &m->writefd;
+
+  if (FD_ISSET (THREAD_FD (thread), fdset))
+    return -1;
+  FD_SET (THREAD_FD (thread), fdset);
+  return 0;
+}
+
+static void
+thread_select_del (struct thread_master *m, struct thread *thread)
+{
+  fd_set *fdset = (thread->type == THREAD_READ) ? &m->readfd : &m->writefd;
+
+  assert (FD_ISSET (THREAD_FD (thread), fdset));
+  FD_CLR (THREAD_FD (thread), fdset);
+}
+
+static int
+thread_select_wait (struct thread_master *m, struct timeval *timer_wait)
+{
+  fd_set exceptfd;
+
+  /* Structure copy.  */
+  m->readfd_ready = m->readfd;
+  m->writefd_ready = m->writefd;
+  exceptfd = m->exceptfd;
+
+  return select (FD_SETSIZE, &m->readfd_ready, &m->writefd_ready,
+                 &exceptfd, timer_wait);
+}
+
+static int
+thread_process_fd (struct thread_list *list, fd_set *fdset, fd_set *mfdset)
+{
+  struct thread *thread;
+  struct thread *next;
+  int ready = 0;
+  
+  assert (list);
+  
+  for (thread = list->head; thread; thread = next)
+    {
+      next = thread->next;
+
+      if (FD_ISSET (THREAD_FD (thread), fdset))
+        {
+          assert (FD_ISSET (THREAD_FD (thread), mfdset));
+          FD_CLR(THREAD_FD (thread), mfdset);
+          thread_list_delete (list, thread);
+          thread_list_add (&thread->master->ready, thread);
+          thread->type = THREAD_READY;
+          ready++;
+        }
+    }
+  return ready;
+}
+
+static void
+thread_select_process (struct thread_master *m, int num)
+{
+  /* Normal priority read thead. */
+  thread_process_fd (&m->read, &m->readfd_ready, &m->readfd);
+  /* Write thead. */
+  thread_process_fd (&m->write, &m->writefd_ready, &m->writefd);
+}
+
+static const struct thread_poller thread_poller_select =
+{
+  "select",
+  thread_select_init,
+  thread_select_finish,
+  thread_select_add,
+  thread_select_del,
+  thread_select_wait,
+  thread_select_process,
+};
+
+#ifdef HAVE_EPOLL
+/* epoll() backend, level-triggered.  Read/write threads are indexed by
+ * descriptor, so the cost of a wakeup is proportional to the number of
+ * ready descriptors rather than the number watched.
+ *
+ * Interest is added eagerly but dropped lazily: when a thread runs or is
+ * cancelled the kernel registration is left alone, as most descriptors are
+ * re-armed straight away.  Should an event arrive for a descriptor nobody
+ * wants any more, the registration is trimmed to the current interest.
+ */
+#define THREAD_EPOLL_EVENTS 256
+#define THREAD_EPOLL_FDS    64
+
+static int
+thread_epoll_init (struct thread_master *m)
+{
+  m->epoll_fd = epoll_create (THREAD_EPOLL_EVENTS);
+  if (m->epoll_fd < 0)
+    return -1;
+  m->events = XCALLOC (MTYPE_THREAD_POLL,
+                       THREAD_EPOLL_EVENTS * sizeof (struct epoll_event));
+  m->fd_size = THREAD_EPOLL_FDS;
+  m->fd_read = XCALLOC (MTYPE_THREAD_POLL,
+                        m->fd_size * sizeof (struct thread *));
+  m->fd_write = XCALLOC (MTYPE_THREAD_POLL,
+                         m->fd_size * sizeof (struct thread *));
+  m->fd_events = XCALLOC (MTYPE_THREAD_POLL,
+                          m->fd_size * sizeof (u_int32_t));
+  return 0;
+}
+
+static void
+thread_epoll_finish (struct thread_master *m)
+{
+  close (m->epoll_fd);
+  XFREE (MTYPE_THREAD_POLL, m->fd_read);
+  XFREE (MTYPE_THREAD_POLL, m->fd_write);
+  XFREE (MTYPE_THREAD_POLL, m->fd_events);
+  XFREE (MTYPE_THREAD_POLL, m->events);
+}
+
+/* Make sure the per-fd index can hold fd. */
+static void
+thread_epoll_grow (struct thread_master *m, int fd)
+{
+  int size = m->fd_size;
+
+  if (fd < m->fd_size)
+    return;
+
+  while (size <= fd)
+    size *= 2;
+
+  m->fd_read = XREALLOC (MTYPE_THREAD_POLL, m->fd_read,
+                         size * sizeof (struct thread *));
+  m->fd_write = XREALLOC (MTYPE_THREAD_POLL, m->fd_write,
+                          size * sizeof (struct thread *));
+  m->fd_events = XREALLOC (MTYPE_THREAD_POLL, m->fd_events,
+                           size * sizeof (u_int32_t));
+  memset (m->fd_read + m->fd_size, 0,
+          (size - m->fd_size) * sizeof (struct thread *));
+  memset (m->fd_write + m->fd_size, 0,
+          (size - m->fd_size) * sizeof (struct thread *));
+  memset (m->fd_events + m->fd_size, 0,
+          (size - m->fd_size) * sizeof (u_int32_t));
+  m->fd_size = size;
+}
+
+/* Bring the kernel registration for fd in line with the threads waiting
+ * on it.  A descriptor may have been closed, and its number reused, since
+ * we last registered it, so ENOENT/EEXIST are retried with the other op. */
+static void
+thread_epoll_update (struct thread_master *m, int fd)
+{
+  struct epoll_event ev;
+  u_int32_t events = 0;
+  int ret;
+
+  if (m->fd_read[fd])
+    events |= EPOLLIN;
+  if (m->fd_write[fd])
+    events |= EPOLLOUT;
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = events;
+  ev.data.fd = fd;
+
+  if (!events)
+    {
+      /* Descriptor may well be closed already, errors don't matter. */
+      epoll_ctl (m->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+      m->fd_events[fd] = 0;
+      return;
+    }
+
+  if (m->fd_events[fd])
+    {
+      ret = epoll_ctl (m->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+      if (ret < 0 && errno == ENOENT)
+        ret = epoll_ctl (m->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+  else
+    {
+      ret = epoll_ctl (m->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+      if (ret < 0 && errno == EEXIST)
+        ret = epoll_ctl (m->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+  if (ret < 0)
+    {
+      zlog_warn ("epoll_ctl() error on fd %d: %s", fd, safe_strerror (errno));
+      m->fd_events[fd] = 0;
+      return;
+    }
+  m->fd_events[fd] = events;
+}
+
+static int
+thread_epoll_add (struct thread_master *m, struct thread *thread)
+{
+  int fd = THREAD_FD (thread);
+  struct thread **slot;
+
+  assert (fd >= 0);
+  thread_epoll_grow (m, fd);
+
+  slot = (thread->type == THREAD_READ) ? &m->fd_read[fd] : &m->fd_write[fd];
+  if (*slot)
+    return -1;
+  *slot = thread;
+
+  thread_epoll_update (m, fd);
+  return 0;
+}
+
+static void
+thread_epoll_del (struct thread_master *m, struct thread *thread)
+{
+  int fd = THREAD_FD (thread);
+
+  if (thread->type == THREAD_READ)
+    {
+      assert (m->fd_read[fd] == thread);
+      m->fd_read[fd] = NULL;
+    }
+  else
+    {
+      assert (m->fd_write[fd] == thread);
+      m->fd_write[fd] = NULL;
+    }
+}
+
+static int
+thread_epoll_wait (struct thread_master *m, struct timeval *timer_wait)
+{
+  int timeout = -1;
+
+  /* Round up, so we don't spin on sub-millisecond timers. */
+  if (timer_wait)
+    timeout = timer_wait->tv_sec * 1000 + (timer_wait->tv_usec + 999) / 1000;
+
+  return epoll_wait (m->epoll_fd, m->events, THREAD_EPOLL_EVENTS, timeout);
+}
+
+/* Move the thread waiting on fd in the given slot to the ready list. */
+static void
+thread_epoll_ready (struct thread_master *m, struct thread **slot,
+                    struct thread_list *list)
+{
+  struct thread *thread = *slot;
+
+  *slot = NULL;
+  thread_list_delete (list, thread);
+  thread_list_add (&m->ready, thread);
+  thread->type = THREAD_READY;
+}
+
+static void
+thread_epoll_process (struct thread_master *m, int num)
+{
+  const u_int32_t rmask = EPOLLIN | EPOLLHUP | EPOLLERR;
+  const u_int32_t wmask = EPOLLOUT | EPOLLHUP | EPOLLERR;
+  int i;
+
+  /* Readers first, then writers, as with select(). */
+  for (i = 0; i < num; i++)
+    {
+      int fd = m->events[i].data.fd;
+      int stale;
+
+      /* Registered for a direction nobody is waiting on any more? */
+      stale = ((m->fd_events[fd] & EPOLLIN) && !m->fd_read[fd])
+              || ((m->fd_events[fd] & EPOLLOUT) && !m->fd_write[fd]);
+
+      if ((m->events[i].events & rmask) && m->fd_read[fd])
+        thread_epoll_ready (m, &m->fd_read[fd], &m->read);
+
+      if (stale)
+        thread_epoll_update (m, fd);
+    }
+
+  for (i = 0; i < num; i++)
+    {
+      int fd = m->events[i].data.fd;
+
+      if ((m->events[i].events & wmask) && m->fd_write[fd])
+        thread_epoll_ready (m, &m->fd_write[fd], &m->write);
+    }
+}
+
+static const struct thread_poller thread_poller_epoll =
+{
+  "epoll",
+  thread_epoll_init,
+  thread_epoll_finish,
+  thread_epoll_add,
+  thread_epoll_del,
+  thread_epoll_wait,
+  thread_epoll_process,
+};
+#endif /* HAVE_EPOLL */
+
 /* Return remain time in second. */
 unsigned long
 thread_timer_remain_second (struct thread *thread)
@@ -600,15 +979,17 @@ funcname_thread_add_read (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->readfd))
+  thread = thread_get (m, THREAD_READ, func, arg, funcname);
+  thread->u.fd = fd;
+
+  if (m->poller->add (m, thread) < 0)
     {
       zlog (NULL, LOG_WARNING, "There is already read fd [%d]", fd);
+      thread->type = THREAD_UNUSED;
+      thread_add_unuse (m, thread);
       return NULL;
     }
 
-  thread = thread_get (m, THREAD_READ, func, arg, funcname);
-  FD_SET (fd, &m->readfd);
-  thread->u.fd = fd;
   thread_list_add (&m->read, thread);
 
   return thread;
@@ -623,15 +1004,17 @@ funcname_thread_add_write (struct thread_master *m,
 
   assert (m != NULL);
 
-  if (FD_ISSET (fd, &m->writefd))
+  thread = thread_get (m, THREAD_WRITE, func, arg, funcname);
+  thread->u.fd = fd;
+
+  if (m->poller->add (m, thread) < 0)
     {
       zlog (NULL, LOG_WARNING, "There is already write fd [%d]", fd);
+      thread->type = THREAD_UNUSED;
+      thread_add_unuse (m, thread);
       return NULL;
     }
 
-  thread = thread_get (m, THREAD_WRITE, func, arg, funcname);
-  FD_SET (fd, &m->writefd);
-  thread->u.fd = fd;
   thread_list_add (&m->write, thread);
 
   return thread;
@@ -646,16 +1029,15 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
                                   const char* funcname)
 {
   struct thread *thread;
-  struct thread_list *list;
+  struct pqueue *queue;
   struct timeval alarm_time;
-  struct thread *tt;
 
   assert (m != NULL);
 
   assert (type == THREAD_TIMER || type == THREAD_BACKGROUND);
   assert (time_relative);
   
-  list = ((type == THREAD_TIMER) ? &m->timer : &m->background);
+  queue = ((type == THREAD_TIMER) ? m->timer : m->background);
   thread = thread_get (m, type, func, arg, funcname);
 
   /* Do we need jitter here? */
@@ -664,15 +1046,12 @@ funcname_thread_add_timer_timeval (struct thread_master *m,
   alarm_time.tv_usec = relative_time.tv_usec + time_relative->tv_usec;
   thread->u.sands = timeval_adjust(alarm_time);
 
-  /* Sort by timeval. */
-  for (tt = list->head; tt; tt = tt->next)
-    if (timeval_cmp (thread->u.sands, tt->u.sands) <= 0)
-      break;
+  /* Heap is ordered by timeval. */
+  pqueue_enqueue (thread, queue);
 
-  if (tt)
-    thread_list_add_before (list, tt, thread);
-  else
-    thread_list_add (list, thread);
+  timer_stats.added++;
+  if (++timer_stats.pending > timer_stats.max_pending)
+    timer_stats.max_pending = timer_stats.pending;
 
   return thread;
 }
@@ -758,22 +1137,21 @@ funcname_thread_add_event (struct thread_master *m,
 void
 thread_cancel (struct thread *thread)
 {
-  struct thread_list *list;
+  struct thread_list *list = NULL;
+  struct pqueue *queue = NULL;
   
   switch (thread->type)
     {
     case THREAD_READ:
-      assert (FD_ISSET (thread->u.fd, &thread->master->readfd));
-      FD_CLR (thread->u.fd, &thread->master->readfd);
+      thread->master->poller->del (thread->master, thread);
       list = &thread->master->read;
       break;
     case THREAD_WRITE:
-      assert (FD_ISSET (thread->u.fd, &thread->master->writefd));
-      FD_CLR (thread->u.fd, &thread->master->writefd);
+      thread->master->poller->del (thread->master, thread);
       list = &thread->master->write;
       break;
     case THREAD_TIMER:
-      list = &thread->master->timer;
+      queue = thread->master->timer;
       break;
     case THREAD_EVENT:
       list = &thread->master->event;
@@ -782,13 +1160,23 @@ thread_cancel (struct thread *thread)
       list = &thread->master->ready;
       break;
     case THREAD_BACKGROUND:
-      list = &thread->master->background;
+      queue = thread->master->background;
       break;
     default:
       return;
       break;
     }
-  thread_list_delete (list, thread);
+
+  if (thread->type == THREAD_TIMER || thread->type == THREAD_BACKGROUND)
+    {
+      assert (queue->array[thread->index] == thread);
+      pqueue_remove_at (thread->index, queue);
+      timer_stats.pending--;
+      timer_stats.cancelled++;
+    }
+  else
+    thread_list_delete (list, thread);
+
   thread->type = THREAD_UNUSED;
   thread_add_unuse (thread->master, thread);
 }
@@ -820,11 +1208,12 @@ thread_cancel_event (struct thread_master *m, void *arg)
 }
 
 static struct timeval *
-thread_timer_wait (struct thread_list *tlist, struct timeval *timer_val)
+thread_timer_wait (struct pqueue *queue, struct timeval *timer_val)
 {
-  if (!thread_empty (tlist))
+  if (queue->size)
     {
-      *timer_val = timeval_subtract (tlist->head->u.sands, relative_time);
+      struct thread *next_timer = queue->array[0];
+      *timer_val = timeval_subtract (next_timer->u.sands, relative_time);
       return timer_val;
     }
   return NULL;
@@ -840,48 +1229,25 @@ thread_run (struct thread_master *m, struct thread *thread,
   return fetch;
 }
 
-static int
-thread_process_fd (struct thread_list *list, fd_set *fdset, fd_set *mfdset)
-{
-  struct thread *thread;
-  struct thread *next;
-  int ready = 0;
-  
-  assert (list);
-  
-  for (thread = list->head; thread; thread = next)
-    {
-      next = thread->next;
-
-      if (FD_ISSET (THREAD_FD (thread), fdset))
-        {
-          assert (FD_ISSET (THREAD_FD (thread), mfdset));
-          FD_CLR(THREAD_FD (thread), mfdset);
-          thread_list_delete (list, thread);
-          thread_list_add (&thread->master->ready, thread);
-          thread->type = THREAD_READY;
-          ready++;
-        }
-    }
-  return ready;
-}
-
 /* Add all timers that have popped to the ready list. */
 static unsigned int
-thread_timer_process (struct thread_list *list, struct timeval *timenow)
+thread_timer_process (struct pqueue *queue, struct timeval *timenow)
 {
   struct thread *thread;
   unsigned int ready = 0;
   
-  for (thread = list->head; thread; thread = thread->next)
+  while (queue->size)
     {
+      thread = queue->array[0];
       if (timeval_cmp (*timenow, thread->u.sands) < 0)
-        return ready;
-      thread_list_delete (list, thread);
+        break;
+      pqueue_dequeue (queue);
       thread->type = THREAD_READY;
       thread_list_add (&thread->master->ready, thread);
       ready++;
     }
+  timer_stats.pending -= ready;
+  timer_stats.expired += ready;
   return ready;
 }
 
@@ -890,9 +1256,6 @@ struct thread *
 thread_fetch (struct thread_master *m, struct thread *fetch)
 {
   struct thread *thread;
-  fd_set readfd;
-  fd_set writefd;
-  fd_set exceptfd;
   struct timeval timer_val;
   struct timeval timer_val_bg;
   struct timeval *timer_wait;
@@ -915,28 +1278,24 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
       if ((thread = thread_trim_head (&m->ready)) != NULL)
         return thread_run (m, thread, fetch);
       
-      /* Structure copy.  */
-      readfd = m->readfd;
-      writefd = m->writefd;
-      exceptfd = m->exceptfd;
-      
       /* Calculate select wait timer if nothing else to do */
       quagga_get_relative (NULL);
-      timer_wait = thread_timer_wait (&m->timer, &timer_val);
-      timer_wait_bg = thread_timer_wait (&m->background, &timer_val_bg);
+      timer_wait = thread_timer_wait (m->timer, &timer_val);
+      timer_wait_bg = thread_timer_wait (m->background, &timer_val_bg);
       
       if (timer_wait_bg &&
 	  (!timer_wait || (timeval_cmp (*timer_wait, *timer_wait_bg) > 0)))
 	timer_wait = timer_wait_bg;
       
-      num = select (FD_SETSIZE, &readfd, &writefd, &exceptfd, timer_wait);
+      num = m->poller->wait (m, timer_wait);
       
       /* Signals should get quick treatment */
       if (num < 0)
         {
           if (errno == EINTR)
             continue; /* signal received - process it */
-          zlog_warn ("select() error: %s", safe_strerror (errno));
+          zlog_warn ("%s() error: %s", m->poller->name,
+                     safe_strerror (errno));
             return NULL;
         }
 
@@ -944,16 +1303,11 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
          priority than I/O threads, so let's push them onto the ready
 	 list in front of the I/O threads. */
       quagga_get_relative (NULL);
-      thread_timer_process (&m->timer, &relative_time);
+      thread_timer_process (m->timer, &relative_time);
       
       /* Got IO, process it */
       if (num > 0)
-        {
-          /* Normal priority read thead. */
-          thread_process_fd (&m->read, &readfd, &m->readfd);
-          /* Write thead. */
-          thread_process_fd (&m->write, &writefd, &m->writefd);
-        }
+        m->poller->process (m, num);
 
 #if 0
       /* If any threads were made ready above (I/O or foreground timer),
@@ -965,7 +1319,7 @@ thread_fetch (struct thread_master *m, struct thread *fetch)
 #endif
 
       /* Background timer/events, lowest priority */
-      thread_timer_process (&m->background, &relative_time);
+      thread_timer_process (m->background, &relative_time);
       
       if ((thread = thread_trim_head (&m->ready)) != NULL)
         return thread_run (m, thread, fetch);
@@ -41,20 +41,58 @@ struct thread_list
   int count;
 };
 
+struct thread_master;
+
+/* I/O readiness backend used by thread_fetch().  select() is always
+ * available, epoll() is used instead on Linux when present.
+ */
+struct thread_poller
+{
+  const char *name;
+  /* Set up backend state, return -1 if backend can not be used. */
+  int (*init) (struct thread_master *);
+  void (*finish) (struct thread_master *);
+  /* Start watching thread's fd, return -1 if the fd is already watched
+   * for the thread's type. */
+  int (*add) (struct thread_master *, struct thread *);
+  /* Stop watching thread's fd. */
+  void (*del) (struct thread_master *, struct thread *);
+  /* Wait for I/O readiness, or until timer_wait expires.  Returns the
+   * value of the underlying system call. */
+  int (*wait) (struct thread_master *, struct timeval *timer_wait);
+  /* Move threads made ready by the last wait onto the ready list. */
+  void (*process) (struct thread_master *, int num);
+};
+
 /* Master of the theads. */
 struct thread_master
 {
   struct thread_list read;
   struct thread_list write;
-  struct thread_list timer;
+  struct pqueue *timer;
   struct thread_list event;
   struct thread_list ready;
   struct thread_list unuse;
-  struct thread_list background;
+  struct pqueue *background;
   fd_set readfd;
   fd_set writefd;
   fd_set exceptfd;
   unsigned long alloc;
+
+  const struct thread_poller *poller;
+  /* Result sets of the last select(). */
+  fd_set readfd_ready;
+  fd_set writefd_ready;
+#ifdef HAVE_EPOLL
+  int epoll_fd;
+  /* Per-fd read/write threads and the events registered with the kernel,
+   * indexed by file descriptor. */
+  struct thread **fd_read;
+  struct thread **fd_write;
+  u_int32_t *fd_events;
+  int fd_size;
+  struct epoll_event *events;
+#endif /* HAVE_EPOLL */
 };
 
 /* Thread itself. */
@@ -72,6 +110,7 @@ struct thread
     int fd;			/* file descriptor in case of read/write. */
     struct timeval sands;	/* rest of time sands value. */
   } u;
+  int index;			/* position in timer queue heap */
   RUSAGE_T ru;			/* Indepth usage info.  */
   struct cpu_thread_history *hist; /* cache pointer to cpu_history */
   char* funcname;
@@ -92,6 +131,16 @@ struct cpu_thread_history
   unsigned char types;
 };
 
+/* Timer queue counters, across all thread masters. */
+struct thread_timer_stats
+{
+  unsigned long added;
+  unsigned long cancelled;
+  unsigned long expired;
+  unsigned int pending;
+  unsigned int max_pending;
+};
+
 /* Clocks supported by Quagga */
 enum quagga_clkid {
   QUAGGA_CLK_REALTIME = 0,	/* ala gettimeofday() */
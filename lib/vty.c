@@ -147,6 +147,59 @@ vty_out (struct vty *vty, const char *format, ...)
   return len;
 }
 
+/* More output is made once less than this is waiting to be written. */
+#define VTY_OUTPUT_LOW 16384
+
+/* Finish with output being made by vty_output_more. */
+static void
+vty_output_stop (struct vty *vty)
+{
+  if (! vty->output_func)
+    return;
+
+  if (vty->output_clean)
+    (*vty->output_clean) (vty);
+  vty->output_func = NULL;
+  vty->output_clean = NULL;
+  vty->output_arg = NULL;
+}
+
+/* Make some more output.  Returns 1 if that was the last of it. */
+static int
+vty_output_continue (struct vty *vty)
+{
+  if ((*vty->output_func) (vty))
+    return 0;
+
+  vty_output_stop (vty);
+  return 1;
+}
+
+/* Everything a command outputs is buffered until written, so a command
+   with a lot to say may instead output it in parts: FUNC is called,
+   with ARG in vty->output_arg, each time most of what was output so far
+   has been written and returns 0 once there is no more, then CLEAN is
+   called.  CLEAN is also called if the vty is closed or the user quits
+   first.  Nothing else is read from the vty meanwhile.  The command
+   should return CMD_SUCCESS after calling this.  Vtys which are not
+   sockets get all the output at once.  */
+void
+vty_output_more (struct vty *vty, int (*func) (struct vty *),
+		 void (*clean) (struct vty *), void *arg)
+{
+  vty_output_stop (vty);
+
+  vty->output_func = func;
+  vty->output_clean = clean;
+  vty->output_arg = arg;
+
+  if (vty->type == VTY_TERM || vty->type == VTY_SHELL_SERV)
+    return;
+
+  while (! vty_output_continue (vty))
+    ;
+}
+
 static int
 vty_log_out (struct vty *vty, const char *level, const char *proto_str,
 	     const char *format, struct timestamp_control *ctl, va_list va)
@@ -1282,7 +1335,8 @@ vty_execute (struct vty *vty)
   vty->cp = vty->length = 0;
   vty_clear_buf (vty);
 
-  if (vty->status != VTY_CLOSE )
+  /* The prompt follows the last of the output. */
+  if (vty->status != VTY_CLOSE && ! vty->output_func)
     vty_prompt (vty);
 
   return ret;
@@ -1323,6 +1377,7 @@ vty_escape_map (unsigned char c, struct vty *vty)
 static void
 vty_buffer_reset (struct vty *vty)
 {
+  vty_output_stop (vty);
   buffer_reset (vty->obuf);
   vty_prompt (vty);
   vty_redraw_line (vty);
@@ -1392,7 +1447,7 @@ vty_read (struct thread *thread)
 	}
 	        
 
-      if (vty->status == VTY_MORE)
+      if (vty->status == VTY_MORE || vty->output_func)
 	{
 	  switch (buf[i])
 	    {
@@ -1549,6 +1604,11 @@ vty_flush (struct thread *thread)
 
   vty->t_write = NULL;
 
+  /* Make more of a command's output once most of it has been written. */
+  if (vty->output_func && buffer_pending (vty->obuf) < VTY_OUTPUT_LOW)
+    if (vty_output_continue (vty) && vty->status != VTY_CLOSE)
+      vty_prompt (vty);
+
   /* Tempolary disable read thread. */
   if ((vty->lines == 0) && vty->t_read)
     {
@@ -1582,6 +1642,8 @@ vty_flush (struct thread *thread)
     case BUFFER_EMPTY:
       if (vty->status == VTY_CLOSE)
 	vty_close (vty);
+      else if (vty->output_func)
+	vty_event (VTY_WRITE, vty_sock, vty);
       else
 	{
 	  vty->status = VTY_NORMAL;
@@ -2084,6 +2146,14 @@ vtysh_read (struct thread *thread)
 	  /* Note that vty_execute clears the command buffer and resets
 	     vty->length to 0. */
 
+	  /* vtysh_write sends the rest of the output and the result.
+	     vtysh waits for that before sending another command.  */
+	  if (vty->output_func)
+	    {
+	      vty_event (VTYSH_WRITE, sock, vty);
+	      return 0;
+	    }
+
 	  /* Return result. */
 #ifdef VTYSH_DEBUG
 	  printf ("result: %d\n", ret);
@@ -2108,9 +2178,22 @@ static int
 vtysh_write (struct thread *thread)
 {
   struct vty *vty = THREAD_ARG (thread);
+  u_char header[4] = {0, 0, 0, CMD_SUCCESS};
+  int done = 0;
 
   vty->t_write = NULL;
-  vtysh_flush(vty);
+
+  if (vty->output_func && buffer_pending (vty->obuf) < VTY_OUTPUT_LOW)
+    if ((done = vty_output_continue (vty)))
+      buffer_put (vty->obuf, header, 4);
+
+  if (vtysh_flush (vty) < 0)
+    return 0;
+
+  if (vty->output_func && ! vty->t_write)
+    vty_event (VTYSH_WRITE, vty->fd, vty);
+  else if (done)
+    vty_event (VTYSH_READ, vty->fd, vty);
   return 0;
 }
 
@@ -2150,6 +2233,8 @@ vty_close (struct vty *vty)
 {
   int i;
 
+  vty_output_stop (vty);
+
   /* Cancel threads.*/
   if (vty->t_read)
     thread_cancel (vty->t_read);
@@ -118,6 +118,11 @@ struct vty
   /* Timeout seconds and thread. */
   unsigned long v_timeout;
   struct thread *t_timeout;
+
+  /* Output the last command is still to make, see vty_output_more. */
+  int (*output_func) (struct vty *);
+  void (*output_clean) (struct vty *);
+  void *output_arg;
 };
 
 /* Integrated configuration file. */
@@ -206,6 +211,8 @@ extern void vty_init_vtysh (void);
 extern void vty_reset (void);
 extern struct vty *vty_new (void);
 extern int vty_out (struct vty *, const char *, ...) PRINTF_ATTRIBUTE(2, 3);
+extern void vty_output_more (struct vty *, int (*) (struct vty *),
+			     void (*) (struct vty *), void *);
 extern void vty_read_config (char *, char *);
 extern void vty_time_print (struct vty *, int);
 extern void vty_serv_sock (const char *, unsigned short, const char *);
@@ -32,6 +32,7 @@
 #include "zclient.h"
 #include "memory.h"
 #include "table.h"
+#include "linklist.h"
 
 /* Zebra client events. */
 enum event {ZCLIENT_SCHEDULE, ZCLIENT_READ, ZCLIENT_CONNECT};
@@ -43,6 +44,51 @@ extern struct thread_master *master;
 
 /* This file local debug flag. */
 int zclient_debug = 0;
+
+/* All zclients, for zclient_exit_flush. */
+static struct list *zclient_list;
+
+/* Longest the daemon waits on exit for zebra to take what is left. */
+#define ZCLIENT_EXIT_TIMEOUT 5
+
+/* Routes withdrawn on the way out wait in the bulk message for an event
+   which never runs once the daemon exits, and zebra keeps the routes of
+   a client which goes.  Write out all that is waiting for zebra, the
+   socket blocking for a while if it must. */
+static void
+zclient_exit_flush (void)
+{
+  struct listnode *node;
+  struct zclient *zclient;
+  struct timeval tv;
+  int flags;
+
+  for (ALL_LIST_ELEMENTS_RO (zclient_list, node, zclient))
+    {
+      if (zclient->sock < 0)
+	continue;
+
+      if (stream_get_endp (zclient->bulk))
+	{
+	  buffer_put (zclient->wb, STREAM_DATA (zclient->bulk),
+		      stream_get_endp (zclient->bulk));
+	  stream_reset (zclient->bulk);
+	  zclient->bulk_count_pos = 0;
+	}
+      if (buffer_empty (zclient->wb))
+	continue;
+
+      tv.tv_sec = ZCLIENT_EXIT_TIMEOUT;
+      tv.tv_usec = 0;
+      setsockopt (zclient->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof (tv));
+      if ((flags = fcntl (zclient->sock, F_GETFL)) >= 0)
+	fcntl (zclient->sock, F_SETFL, flags & ~O_NONBLOCK);
+
+      if (buffer_flush_all (zclient->wb, zclient->sock) != BUFFER_EMPTY)
+	zlog_warn ("%s: zclient fd %d: messages left unsent on exit",
+		   __func__, zclient->sock);
+    }
+}
 
 /* Allocate zclient structure. */
 struct zclient *
@@ -54,8 +100,16 @@ zclient_new ()
 
   zclient->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  zclient->bulk = stream_new (ZEBRA_MAX_PACKET_SIZ);
   zclient->wb = buffer_new(0);
 
+  if (! zclient_list)
+    {
+      zclient_list = list_new ();
+      atexit (zclient_exit_flush);
+    }
+  listnode_add (zclient_list, zclient);
+
   return zclient;
 }
 
@@ -73,6 +127,8 @@ zclient_free (struct zclient *zclient)
     stream_free(zclient->ibuf);
   if (zclient->obuf)
     stream_free(zclient->obuf);
+  if (zclient->bulk)
+    stream_free(zclient->bulk);
   if (zclient->wb)
     buffer_free(zclient->wb);
 
@@ -123,10 +179,19 @@ zclient_stop (struct zclient *zclient)
   THREAD_OFF(zclient->t_read);
   THREAD_OFF(zclient->t_connect);
   THREAD_OFF(zclient->t_write);
+  THREAD_OFF(zclient->t_bulk);
+
+  /* Routes sent just before, as when withdrawing them all, go out if
+     they can. */
+  if (zclient->sock >= 0 && stream_get_endp (zclient->bulk))
+    buffer_write (zclient->wb, zclient->sock, STREAM_DATA (zclient->bulk),
+		  stream_get_endp (zclient->bulk));
 
   /* Reset streams. */
   stream_reset(zclient->ibuf);
   stream_reset(zclient->obuf);
+  stream_reset(zclient->bulk);
+  zclient->bulk_count_pos = 0;
 
   /* Empty the write buffer. */
   buffer_reset(zclient->wb);
@@ -246,13 +311,13 @@ zclient_flush_data(struct thread *thread)
   return 0;
 }
 
-int
-zclient_send_message(struct zclient *zclient)
+static int
+zclient_write (struct zclient *zclient, struct stream *s)
 {
   if (zclient->sock < 0)
     return -1;
-  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(zclient->obuf),
-		       stream_get_endp(zclient->obuf)))
+  switch (buffer_write(zclient->wb, zclient->sock, STREAM_DATA(s),
+		       stream_get_endp(s)))
     {
     case BUFFER_ERROR:
       zlog_warn("%s: buffer_write failed to zclient fd %d, closing",
@@ -270,6 +335,40 @@ zclient_send_message(struct zclient *zclient)
   return 0;
 }
 
+/* Send the bulk message of routes now, if there is one, rather than
+   once this pass through the event loop is over. */
+int
+zclient_bulk_flush (struct zclient *zclient)
+{
+  int ret;
+
+  if (stream_get_endp (zclient->bulk) == 0)
+    return 0;
+
+  ret = zclient_write (zclient, zclient->bulk);
+  stream_reset (zclient->bulk);
+  zclient->bulk_count_pos = 0;
+  return ret;
+}
+
+static int
+zclient_bulk_send (struct thread *thread)
+{
+  struct zclient *zclient = THREAD_ARG (thread);
+
+  zclient->t_bulk = NULL;
+  return zclient_bulk_flush (zclient);
+}
+
+int
+zclient_send_message(struct zclient *zclient)
+{
+  /* Routes sent before this go first. */
+  if (zclient_bulk_flush (zclient) < 0)
+    return -1;
+  return zclient_write (zclient, zclient->obuf);
+}
+
 void
 zclient_create_header (struct stream *s, uint16_t command)
 {
@@ -358,6 +457,9 @@ zclient_start (struct zclient *zclient)
   if (zclient->default_information)
     zebra_message_send (zclient, ZEBRA_REDISTRIBUTE_DEFAULT_ADD);
 
+  if (zclient->zebra_connected)
+    (*zclient->zebra_connected) (zclient);
+
   return 0;
 }
 
@@ -377,6 +479,71 @@ zclient_connect (struct thread *t)
   return zclient_start (zclient);
 }
 
+/*
+ * Routes are put together into bulk messages, sent from an event once
+ * this pass through the event loop is over, or before any other message
+ * to zebra.  A bulk message carries groups of prefixes which share the
+ * route type, flags, nexthops, distance and metric.  Each group is
+ *
+ *     Route Type (1), ZEBRA Flags (1), Message Flags (1),
+ *     nexthops, distance and metric as in ZEBRA_IPV4_ROUTE_ADD,
+ *     Prefix count (2),
+ *
+ * followed by that many prefixes, each as its length in one byte then
+ * as many bytes of the prefix as the length needs.  A route goes into
+ * the last group if it shares all of that, and starts a new one if not,
+ * so routes stay in the order they were sent.
+ *
+ * The route's type, flags, nexthops, distance and metric are in
+ * zclient->obuf.
+ */
+static int
+zclient_route_bulk (struct zclient *zclient, uint16_t command,
+		    struct prefix *p)
+{
+  struct stream *b = zclient->bulk;
+  struct stream *s = zclient->obuf;
+  size_t attr = stream_get_endp (s);
+  size_t psize = PSIZE (p->prefixlen);
+
+  if (zclient->sock < 0)
+    return -1;
+
+  if (stream_get_endp (b)
+      && (zclient->bulk_command != command
+	  || STREAM_WRITEABLE (b) < attr + 2 + 1 + psize))
+    if (zclient_bulk_flush (zclient) < 0)
+      return -1;
+
+  if (stream_get_endp (b) == 0)
+    {
+      zclient_create_header (b, command);
+      zclient->bulk_command = command;
+      zclient->bulk_count_pos = 0;
+    }
+
+  if (! zclient->bulk_count_pos
+      || zclient->bulk_count_pos - zclient->bulk_group != attr
+      || memcmp (STREAM_DATA (b) + zclient->bulk_group, STREAM_DATA (s),
+		 attr) != 0)
+    {
+      zclient->bulk_group = stream_get_endp (b);
+      stream_put (b, STREAM_DATA (s), attr);
+      zclient->bulk_count_pos = stream_get_endp (b);
+      zclient->bulk_prefixes = 0;
+      stream_putw (b, 0);
+    }
+
+  stream_putc (b, p->prefixlen);
+  stream_put (b, &p->u.prefix, psize);
+  stream_putw_at (b, zclient->bulk_count_pos, ++zclient->bulk_prefixes);
+  stream_putw_at (b, 0, stream_get_endp (b));
+
+  if (! zclient->t_bulk)
+    zclient->t_bulk = thread_add_event (master, zclient_bulk_send, zclient, 0);
+  return 0;
+}
+
  /* 
   * "xdr_encode"-like interface that allows daemon (client) to send
   * a message to zebra server for a route that needs to be
@@ -420,31 +587,27 @@ zclient_connect (struct thread *t)
   * byte value.
   *
   * XXX: No attention paid to alignment.
+  *
+  * The route is not sent at once, but with the others sent in the same
+  * pass through the event loop, in ZEBRA_IPV4_ROUTE_ADD_BULK or
+  * ZEBRA_IPV4_ROUTE_DELETE_BULK messages, see zclient_route_bulk.
   */ 
 int
 zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
                  struct zapi_ipv4 *api)
 {
   int i;
-  int psize;
   struct stream *s;
 
   /* Reset stream. */
   s = zclient->obuf;
   stream_reset (s);
   
-  zclient_create_header (s, cmd);
-  
   /* Put type and nexthop. */
   stream_putc (s, api->type);
   stream_putc (s, api->flags);
   stream_putc (s, api->message);
 
-  /* Put prefix information. */
-  psize = PSIZE (p->prefixlen);
-  stream_putc (s, p->prefixlen);
-  stream_write (s, (u_char *) & p->prefix, psize);
-
   /* Nexthop, ifindex, distance and metric information. */
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
@@ -475,10 +638,9 @@ zapi_ipv4_route (u_char cmd, struct zclient *zclient, struct prefix_ipv4 *p,
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
 
-  /* Put length at the first point of the stream. */
-  stream_putw_at (s, 0, stream_get_endp (s));
-
-  return zclient_send_message(zclient);
+  return zclient_route_bulk (zclient, cmd == ZEBRA_IPV4_ROUTE_DELETE
+			     ? ZEBRA_IPV4_ROUTE_DELETE_BULK
+			     : ZEBRA_IPV4_ROUTE_ADD_BULK, (struct prefix *) p);
 }
 
 #ifdef HAVE_IPV6
@@ -487,25 +649,17 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
 	       struct zapi_ipv6 *api)
 {
   int i;
-  int psize;
   struct stream *s;
 
   /* Reset stream. */
   s = zclient->obuf;
   stream_reset (s);
 
-  zclient_create_header (s, cmd);
-
   /* Put type and nexthop. */
   stream_putc (s, api->type);
   stream_putc (s, api->flags);
   stream_putc (s, api->message);
   
-  /* Put prefix information. */
-  psize = PSIZE (p->prefixlen);
-  stream_putc (s, p->prefixlen);
-  stream_write (s, (u_char *)&p->prefix, psize);
-
   /* Nexthop, ifindex, distance and metric information. */
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
@@ -528,10 +682,9 @@ zapi_ipv6_route (u_char cmd, struct zclient *zclient, struct prefix_ipv6 *p,
   if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
     stream_putl (s, api->metric);
 
-  /* Put length at the first point of the stream. */
-  stream_putw_at (s, 0, stream_get_endp (s));
-
-  return zclient_send_message(zclient);
+  return zclient_route_bulk (zclient, cmd == ZEBRA_IPV6_ROUTE_DELETE
+			     ? ZEBRA_IPV6_ROUTE_DELETE_BULK
+			     : ZEBRA_IPV6_ROUTE_ADD_BULK, (struct prefix *) p);
 }
 #endif /* HAVE_IPV6 */
 
@@ -557,6 +710,35 @@ zebra_redistribute_send (int command, struct zclient *zclient, int type)
   return zclient_send_message(zclient);
 }
 
+/*
+ * Register (ZEBRA_NEXTHOP_REGISTER) or unregister (ZEBRA_NEXTHOP_UNREGISTER)
+ * an address with zebra, which then sends ZEBRA_NEXTHOP_UPDATE with how
+ * the address resolves, straight away and again each time that changes.
+ * Both the request and the update start with the address, as
+ *
+ *     family (1 byte), address (4 or 16 bytes)
+ *
+ * and the update goes on with the metric and nexthops in the same form
+ * as the reply to ZEBRA_IPV4_NEXTHOP_LOOKUP or ZEBRA_IPV6_NEXTHOP_LOOKUP.
+ */
+int
+zebra_nexthop_register_send (int command, struct zclient *zclient,
+                             struct prefix *p)
+{
+  struct stream *s;
+
+  s = zclient->obuf;
+  stream_reset (s);
+
+  zclient_create_header (s, command);
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
+
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zclient_send_message(zclient);
+}
+
 /* Router-id update from zebra daemon. */
 void
 zebra_router_id_update_read (struct stream *s, struct prefix *rid)
@@ -937,6 +1119,10 @@ zclient_read (struct thread *thread)
       if (zclient->ipv6_route_delete)
 	ret = (*zclient->ipv6_route_delete) (command, zclient, length);
       break;
+    case ZEBRA_NEXTHOP_UPDATE:
+      if (zclient->nexthop_update)
+	ret = (*zclient->nexthop_update) (command, zclient, length);
+      break;
     default:
       break;
     }
@@ -60,6 +60,18 @@ struct zclient
   /* Thread to write buffered data to zebra. */
   struct thread *t_write;
 
+  /* Routes sent in this pass through the event loop, put together
+     into a bulk message, see zclient_route_bulk.  bulk_group and
+     bulk_count_pos are offsets in bulk, of the current group's
+     attributes and of its prefix count word; bulk_prefixes is the
+     count itself. */
+  struct stream *bulk;
+  uint16_t bulk_command;
+  size_t bulk_group;
+  size_t bulk_count_pos;
+  uint16_t bulk_prefixes;
+  struct thread *t_bulk;
+
   /* Redistribute information. */
   u_char redist_default;
   u_char redist[ZEBRA_ROUTE_MAX];
@@ -79,6 +91,10 @@ struct zclient
   int (*ipv4_route_delete) (int, struct zclient *, uint16_t);
   int (*ipv6_route_add) (int, struct zclient *, uint16_t);
   int (*ipv6_route_delete) (int, struct zclient *, uint16_t);
+  int (*nexthop_update) (int, struct zclient *, uint16_t);
+
+  /* Called once connected, to send zebra what it needs to know. */
+  void (*zebra_connected) (struct zclient *);
 };
 
 /* Zebra API message flag. */
@@ -135,16 +151,27 @@ extern int zclient_socket_un (const char *);
 /* Send redistribute command to zebra daemon. Do not update zclient state. */
 extern int zebra_redistribute_send (int command, struct zclient *, int type);
 
+/* Ask zebra to send ZEBRA_NEXTHOP_UPDATE whenever the resolution of an
+   address changes, or to stop. */
+extern int zebra_nexthop_register_send (int command, struct zclient *,
+                                        struct prefix *);
+
 /* If state has changed, update state and call zebra_redistribute_send. */
 extern void zclient_redistribute (int command, struct zclient *, int type);
 
 /* If state has changed, update state and send the command to zebra. */
 extern void zclient_redistribute_default (int command, struct zclient *);
 
-/* Send the message in zclient->obuf to the zebra daemon (or enqueue it).
+/* Send the message in zclient->obuf to the zebra daemon (or enqueue it),
+   after any routes waiting to go in a bulk message.
    Returns 0 for success or -1 on an I/O error. */
 extern int zclient_send_message(struct zclient *);
 
+/* Send the routes waiting to go in a bulk message now.  What is left
+   on exit is written out anyway, see zclient_exit_flush.  Returns 0
+   for success or -1 on an I/O error. */
+extern int zclient_bulk_flush (struct zclient *);
+
 /* create header for command, length to be filled in by user later */
 extern void zclient_create_header (struct stream *, uint16_t);
 
@@ -54,6 +54,9 @@ typedef int socklen_t;
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif /* HAVE_SYS_SELECT_H */
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif /* HAVE_EPOLL */
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -413,7 +416,14 @@ struct in_pktinfo
 #define ZEBRA_ROUTER_ID_ADD               20
 #define ZEBRA_ROUTER_ID_DELETE            21
 #define ZEBRA_ROUTER_ID_UPDATE            22
-#define ZEBRA_MESSAGE_MAX                 23
+#define ZEBRA_NEXTHOP_REGISTER            23
+#define ZEBRA_NEXTHOP_UNREGISTER          24
+#define ZEBRA_NEXTHOP_UPDATE              25
+#define ZEBRA_IPV4_ROUTE_ADD_BULK         26
+#define ZEBRA_IPV4_ROUTE_DELETE_BULK      27
+#define ZEBRA_IPV6_ROUTE_ADD_BULK         28
+#define ZEBRA_IPV6_ROUTE_DELETE_BULK      29
+#define ZEBRA_MESSAGE_MAX                 30
 
 /* Marker value used in new Zserv, in the byte location corresponding
  * the command value in the old zserv header. To allow old and new
@@ -293,7 +293,11 @@ ospf_deferred_shutdown_finish (struct ospf *ospf)
   /* ospfd being shut-down? If so, was this the last ospf instance? */
   if (CHECK_FLAG (om->options, OSPF_MASTER_SHUTDOWN)
       && (listcount (om->ospf) == 0))
-    exit (0);
+    {
+      /* Routes withdrawn by ospf_finish_final are still to go out. */
+      zclient_bulk_flush (zclient);
+      exit (0);
+    }
 
   return;
 }
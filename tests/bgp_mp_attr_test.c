@@ -436,7 +436,7 @@ parse_test (struct peer *peer, struct test_segment *t, int type)
 {
   int ret;
   int oldfailed = failed;
-  struct attr attr;
+  struct attr attr = { 0 };
   struct bgp_nlri nlri;
 #define RANDOM_FUZZ 35
   
@@ -0,0 +1,391 @@
+/*
+ * Access-list matching test and benchmark.
+ *
+ * Builds access-lists through the CLI, then checks access_list_apply
+ * against a straightforward first-match walk over the same rules, and
+ * times lookups against lists of increasing size.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "command.h"
+#include "vty.h"
+#include "vector.h"
+#include "prefix.h"
+#include "filter.h"
+#include "thread.h"
+#include "memory.h"
+
+struct thread_master *master;
+
+static struct vty *vty;
+
+enum rule_kind { RULE_STANDARD, RULE_EXTENDED, RULE_ZEBRA };
+
+/* Our own copy of a filter, matched the obvious way. */
+struct rule
+{
+  int live;
+  int permit;
+  u_int32_t addr, wild;		/* Host order, addr is pre-masked. */
+  u_int32_t mask, mwild;
+  int plen;
+  int exact;
+};
+
+#define RULES_MAX 10001
+static struct rule rules[RULES_MAX];
+static int nrules;
+
+static int failed;
+
+/* Keeps the benchmark loops from being optimised away. */
+static volatile enum filter_type sink;
+
+static void
+config (const char *fmt, ...)
+{
+  char line[256];
+  va_list args;
+  vector vline;
+  int ret;
+
+  va_start (args, fmt);
+  vsnprintf (line, sizeof line, fmt, args);
+  va_end (args);
+
+  vline = cmd_make_strvec (line);
+  ret = cmd_execute_command (vline, vty, NULL, 0);
+  cmd_free_strvec (vline);
+
+  if (ret != CMD_SUCCESS)
+    {
+      printf ("command failed (%d): %s\n", ret, line);
+      exit (1);
+    }
+}
+
+static const char *
+ip (u_int32_t addr)
+{
+  static char buf[4][INET_ADDRSTRLEN];
+  static int i;
+  struct in_addr in;
+
+  in.s_addr = htonl (addr);
+  i = (i + 1) % 4;
+  return inet_ntop (AF_INET, &in, buf[i], INET_ADDRSTRLEN);
+}
+
+static u_int32_t
+masklen_to_wild (int len)
+{
+  return len >= 32 ? 0 : 0xffffffff >> len;
+}
+
+static u_int32_t
+random_addr (void)
+{
+  /* Keep addresses clustered so that rules overlap. */
+  return 0x0a000000 | (random () & 0x3) << 16 | (random () & 0x1f) << 8
+	 | (random () & 0xff);
+}
+
+static u_int32_t
+random_wild (void)
+{
+  /* Mostly contiguous wildcards, some scattered ones. */
+  if (random () % 8 == 0)
+    return random () & 0x00ff00ff;
+  return masklen_to_wild (8 + random () % 25);
+}
+
+static int
+rule_match (enum rule_kind kind, struct rule *r, u_int32_t addr, int plen)
+{
+  u_int32_t mask;
+
+  switch (kind)
+    {
+    case RULE_STANDARD:
+      return (addr & ~r->wild) == r->addr;
+    case RULE_EXTENDED:
+      mask = plen ? 0xffffffff << (32 - plen) : 0;
+      return (addr & ~r->wild) == r->addr && (mask & ~r->mwild) == r->mask;
+    case RULE_ZEBRA:
+      if (r->exact && r->plen != plen)
+	return 0;
+      if (plen < r->plen)
+	return 0;
+      return r->plen == 0 || ((addr ^ r->addr) >> (32 - r->plen)) == 0;
+    }
+  return 0;
+}
+
+static enum filter_type
+rules_apply (enum rule_kind kind, u_int32_t addr, int plen)
+{
+  int i;
+
+  for (i = 0; i < nrules; i++)
+    if (rules[i].live && rule_match (kind, &rules[i], addr, plen))
+      return rules[i].permit ? FILTER_PERMIT : FILTER_DENY;
+  return FILTER_DENY;
+}
+
+static int
+rule_same (struct rule *a, struct rule *b)
+{
+  return a->permit == b->permit && a->addr == b->addr && a->wild == b->wild
+	 && a->mask == b->mask && a->mwild == b->mwild && a->plen == b->plen
+	 && a->exact == b->exact;
+}
+
+/* Add or remove a rule both in the access-list and in rules[]. */
+static void
+rule_set (enum rule_kind kind, const char *name, struct rule *r, int set)
+{
+  const char *no = set ? "" : "no ";
+  const char *type = r->permit ? "permit" : "deny";
+  int i;
+
+  switch (kind)
+    {
+    case RULE_STANDARD:
+      config ("%saccess-list %s %s %s %s", no, name, type,
+	      ip (r->addr), ip (r->wild));
+      break;
+    case RULE_EXTENDED:
+      config ("%saccess-list %s %s ip %s %s %s %s", no, name, type,
+	      ip (r->addr), ip (r->wild), ip (r->mask), ip (r->mwild));
+      break;
+    case RULE_ZEBRA:
+      config ("%saccess-list %s %s %s/%d%s", no, name, type,
+	      ip (r->addr), r->plen, r->exact ? " exact-match" : "");
+      break;
+    }
+
+  for (i = 0; i < nrules; i++)
+    if (rules[i].live && rule_same (&rules[i], r))
+      break;
+
+  if (set && i == nrules)
+    {
+      rules[nrules] = *r;
+      rules[nrules++].live = 1;
+    }
+  else if (! set && i < nrules)
+    rules[i].live = 0;
+}
+
+static void
+rule_random (enum rule_kind kind, struct rule *r)
+{
+  memset (r, 0, sizeof (struct rule));
+  r->permit = random () & 1;
+
+  switch (kind)
+    {
+    case RULE_EXTENDED:
+      r->mwild = random_wild ();
+      r->mask = (0xffffffff << (random () % 32)) & ~r->mwild;
+      /* Fall through. */
+    case RULE_STANDARD:
+      r->wild = random_wild ();
+      r->addr = random_addr () & ~r->wild;
+      break;
+    case RULE_ZEBRA:
+      r->plen = 8 + random () % 25;
+      r->addr = random_addr () & ~masklen_to_wild (r->plen);
+      r->exact = random () % 4 == 0;
+      break;
+    }
+}
+
+static void
+query (const char *name, u_int32_t addr, int plen, enum filter_type *result)
+{
+  struct prefix p;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = AF_INET;
+  p.prefixlen = plen;
+  p.u.prefix4.s_addr = htonl (addr);
+  *result = access_list_apply (access_list_lookup (AFI_IP, name), &p);
+}
+
+/* Compare access_list_apply against rules_apply while adding and
+   removing random rules. */
+static void
+check_random (enum rule_kind kind, const char *name, int size)
+{
+  struct rule r;
+  enum filter_type got;
+  enum filter_type expected;
+  u_int32_t addr;
+  int plen;
+  int bad = 0;
+  int round;
+  int i;
+
+  nrules = 0;
+
+  for (round = 0; round < 4; round++)
+    {
+      for (i = 0; i < size; i++)
+	{
+	  rule_random (kind, &r);
+	  rule_set (kind, name, &r, 1);
+	}
+
+      /* Take some out again, to exercise deletion. */
+      for (i = 0; i < nrules; i++)
+	if (rules[i].live && random () % 3 == 0)
+	  {
+	    r = rules[i];
+	    rule_set (kind, name, &r, 0);
+	  }
+
+      for (i = 0; i < 20000; i++)
+	{
+	  addr = random_addr ();
+	  plen = random () % 33;
+	  query (name, addr, plen, &got);
+	  expected = rules_apply (kind, addr, plen);
+	  if (got != expected)
+	    bad++;
+	}
+    }
+
+  printf ("%-9s %5d rules: %s\n",
+	  kind == RULE_STANDARD ? "standard"
+	  : kind == RULE_EXTENDED ? "extended" : "zebra",
+	  size, bad ? "FAILED" : "ok");
+  if (bad)
+    failed++;
+
+  /* Empty the list, which also removes it. */
+  for (i = 0; i < nrules; i++)
+    if (rules[i].live)
+      {
+	r = rules[i];
+	rule_set (kind, name, &r, 0);
+      }
+  if (access_list_lookup (AFI_IP, name))
+    {
+      printf ("%s not removed once empty\n", name);
+      failed++;
+    }
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+/* Time lookups in a list of size /24 denies ending in a permit any, the
+   shape of a typical bogon or customer filter. */
+static void
+benchmark (int size)
+{
+  struct access_list *access;
+  struct prefix p;
+  struct timeval start;
+  struct rule r;
+  char name[32];
+  unsigned long lookups;
+  unsigned long linear;
+  int i;
+
+  snprintf (name, sizeof name, "bench%d", size);
+  nrules = 0;
+  for (i = 0; i < size; i++)
+    {
+      memset (&r, 0, sizeof (struct rule));
+      r.plen = 24;
+      r.addr = (0x0a000000 + (i << 8)) ^ (random () & 0x00ff0000);
+      rule_set (RULE_ZEBRA, name, &r, 1);
+    }
+  memset (&r, 0, sizeof (struct rule));
+  r.permit = 1;
+  rule_set (RULE_ZEBRA, name, &r, 1);
+
+  access = access_list_lookup (AFI_IP, name);
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = AF_INET;
+  p.prefixlen = 32;
+
+  gettimeofday (&start, NULL);
+  for (lookups = 0; elapsed (&start) < 0.2; )
+    for (i = 0; i < 1000; i++, lookups++)
+      {
+	p.u.prefix4.s_addr = htonl (0x0a000000 | (random () & 0xffffff));
+	sink = access_list_apply (access, &p);
+      }
+
+  gettimeofday (&start, NULL);
+  for (linear = 0; elapsed (&start) < 0.2; )
+    for (i = 0; i < 100; i++, linear++)
+      sink = rules_apply (RULE_ZEBRA, 0x0a000000 | (random () & 0xffffff),
+			    32);
+
+  printf ("%5d entries: %10lu lookups/s, linear walk %10lu lookups/s\n",
+	  size, lookups * 5, linear * 5);
+}
+
+int
+main (int argc, char **argv)
+{
+  int size;
+
+  master = thread_master_create ();
+  cmd_init (1);
+  vty_init (master);
+  access_list_init ();
+
+  vty = vty_new ();
+  vty->type = VTY_SHELL;
+  vty->node = CONFIG_NODE;
+
+  srandom (1);
+
+  for (size = 10; size <= 1000; size *= 10)
+    {
+      check_random (RULE_STANDARD, "10", size);
+      check_random (RULE_EXTENDED, "110", size);
+      check_random (RULE_ZEBRA, "zebra", size);
+    }
+
+  for (size = 10; size <= 10000; size *= 10)
+    benchmark (size);
+
+  if (failed)
+    {
+      printf ("%d check(s) failed\n", failed);
+      return 1;
+    }
+  printf ("all checks passed\n");
+  return 0;
+}
@@ -23,12 +23,61 @@ struct thread_master *master;
 
 #define TIMES 10
 
+#define POOL_OBJECTS 100000
+#define POOL_SIZE 40
+
+/* MTYPE_ROUTE_NODE is allocated from a pool.  Check that objects don't
+   overlap while freeing and allocating in a mixed order. */
+static int
+test_pool (void)
+{
+  static unsigned long *p[POOL_OBJECTS];
+  int i, j, round;
+  int bad = 0;
+
+  for (round = 0; round < TIMES; round++)
+    {
+      for (i = 0; i < POOL_OBJECTS; i++)
+        if (p[i] == NULL)
+          {
+            p[i] = XCALLOC (MTYPE_ROUTE_NODE, POOL_SIZE);
+            for (j = 0; j < POOL_SIZE / (int) sizeof (long); j++)
+              if (p[i][j] != 0)
+                bad++;
+            for (j = 0; j < POOL_SIZE / (int) sizeof (long); j++)
+              p[i][j] = i;
+          }
+
+      for (i = 0; i < POOL_OBJECTS; i++)
+        {
+          for (j = 0; j < POOL_SIZE / (int) sizeof (long); j++)
+            if (p[i][j] != (unsigned long) i)
+              bad++;
+          if ((i + round) % (round + 2) == 0)
+            XFREE (MTYPE_ROUTE_NODE, p[i]);
+        }
+    }
+
+  for (i = 0; i < POOL_OBJECTS; i++)
+    if (p[i])
+      XFREE (MTYPE_ROUTE_NODE, p[i]);
+
+  if (mtype_stats_alloc (MTYPE_ROUTE_NODE) != 0)
+    bad++;
+
+  printf ("pool: %s\n\n", bad ? "FAILED" : "ok");
+  return bad;
+}
+
 int
 main(int argc, char **argv)
 {
   void *a[10];
   int i;
 
+  if (test_pool ())
+    return 1;
+
   printf ("malloc x, malloc x, free, malloc x, free free\n\n");
   /* simple case, test cache */
   for (i = 0; i < TIMES; i++)
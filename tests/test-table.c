@@ -0,0 +1,289 @@
+/*
+ * Routing table longest prefix match test and benchmark.
+ *
+ * Keeps two tables with the same prefixes, one with the index made by
+ * route_table_lpm and one without, checks route_node_match gives the
+ * same answer from both while prefixes come and go, and times lookups
+ * in each against a table the size of a full feed.
+ *
+ * This file is part of Quagga.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Quagga; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "thread.h"
+#include "memory.h"
+
+struct thread_master *master;
+
+static int failed;
+
+/* Keeps the benchmark loops from being optimised away. */
+static struct route_node * volatile sink;
+
+/* Prefix lengths roughly as in a full IPv4 feed. */
+static int
+random_ipv4_len (void)
+{
+  int r = random () % 100;
+
+  if (r < 55)
+    return 24;
+  if (r < 95)
+    return 16 + random () % 8;
+  if (r < 99)
+    return 8 + random () % 8;
+  return 25 + random () % 8;
+}
+
+static void
+random_prefix (struct prefix *p, u_char family, int clustered)
+{
+  memset (p, 0, sizeof (struct prefix));
+  p->family = family;
+  if (family == AF_INET)
+    {
+      p->prefixlen = random_ipv4_len ();
+      p->u.prefix4.s_addr = htonl (clustered
+				   ? 0x0a000000 | (random () & 0x3ffff) << 6
+				   : (u_int32_t) random () << 1 ^ random ());
+    }
+  else
+    {
+      p->prefixlen = 16 + random () % 49;
+      p->u.prefix6.s6_addr[0] = 0x20;
+      p->u.prefix6.s6_addr[1] = clustered ? 0x01 : random ();
+      p->u.prefix6.s6_addr[2] = random () & (clustered ? 0x3 : 0xff);
+      p->u.prefix6.s6_addr[3] = random ();
+      p->u.prefix6.s6_addr[4] = random ();
+      p->u.prefix6.s6_addr[5] = random ();
+      p->u.prefix6.s6_addr[6] = random ();
+      p->u.prefix6.s6_addr[7] = random ();
+    }
+  apply_mask (p);
+}
+
+/* Add P to both tables, or take it out of both. */
+static void
+prefix_set (struct route_table *a, struct route_table *b, struct prefix *p,
+	    int set)
+{
+  struct route_table *t[2] = { a, b };
+  struct route_node *rn;
+  int i;
+
+  for (i = 0; i < 2; i++)
+    {
+      rn = route_node_get (t[i], p);
+      if (set && ! rn->info)
+	{
+	  /* Keeps the lock route_node_get took. */
+	  rn->info = rn;
+	  continue;
+	}
+      if (! set && rn->info)
+	{
+	  rn->info = NULL;
+	  route_unlock_node (rn);
+	}
+      route_unlock_node (rn);
+    }
+}
+
+static int
+check_lookups (struct route_table *a, struct route_table *b, u_char family,
+	       int clustered, int count)
+{
+  struct route_node *ra;
+  struct route_node *rb;
+  struct prefix p;
+  int bad = 0;
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      random_prefix (&p, family, clustered);
+      p.prefixlen = family == AF_INET ? IPV4_MAX_BITLEN : IPV6_MAX_BITLEN;
+      if (i % 4 == 0)
+	p.prefixlen = random () % (p.prefixlen + 1);
+
+      ra = route_node_match (a, &p);
+      rb = route_node_match (b, &p);
+      if ((ra == NULL) != (rb == NULL)
+	  || (ra && ! prefix_same (&ra->p, &rb->p)))
+	bad++;
+      if (ra)
+	route_unlock_node (ra);
+      if (rb)
+	route_unlock_node (rb);
+    }
+  return bad;
+}
+
+/* Random prefixes in and out of two tables, comparing lookups. */
+static void
+check_random (u_char family, int clustered)
+{
+  struct route_table *a = route_table_init ();
+  struct route_table *b = route_table_init ();
+  struct route_node *rn;
+  struct prefix p;
+  int bad = 0;
+  int round;
+  int i;
+
+  /* Some before the index is made, the rest after. */
+  for (i = 0; i < 2000; i++)
+    {
+      random_prefix (&p, family, clustered);
+      prefix_set (a, b, &p, 1);
+    }
+  route_table_lpm (a, family);
+  bad += check_lookups (a, b, family, clustered, 20000);
+
+  for (round = 0; round < 8; round++)
+    {
+      for (i = 0; i < 5000; i++)
+	{
+	  random_prefix (&p, family, clustered);
+	  prefix_set (a, b, &p, random () % 3 != 0);
+	}
+      if (round == 4)
+	{
+	  memset (&p, 0, sizeof (struct prefix));
+	  p.family = family;
+	  prefix_set (a, b, &p, 1);
+	}
+      bad += check_lookups (a, b, family, clustered, 20000);
+    }
+
+  /* Empty both, the index should go with the nodes. */
+  for (rn = route_top (b); rn; rn = route_next (rn))
+    if (rn->info)
+      prefix_set (a, b, &rn->p, 0);
+  if (a->top || route_table_lpm_chunks (a))
+    {
+      printf ("%lu index chunks left in an empty table\n",
+	      route_table_lpm_chunks (a));
+      bad++;
+    }
+
+  printf ("%s %s: %s\n", family == AF_INET ? "ipv4" : "ipv6",
+	  clustered ? "clustered" : "spread", bad ? "FAILED" : "ok");
+  if (bad)
+    failed++;
+
+  route_table_finish (a);
+  route_table_finish (b);
+}
+
+static double
+elapsed (struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return (now.tv_sec - start->tv_sec)
+	 + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static unsigned long
+lookups_per_second (struct route_table *table, struct in_addr *addr,
+		    int count)
+{
+  struct timeval start;
+  struct route_node *rn;
+  unsigned long lookups;
+  int i;
+
+  gettimeofday (&start, NULL);
+  for (lookups = 0; elapsed (&start) < 0.5; )
+    for (i = 0; i < 1000; i++, lookups++)
+      {
+	rn = route_node_match_ipv4 (table, &addr[lookups % count]);
+	if (rn)
+	  route_unlock_node (rn);
+	sink = rn;
+      }
+  return lookups * 2;
+}
+
+/* Time lookups of random addresses in a table of SIZE prefixes. */
+static void
+benchmark (int size)
+{
+  struct route_table *a = route_table_init ();
+  struct route_table *b = route_table_init ();
+  struct in_addr *addr;
+  struct prefix p;
+  unsigned long with;
+  unsigned long without;
+  int i;
+
+  for (i = 0; i < size; i++)
+    {
+      random_prefix (&p, AF_INET, 0);
+      prefix_set (a, b, &p, 1);
+    }
+  route_table_lpm (a, AF_INET);
+
+  addr = XMALLOC (MTYPE_TMP, sizeof (struct in_addr) * 1000000);
+  for (i = 0; i < 1000000; i++)
+    addr[i].s_addr = htonl ((u_int32_t) random () << 1 ^ random ());
+
+  with = lookups_per_second (a, addr, 1000000);
+  without = lookups_per_second (b, addr, 1000000);
+
+  printf ("%7d prefixes: %9lu lookups/s indexed, %9lu lookups/s tree, "
+	  "%lu index chunks\n", size, with, without,
+	  route_table_lpm_chunks (a));
+
+  XFREE (MTYPE_TMP, addr);
+  route_table_finish (a);
+  route_table_finish (b);
+}
+
+int
+main (int argc, char **argv)
+{
+  int size;
+
+  master = thread_master_create ();
+
+  srandom (1);
+
+  check_random (AF_INET, 1);
+  check_random (AF_INET, 0);
+#ifdef HAVE_IPV6
+  check_random (AF_INET6, 1);
+  check_random (AF_INET6, 0);
+#endif /* HAVE_IPV6 */
+
+  for (size = 6000; size <= 600000; size *= 10)
+    benchmark (size);
+
+  if (failed)
+    {
+      printf ("%d check(s) failed\n", failed);
+      return 1;
+    }
+  printf ("all checks passed\n");
+  return 0;
+}
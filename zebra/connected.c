@@ -190,8 +190,6 @@ connected_up_ipv4 (struct interface *ifp, struct connected *ifc)
 
   rib_add_ipv4 (ZEBRA_ROUTE_CONNECT, 0, &p, NULL, NULL, ifp->ifindex,
 	RT_TABLE_MAIN, ifp->metric, 0);
-
-  rib_update ();
 }
 
 /* Add connected IPv4 route to the interface. */
@@ -296,8 +294,6 @@ connected_down_ipv4 (struct interface *ifp, struct connected *ifc)
 
   /* Same logic as for connected_up_ipv4(): push the changes into the head. */
   rib_delete_ipv4 (ZEBRA_ROUTE_CONNECT, 0, &p, NULL, ifp->ifindex, 0);
-
-  rib_update ();
 }
 
 /* Delete connected IPv4 route to the interface. */
@@ -342,8 +338,6 @@ connected_up_ipv6 (struct interface *ifp, struct connected *ifc)
 
   rib_add_ipv6 (ZEBRA_ROUTE_CONNECT, 0, &p, NULL, ifp->ifindex, 0,
                 ifp->metric, 0);
-
-  rib_update ();
 }
 
 /* Add connected IPv6 route to the interface. */
@@ -416,8 +410,6 @@ connected_down_ipv6 (struct interface *ifp, struct connected *ifc)
     return;
 
   rib_delete_ipv6 (ZEBRA_ROUTE_CONNECT, 0, &p, NULL, ifp->ifindex, 0);
-
-  rib_update ();
 }
 
 void
@@ -512,8 +512,9 @@ if_up (struct interface *ifp)
 	}
     }
 
-  /* Examine all static routes. */
-  rib_update ();
+  /* Examine routes with nexthops on the interface, those with
+     gateways through it follow from its connected routes. */
+  rib_update_interface (ifp);
 }
 
 /* Interface goes down.  We have to manage different behavior of based
@@ -545,8 +546,8 @@ if_down (struct interface *ifp)
 	}
     }
 
-  /* Examine all static routes which direct to the interface. */
-  rib_update ();
+  /* Examine routes with nexthops on the interface. */
+  rib_update_interface (ifp);
 }
 
 void
@@ -37,4 +37,5 @@ int kernel_address_delete_ipv4 (struct interface *a, struct connected *b)
 }
 
 void kernel_init (void) { return; }
+void kernel_flush (void) { return; }
 #pragma weak route_read = kernel_init
@@ -30,12 +30,15 @@
 #include "zclient.h"
 #include "linklist.h"
 #include "log.h"
+#include "thread.h"
+#include "buffer.h"
 
 #include "zebra/rib.h"
 #include "zebra/zserv.h"
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/router-id.h"
+#include "zebra/zebra_nht.h"
 
 /* master zebra server structure */
 extern struct zebra_t zebrad;
@@ -137,35 +140,159 @@ zebra_redistribute_default (struct zserv *client)
 #endif /* HAVE_IPV6 */
 }
 
-/* Redistribute routes. */
+/* A redistribution walk sends routes until the client has this many
+   bytes waiting to be written to it, and then waits for the client to
+   read them before going on. */
+#define ZEBRA_REDIST_WATERMARK  65536
+
+/* Route nodes a redistribution walk looks at before yielding. */
+#define ZEBRA_REDIST_NODES      1000
+
+static int zebra_redistribute_run (struct thread *);
+
+static int
+zebra_redistribute_dumping (struct zserv *client)
+{
+  int type;
+
+  for (type = 0; type < ZEBRA_ROUTE_MAX; type++)
+    if (client->redist_dump[type])
+      return 1;
+  return 0;
+}
+
 static void
-zebra_redistribute (struct zserv *client, int type)
+zebra_redistribute_schedule (struct zserv *client)
 {
-  struct rib *newrib;
+  if (! client->t_redist)
+    client->t_redist = thread_add_background (zebrad.master,
+					      zebra_redistribute_run,
+					      client, 0);
+}
+
+/* Finish the walk in hand, and start one for the types asked for
+   while it was going on. */
+static void
+zebra_redistribute_done (struct zserv *client)
+{
+  if (client->redist_rn)
+    route_unlock_node (client->redist_rn);
+  client->redist_rn = NULL;
+  THREAD_OFF (client->t_redist);
+
+  if (IS_ZEBRA_DEBUG_EVENT)
+    zlog_debug ("client %d: redistribution walk done, %lu routes sent",
+		client->sock, client->redist_dump_routes);
+
+  memcpy (client->redist_dump, client->redist_dump_next,
+	  sizeof (client->redist_dump));
+  memset (client->redist_dump_next, 0, sizeof (client->redist_dump_next));
+  client->redist_afi = AFI_IP;
+  if (zebra_redistribute_dumping (client))
+    zebra_redistribute_schedule (client);
+}
+
+/* Send the client routes from where the walk got to, until it has
+   enough to read or the walk has run long enough. */
+static int
+zebra_redistribute_run (struct thread *thread)
+{
+  struct zserv *client = THREAD_ARG (thread);
   struct route_table *table;
   struct route_node *rn;
+  struct rib *rib;
+  int nodes;
 
-  table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      for (newrib = rn->info; newrib; newrib = newrib->next)
-	if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED) 
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV4_ROUTE_ADD, client, &rn->p, newrib);
-  
+  client->t_redist = NULL;
+
+  for (nodes = 0; nodes < ZEBRA_REDIST_NODES; nodes++)
+    {
+      if (client->redist_rn)
+	rn = route_next (client->redist_rn);
+      else
+	{
+	  table = vrf_table (client->redist_afi, SAFI_UNICAST, 0);
+	  rn = table ? route_top (table) : NULL;
+	}
+      client->redist_rn = rn;
+
+      if (! rn)
+	{
 #ifdef HAVE_IPV6
-  table = vrf_table (AFI_IP6, SAFI_UNICAST, 0);
-  if (table)
-    for (rn = route_top (table); rn; rn = route_next (rn))
-      for (newrib = rn->info; newrib; newrib = newrib->next)
-	if (CHECK_FLAG (newrib->flags, ZEBRA_FLAG_SELECTED)
-	    && newrib->type == type 
-	    && newrib->distance != DISTANCE_INFINITY
-	    && zebra_check_addr (&rn->p))
-	  zsend_route_multipath (ZEBRA_IPV6_ROUTE_ADD, client, &rn->p, newrib);
+	  if (client->redist_afi == AFI_IP)
+	    {
+	      client->redist_afi = AFI_IP6;
+	      continue;
+	    }
 #endif /* HAVE_IPV6 */
+	  zebra_redistribute_done (client);
+	  return 0;
+	}
+
+      for (rib = rn->info; rib; rib = rib->next)
+	if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
+	    && client->redist_dump[rib->type]
+	    && rib->distance != DISTANCE_INFINITY
+	    && zebra_check_addr (&rn->p))
+	  {
+	    if (zsend_route_multipath (client->redist_afi == AFI_IP
+				       ? ZEBRA_IPV4_ROUTE_ADD
+				       : ZEBRA_IPV6_ROUTE_ADD,
+				       client, &rn->p, rib) < 0)
+	      return 0;
+	    client->redist_dump_routes++;
+
+	    /* zserv_flush_data starts us again once the client has
+	       read enough of this. */
+	    if (buffer_pending (client->wb) >= ZEBRA_REDIST_WATERMARK)
+	      {
+		client->redist_dump_waits++;
+		return 0;
+	      }
+	  }
+    }
+
+  zebra_redistribute_schedule (client);
+  return 0;
+}
+
+/* Redistribute routes. */
+static void
+zebra_redistribute (struct zserv *client, int type)
+{
+  if (zebra_redistribute_dumping (client))
+    {
+      client->redist_dump_next[type] = 1;
+      return;
+    }
+
+  client->redist_dump[type] = 1;
+  client->redist_afi = AFI_IP;
+  client->redist_rn = NULL;
+  zebra_redistribute_schedule (client);
+}
+
+/* The client has read some of what it was sent; go on with a
+   redistribution walk that was waiting for it. */
+void
+zebra_redistribute_resume (struct zserv *client)
+{
+  if (! client->t_redist
+      && zebra_redistribute_dumping (client)
+      && buffer_pending (client->wb) < ZEBRA_REDIST_WATERMARK)
+    zebra_redistribute_schedule (client);
+}
+
+/* The client is going away. */
+void
+zebra_redistribute_stop (struct zserv *client)
+{
+  memset (client->redist_dump_next, 0, sizeof (client->redist_dump_next));
+  memset (client->redist_dump, 0, sizeof (client->redist_dump));
+  if (client->redist_rn)
+    route_unlock_node (client->redist_rn);
+  client->redist_rn = NULL;
+  THREAD_OFF (client->t_redist);
 }
 
 void
@@ -174,6 +301,8 @@ redistribute_add (struct prefix *p, struct rib *rib)
   struct listnode *node, *nnode;
   struct zserv *client;
 
+  zebra_nht_changed (p);
+
   for (ALL_LIST_ELEMENTS (zebrad.client_list, node, nnode, client))
     {
       if (is_default (p))
@@ -206,6 +335,8 @@ redistribute_delete (struct prefix *p, struct rib *rib)
   struct listnode *node, *nnode;
   struct zserv *client;
 
+  zebra_nht_changed (p);
+
   /* Add DISTANCE_INFINITY check. */
   if (rib->distance == DISTANCE_INFINITY)
     return;
@@ -284,6 +415,13 @@ zebra_redistribute_delete (int command, struct zserv *client, int length)
     case ZEBRA_ROUTE_OSPF6:
     case ZEBRA_ROUTE_BGP:
       client->redist[type] = 0;
+      client->redist_dump_next[type] = 0;
+      if (client->redist_dump[type])
+	{
+	  client->redist_dump[type] = 0;
+	  if (! zebra_redistribute_dumping (client))
+	    zebra_redistribute_done (client);
+	}
       break;
     default:
       break;
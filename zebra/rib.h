@@ -25,6 +25,8 @@
 
 #include "prefix.h"
 
+struct interface;
+
 #define DISTANCE_INFINITY  255
 
 /* Routing information base. */
@@ -48,6 +50,9 @@ struct rib
   
   /* Nexthop structure */
   struct nexthop *nexthop;
+
+  /* Group the nexthops belong to, when shared with other routes. */
+  struct nexthop_group *nhg;
   
   /* Refrence count. */
   unsigned long refcnt;
@@ -76,6 +81,7 @@ struct rib
   /* RIB internal status */
   u_char status;
 #define RIB_ENTRY_REMOVED	(1 << 0)
+#define RIB_ENTRY_FIB		(1 << 1)
 
   /* Nexthop information. */
   u_char nexthop_num;
@@ -198,6 +204,30 @@ struct nexthop
   union g_addr src;
 };
 
+/* The FIB flag of a nexthop counts only while its route is installed,
+   the nexthop may be shared with routes which are not. */
+#define RIB_NEXTHOP_FIB(R,N) \
+  (CHECK_FLAG ((R)->status, RIB_ENTRY_FIB) \
+   && CHECK_FLAG ((N)->flags, NEXTHOP_FLAG_FIB))
+
+/* Nexthops shared between routes that were given the same ones, and
+   resolved to the same.  Routes move between groups as resolution
+   changes; the nexthops of a group are not changed once made. */
+struct nexthop_group
+{
+  struct nexthop *nexthop;
+  u_char nexthop_num;
+  u_char nexthop_active_num;
+
+  /* The nexthops as given, and what they last resolved to. */
+  struct nexthop_cache *cache;
+
+  /* Routes using the group. */
+  unsigned long refcnt;
+
+  unsigned int key;
+};
+
 /* Routing table instance.  */
 struct vrf
 {
@@ -261,10 +291,13 @@ extern struct rib *rib_match_ipv4 (struct in_addr);
 
 extern struct rib *rib_lookup_ipv4 (struct prefix_ipv4 *);
 
+extern void rib_free (struct rib *);
 extern void rib_update (void);
+extern void rib_update_interface (struct interface *);
 extern void rib_weed_tables (void);
 extern void rib_sweep_route (void);
 extern void rib_close (void);
+extern void rib_kernel_failed (struct prefix *);
 extern void rib_init (void);
 
 extern int
@@ -558,3 +558,9 @@ kernel_delete_ipv6_old (struct prefix_ipv6 *dest, struct in6_addr *gate,
   return kernel_ioctl_ipv6 (SIOCDELRT, dest, gate, index, flags);
 }
 #endif /* HAVE_IPV6 */
+
+/* Routes are sent to the kernel as they are changed, nothing waits. */
+void
+kernel_flush (void)
+{
+}
@@ -257,6 +257,309 @@ set_netlink_nonblocking (struct nlsock *nl, int *flags)
   return 0;
 }
 
+/* Route changes are not sent one at a time, each waiting for its
+   acknowledgement.  They are put together in nl_batch and sent in one
+   go by kernel_flush once the RIB work queue has run dry, or when the
+   buffer fills up, and the acknowledgements are read as they come in.  Routes
+   the kernel refuses are handed back to the RIB by sequence number.
+
+   The kernel deals with the messages before sendmsg returns, so their
+   acknowledgements are read straight away.  NL_BATCH_COUNT keeps those
+   of one batch within the socket receive buffer.  */
+#define NL_BATCH_SIZE   32768
+#define NL_BATCH_COUNT  128
+#define NL_PENDING_MAX  1024
+
+static union
+{
+  struct nlmsghdr n;
+  char buf[NL_BATCH_SIZE];
+} nl_batch;
+static size_t nl_batch_len;
+static unsigned int nl_batch_count;
+
+/* Messages waiting to be acknowledged, oldest first, the last
+   nl_batch_count of them not sent yet. */
+static struct nl_pending
+{
+  u_int32_t seq;
+  int cmd;
+  struct prefix p;
+} nl_pending[NL_PENDING_MAX];
+static unsigned int nl_pending_head;
+static unsigned int nl_pending_count;
+
+static struct thread *nl_ack_thread;
+
+#define NL_PENDING(I) (&nl_pending[(nl_pending_head + (I)) % NL_PENDING_MAX])
+#define NL_INFLIGHT() (nl_pending_count - nl_batch_count)
+
+static void
+netlink_pending_pop (void)
+{
+  nl_pending_head = (nl_pending_head + 1) % NL_PENDING_MAX;
+  nl_pending_count--;
+}
+
+/* The oldest message failed.  Unless a later one changes the same
+   route, tell the RIB it is not installed. */
+static void
+netlink_pending_failed (void)
+{
+  struct nl_pending *pending = NL_PENDING (0);
+  unsigned int i;
+
+  if (pending->cmd != RTM_NEWROUTE)
+    return;
+
+  for (i = 1; i < nl_pending_count; i++)
+    if (prefix_same (&NL_PENDING (i)->p, &pending->p))
+      return;
+
+  rib_kernel_failed (&pending->p);
+}
+
+/* Acknowledgement or error for message seq. */
+static void
+netlink_pending_done (u_int32_t seq, int error)
+{
+  /* Acknowledgements come in order, anything before seq has been
+     dealt with already. */
+  while (NL_INFLIGHT () > 0 && (int) (NL_PENDING (0)->seq - seq) < 0)
+    netlink_pending_pop ();
+
+  if (NL_INFLIGHT () == 0 || NL_PENDING (0)->seq != seq)
+    return;
+
+  if (error)
+    netlink_pending_failed ();
+  netlink_pending_pop ();
+}
+
+static int netlink_batch_read (struct thread *);
+static int netlink_batch_recv (void);
+
+/* Send what is in the batch. */
+static void
+netlink_batch_send (void)
+{
+  int status;
+  int save_errno;
+  struct sockaddr_nl snl;
+  struct iovec iov = { (void *) nl_batch.buf, nl_batch_len };
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+
+  if (nl_batch_len == 0)
+    return;
+
+  memset (&snl, 0, sizeof snl);
+  snl.nl_family = AF_NETLINK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: %s %u messages, %zu bytes", __func__, netlink_cmd.name,
+		nl_batch_count, nl_batch_len);
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  status = sendmsg (netlink_cmd.sock, &msg, 0);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  nl_batch_len = 0;
+
+  if (status < 0)
+    {
+      zlog (NULL, LOG_ERR, "%s: sendmsg() error: %s", __func__,
+	    safe_strerror (save_errno));
+
+      /* None of them made it, fail them all.  They are the newest. */
+      while (nl_batch_count > 0)
+	{
+	  struct nl_pending *pending = NL_PENDING (nl_pending_count - 1);
+
+	  if (pending->cmd == RTM_NEWROUTE)
+	    rib_kernel_failed (&pending->p);
+	  nl_pending_count--;
+	  nl_batch_count--;
+	}
+      return;
+    }
+
+  nl_batch_count = 0;
+  while (NL_INFLIGHT () > 0 && netlink_batch_recv () == 0)
+    ;
+
+  if (NL_INFLIGHT () > 0 && ! nl_ack_thread)
+    nl_ack_thread = thread_add_read (zebrad.master, netlink_batch_read, NULL,
+				     netlink_cmd.sock);
+}
+
+/* Read whatever acknowledgements there are.  Returns -1 once there is
+   nothing more to read. */
+static int
+netlink_batch_recv (void)
+{
+  int status;
+  int save_errno;
+  char buf[8192];
+  struct iovec iov = { buf, sizeof buf };
+  struct sockaddr_nl snl;
+  struct msghdr msg = { (void *) &snl, sizeof snl, &iov, 1, NULL, 0, 0 };
+  struct nlmsghdr *h;
+
+  if (zserv_privs.change (ZPRIVS_RAISE))
+    zlog (NULL, LOG_ERR, "Can't raise privileges");
+  status = recvmsg (netlink_cmd.sock, &msg, 0);
+  save_errno = errno;
+  if (zserv_privs.change (ZPRIVS_LOWER))
+    zlog (NULL, LOG_ERR, "Can't lower privileges");
+
+  if (status < 0)
+    {
+      if (save_errno == EINTR)
+	return 0;
+      if (save_errno == EWOULDBLOCK || save_errno == EAGAIN)
+	return -1;
+      zlog (NULL, LOG_ERR, "%s recvmsg overrun: %s", netlink_cmd.name,
+	    safe_strerror (save_errno));
+
+      /* Acknowledgements were lost, stop waiting for them. */
+      while (NL_INFLIGHT () > 0)
+	netlink_pending_pop ();
+      return -1;
+    }
+
+  if (status == 0)
+    {
+      zlog (NULL, LOG_ERR, "%s EOF", netlink_cmd.name);
+      return -1;
+    }
+
+  if (snl.nl_pid != 0)
+    return 0;
+
+  for (h = (struct nlmsghdr *) buf; NLMSG_OK (h, (unsigned int) status);
+       h = NLMSG_NEXT (h, status))
+    {
+      struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA (h);
+
+      if (h->nlmsg_type != NLMSG_ERROR)
+	{
+	  zlog_warn ("%s: ignoring message type 0x%04x", __func__,
+		     h->nlmsg_type);
+	  continue;
+	}
+
+      if (h->nlmsg_len < NLMSG_LENGTH (sizeof (struct nlmsgerr)))
+	{
+	  zlog (NULL, LOG_ERR, "%s error: message truncated",
+		netlink_cmd.name);
+	  continue;
+	}
+
+      if (err->error)
+	{
+	  int loglvl = LOG_ERR;
+
+	  if (-err->error == ENODEV || -err->error == ESRCH)
+	    loglvl = LOG_DEBUG;
+
+	  zlog (NULL, loglvl, "%s error: %s, type=%s(%u), seq=%u, pid=%u",
+		netlink_cmd.name, safe_strerror (-err->error),
+		lookup (nlmsg_str, err->msg.nlmsg_type),
+		err->msg.nlmsg_type, err->msg.nlmsg_seq, err->msg.nlmsg_pid);
+	}
+      else if (IS_ZEBRA_DEBUG_KERNEL)
+	zlog_debug ("%s: %s ACK: type=%s(%u), seq=%u", __func__,
+		    netlink_cmd.name, lookup (nlmsg_str, err->msg.nlmsg_type),
+		    err->msg.nlmsg_type, err->msg.nlmsg_seq);
+
+      netlink_pending_done (err->msg.nlmsg_seq, err->error);
+    }
+  return 0;
+}
+
+static int
+netlink_batch_read (struct thread *thread)
+{
+  nl_ack_thread = NULL;
+
+  while (NL_INFLIGHT () > 0 && netlink_batch_recv () == 0)
+    ;
+
+  if (NL_INFLIGHT () > 0)
+    nl_ack_thread = thread_add_read (zebrad.master, netlink_batch_read, NULL,
+				     netlink_cmd.sock);
+  return 0;
+}
+
+/* Send the batch and read all acknowledgements, before talking to the
+   kernel synchronously. */
+static void
+netlink_batch_drain (void)
+{
+  netlink_batch_send ();
+
+  if (NL_INFLIGHT () == 0)
+    return;
+
+  THREAD_OFF (nl_ack_thread);
+  while (NL_INFLIGHT () > 0)
+    if (netlink_batch_recv () < 0)
+      break;
+
+  /* Anything still outstanding is not coming. */
+  while (NL_INFLIGHT () > 0)
+    netlink_pending_pop ();
+}
+
+/* Queue a route change for the kernel. */
+static int
+netlink_batch_add (struct nlmsghdr *n, struct prefix *p)
+{
+  struct nl_pending *pending;
+
+  if (netlink_cmd.sock < 0)
+    {
+      zlog (NULL, LOG_ERR, "%s socket isn't active.", netlink_cmd.name);
+      return -1;
+    }
+
+  if (nl_batch_len + NLMSG_ALIGN (n->nlmsg_len) > NL_BATCH_SIZE
+      || nl_batch_count == NL_BATCH_COUNT)
+    netlink_batch_send ();
+  if (nl_pending_count == NL_PENDING_MAX)
+    netlink_batch_drain ();
+
+  n->nlmsg_seq = ++netlink_cmd.seq;
+  n->nlmsg_flags |= NLM_F_ACK;
+
+  if (IS_ZEBRA_DEBUG_KERNEL)
+    zlog_debug ("%s: %s type %s(%u), seq=%u", __func__, netlink_cmd.name,
+		lookup (nlmsg_str, n->nlmsg_type), n->nlmsg_type,
+		n->nlmsg_seq);
+
+  memcpy (nl_batch.buf + nl_batch_len, n, n->nlmsg_len);
+  nl_batch_len += NLMSG_ALIGN (n->nlmsg_len);
+  nl_batch_count++;
+
+  pending = NL_PENDING (nl_pending_count);
+  pending->seq = n->nlmsg_seq;
+  pending->cmd = n->nlmsg_type;
+  prefix_copy (&pending->p, p);
+  nl_pending_count++;
+  return 0;
+}
+
+/* Send any queued route changes.  Acknowledgements are read as they
+   come in. */
+void
+kernel_flush (void)
+{
+  netlink_batch_send ();
+}
+
 /* Get type specified information from netlink. */
 static int
 netlink_request (int family, int type, struct nlsock *nl)
@@ -271,6 +574,8 @@ netlink_request (int family, int type, struct nlsock *nl)
     struct rtgenmsg g;
   } req;
 
+  if (nl == &netlink_cmd)
+    netlink_batch_drain ();
 
   /* Check netlink socket. */
   if (nl->sock < 0)
@@ -1270,6 +1575,9 @@ netlink_talk (struct nlmsghdr *n, struct nlsock *nl)
   int snb_ret;
   int save_errno;
 
+  if (nl == &netlink_cmd)
+    netlink_batch_drain ();
+
   memset (&snl, 0, sizeof snl);
   snl.nl_family = AF_NETLINK;
 
@@ -1402,7 +1710,6 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
                          int family)
 {
   int bytelen;
-  struct sockaddr_nl snl;
   struct nexthop *nexthop = NULL;
   int nexthop_num = 0;
   int discard;
@@ -1816,12 +2123,8 @@ netlink_route_multipath (int cmd, struct prefix *p, struct rib *rib,
 
 skip:
 
-  /* Destination netlink address. */
-  memset (&snl, 0, sizeof snl);
-  snl.nl_family = AF_NETLINK;
-
-  /* Talk to netlink socket. */
-  return netlink_talk (&req.n, &netlink_cmd);
+  /* Queue it for the kernel, replies are dealt with as they come. */
+  return netlink_batch_add (&req.n, p);
 }
 
 int
@@ -0,0 +1,287 @@
+/* Nexthop tracking for zebra clients.
+ *
+ * This file is part of Quagga routing suite.
+ *
+ * Quagga is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2, or (at your option) any
+ * later version.
+ *
+ * Quagga is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GNU Zebra; see the file COPYING.  If not, write to the Free
+ * Software Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ */
+
+/* Clients register the addresses they use as nexthops, and are sent
+   ZEBRA_NEXTHOP_UPDATE with how each resolves, at once and whenever
+   that changes, rather than having to poll with nexthop lookups.
+
+   Registered addresses are kept in a table of host routes.  When the
+   selected route for a prefix changes, the addresses under it are
+   marked, and an event resolves them again afterwards, sending an
+   update where the answer is not what was last sent.  */
+
+#include <zebra.h>
+
+#include "prefix.h"
+#include "table.h"
+#include "stream.h"
+#include "linklist.h"
+#include "memory.h"
+#include "thread.h"
+#include "log.h"
+#include "zclient.h"
+
+#include "zebra/rib.h"
+#include "zebra/zserv.h"
+#include "zebra/debug.h"
+#include "zebra/zebra_nht.h"
+
+/* master zebra server structure */
+extern struct zebra_t zebrad;
+
+/* A registered address. */
+struct zebra_nht
+{
+  /* Clients which registered it. */
+  struct list *clients;
+
+  /* Needs resolving again. */
+  u_char dirty;
+
+  /* What was last sent, as put by zserv_nexthop_encode. */
+  u_char *data;
+  size_t size;
+};
+
+/* Registered addresses, by address family. */
+static struct route_table *zebra_nht_table[AFI_MAX];
+
+/* Event resolving marked addresses again. */
+static struct thread *zebra_nht_thread;
+
+static struct stream *zebra_nht_buf;
+
+static struct route_table *
+zebra_nht_table_get (struct prefix *p)
+{
+  if (p->family == AF_INET)
+    return zebra_nht_table[AFI_IP];
+#ifdef HAVE_IPV6
+  if (p->family == AF_INET6)
+    return zebra_nht_table[AFI_IP6];
+#endif /* HAVE_IPV6 */
+  return NULL;
+}
+
+/* Work out how the address resolves, into zebra_nht_buf. */
+static void
+zebra_nht_resolve (struct prefix *p)
+{
+  struct rib *rib = NULL;
+
+  if (p->family == AF_INET)
+    rib = rib_match_ipv4 (p->u.prefix4);
+#ifdef HAVE_IPV6
+  else if (p->family == AF_INET6)
+    rib = rib_match_ipv6 (&p->u.prefix6);
+#endif /* HAVE_IPV6 */
+
+  stream_reset (zebra_nht_buf);
+  zserv_nexthop_encode (zebra_nht_buf, rib);
+}
+
+/* Remember what is in zebra_nht_buf as last sent.  Returns whether it
+   is any different. */
+static int
+zebra_nht_save (struct zebra_nht *nht)
+{
+  size_t size;
+
+  size = stream_get_endp (zebra_nht_buf);
+  if (nht->data && nht->size == size
+      && memcmp (nht->data, STREAM_DATA (zebra_nht_buf), size) == 0)
+    return 0;
+
+  if (nht->data)
+    XFREE (MTYPE_NEXTHOP_TRACK, nht->data);
+  nht->data = XMALLOC (MTYPE_NEXTHOP_TRACK, size);
+  memcpy (nht->data, STREAM_DATA (zebra_nht_buf), size);
+  nht->size = size;
+  return 1;
+}
+
+static void
+zebra_nht_free (struct route_node *rn)
+{
+  struct zebra_nht *nht = rn->info;
+
+  list_free (nht->clients);
+  if (nht->data)
+    XFREE (MTYPE_NEXTHOP_TRACK, nht->data);
+  XFREE (MTYPE_NEXTHOP_TRACK, nht);
+
+  rn->info = NULL;
+  route_unlock_node (rn);
+}
+
+void
+zebra_nht_register (struct zserv *client, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct zebra_nht *nht;
+
+  table = zebra_nht_table_get (p);
+  if (! table)
+    return;
+
+  rn = route_node_get (table, p);
+  if (rn->info)
+    {
+      nht = rn->info;
+      route_unlock_node (rn);
+    }
+  else
+    {
+      nht = XCALLOC (MTYPE_NEXTHOP_TRACK, sizeof (struct zebra_nht));
+      nht->clients = list_new ();
+      rn->info = nht;
+
+      zebra_nht_resolve (p);
+      zebra_nht_save (nht);
+    }
+
+  if (! listnode_lookup (nht->clients, client))
+    listnode_add (nht->clients, client);
+
+  zsend_nexthop_update (client, p, nht->data, nht->size);
+}
+
+static void
+zebra_nht_unregister_node (struct zserv *client, struct route_node *rn)
+{
+  struct zebra_nht *nht = rn->info;
+
+  listnode_delete (nht->clients, client);
+  if (listcount (nht->clients) == 0)
+    zebra_nht_free (rn);
+}
+
+void
+zebra_nht_unregister (struct zserv *client, struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+
+  table = zebra_nht_table_get (p);
+  if (! table)
+    return;
+
+  rn = route_node_lookup (table, p);
+  if (! rn)
+    return;
+
+  if (rn->info)
+    zebra_nht_unregister_node (client, rn);
+  route_unlock_node (rn);
+}
+
+/* Forget a client going away. */
+void
+zebra_nht_client_close (struct zserv *client)
+{
+  struct route_node *rn;
+  afi_t afi;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    if (zebra_nht_table[afi])
+      for (rn = route_top (zebra_nht_table[afi]); rn; rn = route_next (rn))
+	if (rn->info)
+	  zebra_nht_unregister_node (client, rn);
+}
+
+/* Resolve marked addresses again, and tell clients of any changes. */
+static int
+zebra_nht_evaluate (struct thread *thread)
+{
+  struct route_node *rn;
+  struct zebra_nht *nht;
+  struct listnode *node;
+  struct zserv *client;
+  afi_t afi;
+
+  zebra_nht_thread = NULL;
+
+  for (afi = AFI_IP; afi < AFI_MAX; afi++)
+    if (zebra_nht_table[afi])
+      for (rn = route_top (zebra_nht_table[afi]); rn; rn = route_next (rn))
+	{
+	  if ((nht = rn->info) == NULL || ! nht->dirty)
+	    continue;
+
+	  nht->dirty = 0;
+	  zebra_nht_resolve (&rn->p);
+	  if (! zebra_nht_save (nht))
+	    continue;
+
+	  if (IS_ZEBRA_DEBUG_EVENT)
+	    {
+	      char buf[INET6_ADDRSTRLEN];
+
+	      zlog_debug ("nexthop %s resolution changed",
+			  inet_ntop (rn->p.family, &rn->p.u.prefix,
+				     buf, INET6_ADDRSTRLEN));
+	    }
+
+	  for (ALL_LIST_ELEMENTS_RO (nht->clients, node, client))
+	    zsend_nexthop_update (client, &rn->p, nht->data, nht->size);
+	}
+  return 0;
+}
+
+/* The selected route for p has changed, so may have the resolution of
+   registered addresses under it.  */
+void
+zebra_nht_changed (struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *rn;
+  int marked = 0;
+
+  table = zebra_nht_table_get (p);
+  if (! table || ! table->top)
+    return;
+
+  /* Held until the end, or the walk could go past it once it goes. */
+  top = route_node_get (table, p);
+  route_lock_node (top);
+  for (rn = top; rn; rn = route_next_until (rn, top))
+    if (rn->info)
+      {
+	((struct zebra_nht *) rn->info)->dirty = 1;
+	marked = 1;
+      }
+  route_unlock_node (top);
+
+  if (marked && ! zebra_nht_thread)
+    zebra_nht_thread = thread_add_event (zebrad.master, zebra_nht_evaluate,
+					 NULL, 0);
+}
+
+void
+zebra_nht_init (void)
+{
+  zebra_nht_table[AFI_IP] = route_table_init ();
+#ifdef HAVE_IPV6
+  zebra_nht_table[AFI_IP6] = route_table_init ();
+#endif /* HAVE_IPV6 */
+  zebra_nht_buf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+}
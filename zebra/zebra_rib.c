@@ -34,6 +34,8 @@
 #include "workqueue.h"
 #include "prefix.h"
 #include "routemap.h"
+#include "hash.h"
+#include "jhash.h"
 
 #include "zebra/rib.h"
 #include "zebra/rt.h"
@@ -90,6 +92,10 @@ vrf_alloc (const char *name)
   vrf->stable[AFI_IP][SAFI_UNICAST] = route_table_init ();
   vrf->stable[AFI_IP6][SAFI_UNICAST] = route_table_init ();
 
+  /* Nexthops are resolved by longest prefix match in these. */
+  route_table_lpm (vrf->table[AFI_IP][SAFI_UNICAST], AF_INET);
+  route_table_lpm (vrf->table[AFI_IP6][SAFI_UNICAST], AF_INET6);
+
   return vrf;
 }
 
@@ -336,6 +342,268 @@ nexthop_blackhole_add (struct rib *rib)
   return nexthop;
 }
 
+/* Nexthops as a route's owner gave them, before resolution, and the
+   group they resolved to when last looked at.  Made for the first
+   route given them, shared with any others given the same. */
+struct nexthop_cache
+{
+  struct nexthop *nexthop;
+  u_char family;
+  u_char flags;
+  unsigned int key;
+
+  /* Groups made from it. */
+  unsigned long refcnt;
+
+  /* What resolution gave at epoch, holding a reference. */
+  unsigned long epoch;
+  struct nexthop_group *group;
+};
+
+/* Route flags which resolving and installing nexthops depend on. */
+#define NEXTHOP_CACHE_FLAGS \
+  (ZEBRA_FLAG_INTERNAL | ZEBRA_FLAG_BLACKHOLE | ZEBRA_FLAG_REJECT)
+
+static struct hash *nexthop_caches;
+static struct hash *nexthop_groups;
+
+/* Moved on whenever anything resolving gateways depends on may have
+   changed, which leaves what the caches have out of date. */
+static unsigned long nexthop_epoch = 1;
+
+static unsigned int
+nexthop_list_key (struct nexthop *nexthop, unsigned int key)
+{
+  for (; nexthop; nexthop = nexthop->next)
+    {
+      key = jhash_3words (nexthop->type,
+			  nexthop->flags & ~NEXTHOP_FLAG_FIB,
+			  nexthop->ifindex, key);
+      key = jhash (&nexthop->gate, sizeof (union g_addr), key);
+      key = jhash (&nexthop->rgate, sizeof (union g_addr), key);
+      if (nexthop->ifname)
+	key = jhash (nexthop->ifname, strlen (nexthop->ifname), key);
+    }
+  return key;
+}
+
+/* Same nexthops, in the same state bar the FIB flag, which goes with
+   installing a route using them. */
+static int
+nexthop_list_same (struct nexthop *a, struct nexthop *b)
+{
+  for (; a && b; a = a->next, b = b->next)
+    {
+      if (a->type != b->type
+	  || (a->flags & ~NEXTHOP_FLAG_FIB) != (b->flags & ~NEXTHOP_FLAG_FIB)
+	  || a->ifindex != b->ifindex
+	  || a->rtype != b->rtype
+	  || a->rifindex != b->rifindex
+	  || memcmp (&a->gate, &b->gate, sizeof (union g_addr))
+	  || memcmp (&a->rgate, &b->rgate, sizeof (union g_addr))
+	  || memcmp (&a->src, &b->src, sizeof (union g_addr)))
+	return 0;
+      if (a->ifname || b->ifname)
+	if (! a->ifname || ! b->ifname || strcmp (a->ifname, b->ifname))
+	  return 0;
+    }
+  return a == b;
+}
+
+static struct nexthop *
+nexthop_list_copy (struct nexthop *nexthop, u_char *num)
+{
+  struct nexthop *head = NULL;
+  struct nexthop *last = NULL;
+  struct nexthop *new;
+
+  if (num)
+    *num = 0;
+  for (; nexthop; nexthop = nexthop->next)
+    {
+      new = XMALLOC (MTYPE_NEXTHOP, sizeof (struct nexthop));
+      memcpy (new, nexthop, sizeof (struct nexthop));
+      if (nexthop->ifname)
+	new->ifname = XSTRDUP (0, nexthop->ifname);
+      UNSET_FLAG (new->flags, NEXTHOP_FLAG_FIB);
+      new->next = NULL;
+      new->prev = last;
+      if (last)
+	last->next = new;
+      else
+	head = new;
+      last = new;
+      if (num)
+	(*num)++;
+    }
+  return head;
+}
+
+static void
+nexthop_list_free (struct nexthop *nexthop)
+{
+  struct nexthop *next;
+
+  for (; nexthop; nexthop = next)
+    {
+      next = nexthop->next;
+      nexthop_free (nexthop);
+    }
+}
+
+static unsigned int
+nexthop_cache_key (void *arg)
+{
+  struct nexthop_cache *cache = arg;
+
+  return cache->key;
+}
+
+static int
+nexthop_cache_cmp (void *a, void *b)
+{
+  struct nexthop_cache *ca = a;
+  struct nexthop_cache *cb = b;
+
+  return (ca->family == cb->family && ca->flags == cb->flags
+	  && nexthop_list_same (ca->nexthop, cb->nexthop));
+}
+
+static void *
+nexthop_cache_alloc (void *arg)
+{
+  struct nexthop_cache *key = arg;
+  struct nexthop_cache *cache;
+
+  cache = XCALLOC (MTYPE_NEXTHOP_GROUP, sizeof (struct nexthop_cache));
+  cache->nexthop = nexthop_list_copy (key->nexthop, NULL);
+  cache->family = key->family;
+  cache->flags = key->flags;
+  cache->key = key->key;
+  return cache;
+}
+
+static unsigned int
+nexthop_group_key (void *arg)
+{
+  struct nexthop_group *nhg = arg;
+
+  return nhg->key;
+}
+
+static int
+nexthop_group_cmp (void *a, void *b)
+{
+  struct nexthop_group *ga = a;
+  struct nexthop_group *gb = b;
+
+  return (ga->cache == gb->cache
+	  && nexthop_list_same (ga->nexthop, gb->nexthop));
+}
+
+/* The group of nexthops from cache in the state of those in list,
+   made if there is none yet.  A new one has no references. */
+static struct nexthop_group *
+nexthop_group_get (struct nexthop_cache *cache, struct nexthop *list)
+{
+  struct nexthop_group key;
+  struct nexthop_group *nhg;
+  struct nexthop *nexthop;
+
+  key.cache = cache;
+  key.nexthop = list;
+  key.key = nexthop_list_key (list, cache->key);
+  if ((nhg = hash_lookup (nexthop_groups, &key)) != NULL)
+    return nhg;
+
+  nhg = XCALLOC (MTYPE_NEXTHOP_GROUP, sizeof (struct nexthop_group));
+  nhg->cache = cache;
+  nhg->key = key.key;
+  nhg->nexthop = nexthop_list_copy (list, &nhg->nexthop_num);
+  for (nexthop = nhg->nexthop; nexthop; nexthop = nexthop->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE))
+      nhg->nexthop_active_num++;
+  cache->refcnt++;
+  hash_get (nexthop_groups, nhg, hash_alloc_intern);
+  return nhg;
+}
+
+static void
+nexthop_group_free (struct nexthop_group *nhg)
+{
+  struct nexthop_cache *cache = nhg->cache;
+
+  hash_release (nexthop_groups, nhg);
+  nexthop_list_free (nhg->nexthop);
+  XFREE (MTYPE_NEXTHOP_GROUP, nhg);
+
+  if (--cache->refcnt == 0)
+    {
+      hash_release (nexthop_caches, cache);
+      nexthop_list_free (cache->nexthop);
+      XFREE (MTYPE_NEXTHOP_GROUP, cache);
+    }
+}
+
+static void
+nexthop_group_unlock (struct nexthop_group *nhg)
+{
+  if (--nhg->refcnt == 0)
+    nexthop_group_free (nhg);
+}
+
+/* The route no longer uses its group. */
+static void
+nexthop_group_release (struct rib *rib)
+{
+  struct nexthop_group *nhg = rib->nhg;
+  struct nexthop_cache *cache = nhg->cache;
+  struct nexthop_group *cached;
+  int last;
+
+  /* The cache goes with the last group made from it, which cannot be
+     the one it holds while the route holds it too. */
+  last = (nhg->refcnt == 1 && cache->refcnt == 1);
+
+  rib->nhg = NULL;
+  rib->nexthop = NULL;
+  nexthop_group_unlock (nhg);
+
+  /* Only the cache holds the group it has left: let both go. */
+  cached = last ? NULL : cache->group;
+  if (cached && cached->refcnt == 1 && cache->refcnt == 1)
+    {
+      cache->group = NULL;
+      nexthop_group_unlock (cached);
+    }
+}
+
+/* Share the nexthops of a new route with the routes given the same
+   ones, family being that of its prefix. */
+static void
+nexthop_group_intern (struct rib *rib, u_char family)
+{
+  struct nexthop_cache key;
+  struct nexthop_cache *cache;
+  struct nexthop_group *nhg;
+
+  key.nexthop = rib->nexthop;
+  key.family = family;
+  key.flags = rib->flags & NEXTHOP_CACHE_FLAGS;
+  key.key = nexthop_list_key (rib->nexthop,
+			      jhash_2words (family, key.flags, 0));
+  cache = hash_get (nexthop_caches, &key, nexthop_cache_alloc);
+
+  /* Straight into what the others resolved to, if there is anything. */
+  nhg = cache->group ? cache->group : nexthop_group_get (cache, rib->nexthop);
+  nhg->refcnt++;
+
+  nexthop_list_free (rib->nexthop);
+  rib->nhg = nhg;
+  rib->nexthop = nhg->nexthop;
+  rib->nexthop_num = nhg->nexthop_num;
+}
+
 /* If force flag is not set, do not modify falgs at all for uninstall
    the route from FIB. */
 static int
@@ -404,7 +672,7 @@ nexthop_active_ipv4 (struct rib *rib, struct nexthop *nexthop, int set,
 	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
 	    {
 	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+		if (RIB_NEXTHOP_FIB (match, newhop)
 		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
 		  {
 		    if (set)
@@ -502,7 +770,7 @@ nexthop_active_ipv6 (struct rib *rib, struct nexthop *nexthop, int set,
 	  else if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_INTERNAL))
 	    {
 	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB)
+		if (RIB_NEXTHOP_FIB (match, newhop)
 		    && ! CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_RECURSIVE))
 		  {
 		    if (set)
@@ -582,7 +850,7 @@ rib_match_ipv4 (struct in_addr addr)
 	  else
 	    {
 	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB))
+		if (RIB_NEXTHOP_FIB (match, newhop))
 		  return match;
 	      return NULL;
 	    }
@@ -625,7 +893,7 @@ rib_lookup_ipv4 (struct prefix_ipv4 *p)
     return match;
   
   for (nexthop = match->nexthop; nexthop; nexthop = nexthop->next)
-    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+    if (RIB_NEXTHOP_FIB (match, nexthop))
       return match;
 
   return NULL;
@@ -684,7 +952,7 @@ rib_lookup_ipv4_route (struct prefix_ipv4 *p, union sockunion * qgate)
   
   /* Ok, we have a cood candidate, let's check it's nexthop list... */
   for (nexthop = match->nexthop; nexthop; nexthop = nexthop->next)
-    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+    if (RIB_NEXTHOP_FIB (match, nexthop))
     {
       /* We are happy with either direct or recursive hexthop */
       if (nexthop->gate.ipv4.s_addr == qgate->sin.sin_addr.s_addr ||
@@ -757,7 +1025,7 @@ rib_match_ipv6 (struct in6_addr *addr)
 	  else
 	    {
 	      for (newhop = match->nexthop; newhop; newhop = newhop->next)
-		if (CHECK_FLAG (newhop->flags, NEXTHOP_FLAG_FIB))
+		if (RIB_NEXTHOP_FIB (match, newhop))
 		  return match;
 	      return NULL;
 	    }
@@ -881,6 +1149,118 @@ nexthop_active_check (struct route_node *rn, struct rib *rib,
   return CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE);
 }
 
+/* Whether resolving the route's nexthops depends on its prefix, through
+   a route map or a gateway inside the prefix, so that what the cache
+   has for the other routes given them will not do for it. */
+static int
+nexthop_group_own (struct route_node *rn, struct rib *rib)
+{
+  extern char *proto_rm[AFI_MAX][ZEBRA_ROUTE_MAX+1];
+  struct nexthop *nexthop;
+  struct prefix p;
+  afi_t afi;
+
+  /* nexthop_active_check only applies the route map of the route's
+     own family. */
+  afi = family2afi (rn->p.family);
+  if ((rib->type >= 0 && rib->type < ZEBRA_ROUTE_MAX
+       && proto_rm[afi][rib->type])
+      || proto_rm[afi][ZEBRA_ROUTE_MAX])
+    return 1;
+
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    {
+      memset (&p, 0, sizeof (struct prefix));
+      switch (nexthop->type)
+	{
+	case NEXTHOP_TYPE_IPV4:
+	case NEXTHOP_TYPE_IPV4_IFINDEX:
+	  p.family = AF_INET;
+	  p.prefixlen = IPV4_MAX_BITLEN;
+	  p.u.prefix4 = nexthop->gate.ipv4;
+	  break;
+#ifdef HAVE_IPV6
+	case NEXTHOP_TYPE_IPV6:
+	case NEXTHOP_TYPE_IPV6_IFINDEX:
+	case NEXTHOP_TYPE_IPV6_IFNAME:
+	  p.family = AF_INET6;
+	  p.prefixlen = IPV6_MAX_BITLEN;
+	  p.u.prefix6 = nexthop->gate.ipv6;
+	  break;
+#endif /* HAVE_IPV6 */
+	default:
+	  continue;
+	}
+      if (prefix_match (&rn->p, &p))
+	return 1;
+    }
+  return 0;
+}
+
+/* nexthop_active_update for a route sharing its nexthops.  Resolves
+   them once for all routes given them, unless that is out of date or
+   will not do for this route, in a copy of them as given; the result
+   is the group of nexthops in that state.  If set, the route moves
+   there, otherwise it keeps its nexthops, the FIB flags of which say
+   what is installed, while the count and the changed flag are for
+   what it would have. */
+static int
+nexthop_group_update (struct route_node *rn, struct rib *rib, int set)
+{
+  struct nexthop_cache *cache = rib->nhg->cache;
+  struct nexthop_group *nhg;
+  struct nexthop_group *old;
+  struct nexthop *list;
+  struct nexthop *nexthop;
+  struct nexthop *prev;
+  int own;
+
+  own = nexthop_group_own (rn, rib);
+  if (! own && cache->epoch == nexthop_epoch && cache->group)
+    nhg = cache->group;
+  else
+    {
+      list = nexthop_list_copy (cache->nexthop, NULL);
+      for (nexthop = list; nexthop; nexthop = nexthop->next)
+	nexthop_active_check (rn, rib, nexthop, 1);
+      nhg = nexthop_group_get (cache, list);
+      nexthop_list_free (list);
+
+      if (! own)
+	{
+	  cache->epoch = nexthop_epoch;
+	  if (cache->group != nhg)
+	    {
+	      old = cache->group;
+	      nhg->refcnt++;
+	      cache->group = nhg;
+	      if (old)
+		nexthop_group_unlock (old);
+	    }
+	}
+    }
+
+  UNSET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+  for (nexthop = nhg->nexthop, prev = rib->nexthop; nexthop && prev;
+       nexthop = nexthop->next, prev = prev->next)
+    if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE)
+	!= CHECK_FLAG (prev->flags, NEXTHOP_FLAG_ACTIVE))
+      SET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
+  rib->nexthop_active_num = nhg->nexthop_active_num;
+
+  if (set && nhg != rib->nhg)
+    {
+      nhg->refcnt++;
+      nexthop_group_release (rib);
+      rib->nhg = nhg;
+      rib->nexthop = nhg->nexthop;
+    }
+  else if (nhg->refcnt == 0)
+    nexthop_group_free (nhg);
+
+  return rib->nexthop_active_num;
+}
+
 /* Iterate over all nexthops of the given RIB entry and refresh their
  * ACTIVE flag. rib->nexthop_active_num is updated accordingly. If any
  * nexthop is found to toggle the ACTIVE flag, the whole rib structure
@@ -896,6 +1276,9 @@ nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
   struct nexthop *nexthop;
   int prev_active, new_active;
 
+  if (rib->nhg)
+    return nexthop_group_update (rn, rib, set);
+
   rib->nexthop_active_num = 0;
   UNSET_FLAG (rib->flags, ZEBRA_FLAG_CHANGED);
 
@@ -912,12 +1295,25 @@ nexthop_active_update (struct route_node *rn, struct rib *rib, int set)
 
 
 
+/* The route is no longer in the FIB.  Shared nexthops keep their FIB
+   flags, for the other routes using them. */
+static void
+rib_fib_clear (struct rib *rib)
+{
+  struct nexthop *nexthop;
+
+  UNSET_FLAG (rib->status, RIB_ENTRY_FIB);
+  if (! rib->nhg)
+    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+      UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+}
+
 static void
 rib_install_kernel (struct route_node *rn, struct rib *rib)
 {
   int ret = 0;
-  struct nexthop *nexthop;
 
+  SET_FLAG (rib->status, RIB_ENTRY_FIB);
   switch (PREFIX_FAMILY (&rn->p))
     {
     case AF_INET:
@@ -932,10 +1328,47 @@ rib_install_kernel (struct route_node *rn, struct rib *rib)
 
   /* This condition is never met, if we are using rt_socket.c */
   if (ret < 0)
-    {
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
-    }
+    rib_fib_clear (rib);
+}
+
+/* The kernel refused, after the fact, to install the route selected for
+   the prefix.  Take the FIB flags off again, and tell clients.  */
+void
+rib_kernel_failed (struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *rn;
+  struct rib *rib;
+
+  table = vrf_table (family2afi (p->family), SAFI_UNICAST, 0);
+  if (! table)
+    return;
+
+  rn = route_node_lookup (table, p);
+  if (! rn)
+    return;
+
+  for (rib = rn->info; rib; rib = rib->next)
+    if (CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
+	&& ! CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED)
+	&& ! RIB_SYSTEM_ROUTE (rib))
+      {
+	if (IS_ZEBRA_DEBUG_RIB)
+	  {
+	    char buf[INET6_ADDRSTRLEN];
+
+	    zlog_debug ("%s: %s/%d not installed in the kernel", __func__,
+			inet_ntop (p->family, &p->u.prefix, buf,
+				   INET6_ADDRSTRLEN), p->prefixlen);
+	  }
+
+	rib_fib_clear (rib);
+	nexthop_epoch++;
+	redistribute_add (&rn->p, rib);
+	break;
+      }
+
+  route_unlock_node (rn);
 }
 
 /* Uninstall the route from kernel. */
@@ -943,7 +1376,6 @@ static int
 rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
 {
   int ret = 0;
-  struct nexthop *nexthop;
 
   switch (PREFIX_FAMILY (&rn->p))
     {
@@ -959,8 +1391,7 @@ rib_uninstall_kernel (struct route_node *rn, struct rib *rib)
 #endif /* HAVE_IPV6 */
     }
 
-  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+  rib_fib_clear (rib);
 
   return ret;
 }
@@ -978,6 +1409,362 @@ rib_uninstall (struct route_node *rn, struct rib *rib)
     }
 }
 
+/* What route nodes depend on for their nexthops to resolve: gateway
+ * addresses, kept as host routes in a table per address family, and
+ * interfaces, by index or by name.  Each keeps the set of route nodes
+ * depending on it, so that interface and address events, and changes
+ * to the route a gateway resolves through, need queue only those nodes
+ * for processing again, not the whole table.
+ *
+ * A node's dependencies are worked out again by rib_process, which is
+ * where it ends up after any change to its RIBs or their nexthops.
+ */
+struct rib_dep
+{
+  /* Node in rib_dep_gate for a gateway, NULL for an interface. */
+  struct route_node *rn;
+  unsigned int ifindex;
+  char *ifname;
+
+  /* Route nodes depending on it. */
+  struct hash *nodes;
+};
+
+/* Dependencies of a route node. */
+struct rib_dep_node
+{
+  struct route_node *rn;
+  unsigned int count;
+  struct rib_dep **deps;
+};
+
+static struct route_table *rib_dep_gate[AFI_MAX];
+static struct hash *rib_dep_if;
+static struct hash *rib_dep_nodes;
+
+static void rib_queue_add (struct zebra_t *, struct route_node *);
+
+static unsigned int
+rib_dep_ptr_key (void *p)
+{
+  return (uintptr_t) p >> 4;
+}
+
+static int
+rib_dep_ptr_cmp (void *a, void *b)
+{
+  return a == b;
+}
+
+static unsigned int
+rib_dep_node_key (void *p)
+{
+  return rib_dep_ptr_key (((struct rib_dep_node *) p)->rn);
+}
+
+static int
+rib_dep_node_cmp (void *a, void *b)
+{
+  return ((struct rib_dep_node *) a)->rn == ((struct rib_dep_node *) b)->rn;
+}
+
+static unsigned int
+rib_dep_if_key (void *p)
+{
+  struct rib_dep *dep = p;
+  unsigned int key = 0;
+  const char *c;
+
+  if (! dep->ifname)
+    return dep->ifindex;
+  for (c = dep->ifname; *c; c++)
+    key = key * 31 + *c;
+  return key;
+}
+
+static int
+rib_dep_if_cmp (void *a, void *b)
+{
+  struct rib_dep *da = a;
+  struct rib_dep *db = b;
+
+  if (da->ifname || db->ifname)
+    return da->ifname && db->ifname && strcmp (da->ifname, db->ifname) == 0;
+  return da->ifindex == db->ifindex;
+}
+
+/* The key a nexthop depends on, in dep.  Returns 0 for a nexthop
+   depending on nothing. */
+static int
+rib_dep_nexthop (struct nexthop *nexthop, struct rib_dep *dep,
+		 struct prefix *gate)
+{
+  memset (dep, 0, sizeof (struct rib_dep));
+  memset (gate, 0, sizeof (struct prefix));
+
+  switch (nexthop->type)
+    {
+    case NEXTHOP_TYPE_IFINDEX:
+      dep->ifindex = nexthop->ifindex;
+      return 1;
+    case NEXTHOP_TYPE_IFNAME:
+    case NEXTHOP_TYPE_IPV6_IFNAME:
+      if (! nexthop->ifname)
+	return 0;
+      dep->ifname = nexthop->ifname;
+      return 1;
+    case NEXTHOP_TYPE_IPV4:
+    case NEXTHOP_TYPE_IPV4_IFINDEX:
+      gate->family = AF_INET;
+      gate->prefixlen = IPV4_MAX_BITLEN;
+      gate->u.prefix4 = nexthop->gate.ipv4;
+      return 1;
+#ifdef HAVE_IPV6
+    case NEXTHOP_TYPE_IPV6_IFINDEX:
+      if (IN6_IS_ADDR_LINKLOCAL (&nexthop->gate.ipv6))
+	{
+	  dep->ifindex = nexthop->ifindex;
+	  return 1;
+	}
+      /* Fall through. */
+    case NEXTHOP_TYPE_IPV6:
+      gate->family = AF_INET6;
+      gate->prefixlen = IPV6_MAX_BITLEN;
+      gate->u.prefix6 = nexthop->gate.ipv6;
+      return 1;
+#endif /* HAVE_IPV6 */
+    default:
+      return 0;
+    }
+}
+
+/* Does the dependency in the node's list match the key? */
+static int
+rib_dep_match (struct rib_dep *dep, struct rib_dep *key, struct prefix *gate)
+{
+  if (gate->family)
+    return dep->rn && prefix_same (&dep->rn->p, gate);
+  return ! dep->rn && rib_dep_if_cmp (dep, key);
+}
+
+static struct rib_dep *
+rib_dep_get (struct rib_dep *key, struct prefix *gate)
+{
+  struct route_node *rn;
+  struct rib_dep *dep;
+
+  if (gate->family)
+    {
+      rn = route_node_get (rib_dep_gate[family2afi (gate->family)], gate);
+      if (rn->info)
+	{
+	  route_unlock_node (rn);
+	  return rn->info;
+	}
+      dep = XCALLOC (MTYPE_RIB_DEP, sizeof (struct rib_dep));
+      dep->rn = rn;
+      rn->info = dep;
+    }
+  else
+    {
+      dep = hash_lookup (rib_dep_if, key);
+      if (dep)
+	return dep;
+      dep = XCALLOC (MTYPE_RIB_DEP, sizeof (struct rib_dep));
+      dep->ifindex = key->ifindex;
+      if (key->ifname)
+	dep->ifname = XSTRDUP (MTYPE_RIB_DEP, key->ifname);
+      hash_get (rib_dep_if, dep, hash_alloc_intern);
+    }
+  dep->nodes = hash_create (rib_dep_ptr_key, rib_dep_ptr_cmp);
+  return dep;
+}
+
+static void
+rib_dep_release (struct rib_dep *dep, struct route_node *rn)
+{
+  hash_release (dep->nodes, rn);
+  if (dep->nodes->count)
+    return;
+
+  hash_free (dep->nodes);
+  if (dep->rn)
+    {
+      dep->rn->info = NULL;
+      route_unlock_node (dep->rn);
+    }
+  else
+    {
+      hash_release (rib_dep_if, dep);
+      if (dep->ifname)
+	XFREE (MTYPE_RIB_DEP, dep->ifname);
+    }
+  XFREE (MTYPE_RIB_DEP, dep);
+}
+
+/* Work out again what the route node depends on, from the nexthops of
+   its RIBs. */
+static void
+rib_dep_update (struct route_node *rn)
+{
+  struct rib_dep_node lookup;
+  struct rib_dep_node *dn;
+  struct rib_dep **deps = NULL;
+  struct rib_dep key;
+  struct prefix gate;
+  struct rib *rib;
+  struct nexthop *nexthop;
+  unsigned int count = 0;
+  unsigned int size = 0;
+  unsigned int i;
+  int same = 1;
+
+  lookup.rn = rn;
+  dn = hash_lookup (rib_dep_nodes, &lookup);
+
+  for (rib = rn->info; rib; rib = rib->next)
+    {
+      if (CHECK_FLAG (rib->status, RIB_ENTRY_REMOVED))
+	continue;
+
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	{
+	  struct rib_dep *dep = NULL;
+
+	  if (! rib_dep_nexthop (nexthop, &key, &gate))
+	    continue;
+
+	  for (i = 0; i < count; i++)
+	    if (rib_dep_match (deps[i], &key, &gate))
+	      break;
+	  if (i < count)
+	    continue;
+
+	  /* Usually it is what the node depended on before. */
+	  if (dn)
+	    for (i = 0; i < dn->count && ! dep; i++)
+	      if (rib_dep_match (dn->deps[i], &key, &gate))
+		dep = dn->deps[i];
+	  if (! dep)
+	    {
+	      dep = rib_dep_get (&key, &gate);
+	      same = 0;
+	    }
+
+	  if (count == size)
+	    {
+	      size = size ? size * 2 : 4;
+	      deps = XREALLOC (MTYPE_RIB_DEP, deps,
+			       size * sizeof (struct rib_dep *));
+	    }
+	  deps[count++] = dep;
+	}
+    }
+
+  if (same && dn && dn->count == count)
+    {
+      if (deps)
+	XFREE (MTYPE_RIB_DEP, deps);
+      return;
+    }
+  if (! dn && ! count)
+    return;
+
+  /* Add the new ones before letting go of the old, so what stays is
+     not freed in between. */
+  for (i = 0; i < count; i++)
+    hash_get (deps[i]->nodes, rn, hash_alloc_intern);
+
+  if (dn)
+    {
+      for (i = 0; i < dn->count; i++)
+	{
+	  unsigned int j;
+
+	  for (j = 0; j < count; j++)
+	    if (deps[j] == dn->deps[i])
+	      break;
+	  if (j == count)
+	    rib_dep_release (dn->deps[i], rn);
+	}
+      if (dn->deps)
+	XFREE (MTYPE_RIB_DEP, dn->deps);
+    }
+
+  if (! count)
+    {
+      hash_release (rib_dep_nodes, dn);
+      XFREE (MTYPE_RIB_DEP, dn);
+      return;
+    }
+
+  if (! dn)
+    {
+      dn = XCALLOC (MTYPE_RIB_DEP, sizeof (struct rib_dep_node));
+      dn->rn = rn;
+      hash_get (rib_dep_nodes, dn, hash_alloc_intern);
+    }
+  dn->deps = deps;
+  dn->count = count;
+}
+
+static void
+rib_dep_queue_node (struct hash_backet *backet, void *arg)
+{
+  rib_queue_add (&zebrad, backet->data);
+}
+
+static void
+rib_dep_queue (struct rib_dep *dep)
+{
+  hash_iterate (dep->nodes, rib_dep_queue_node, NULL);
+}
+
+/* The selected route for p has changed, so may have the resolution of
+   gateways under it: queue the nodes using them. */
+static void
+rib_dep_changed (struct prefix *p)
+{
+  struct route_table *table;
+  struct route_node *top;
+  struct route_node *rn;
+
+  nexthop_epoch++;
+
+  table = rib_dep_gate[family2afi (p->family)];
+  if (! table || ! table->top)
+    return;
+
+  /* Held until the end, or the walk could go past it once it goes. */
+  top = route_node_get (table, p);
+  route_lock_node (top);
+  for (rn = top; rn; rn = route_next_until (rn, top))
+    if (rn->info)
+      rib_dep_queue (rn->info);
+  route_unlock_node (top);
+}
+
+/* The interface went up or down: queue the nodes with nexthops on it.
+   Nodes using gateways through it follow once its connected routes
+   have been processed. */
+void
+rib_update_interface (struct interface *ifp)
+{
+  struct rib_dep key;
+  struct rib_dep *dep;
+
+  nexthop_epoch++;
+
+  memset (&key, 0, sizeof (struct rib_dep));
+  key.ifindex = ifp->ifindex;
+  if ((dep = hash_lookup (rib_dep_if, &key)) != NULL)
+    rib_dep_queue (dep);
+
+  key.ifname = ifp->name;
+  if ((dep = hash_lookup (rib_dep_if, &key)) != NULL)
+    rib_dep_queue (dep);
+}
+
 static void rib_unlink (struct route_node *, struct rib *);
 
 /* Core function for processing routing information base. */
@@ -990,6 +1777,7 @@ rib_process (struct route_node *rn)
   struct rib *select = NULL;
   struct rib *del = NULL;
   int installed = 0;
+  int changed = 0;
   struct nexthop *nexthop = NULL;
   char buf[INET6_ADDRSTRLEN];
   
@@ -1106,6 +1894,7 @@ rib_process (struct route_node *rn)
           if (! RIB_SYSTEM_ROUTE (select))
             rib_install_kernel (rn, select);
           redistribute_add (&rn->p, select);
+          changed = (select->type != ZEBRA_ROUTE_BGP);
         }
       else if (! RIB_SYSTEM_ROUTE (select))
         {
@@ -1117,7 +1906,7 @@ rib_process (struct route_node *rn)
            */
 
           for (nexthop = select->nexthop; nexthop; nexthop = nexthop->next)
-            if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+            if (RIB_NEXTHOP_FIB (select, nexthop))
             {
               installed = 1;
               break;
@@ -1144,6 +1933,7 @@ rib_process (struct route_node *rn)
 
       /* Set real nexthop. */
       nexthop_active_update (rn, fib, 1);
+      changed = (fib->type != ZEBRA_ROUTE_BGP);
     }
 
   /* Regardless of some RIB entry being SELECTED or not before, now we can
@@ -1162,6 +1952,8 @@ rib_process (struct route_node *rn)
         rib_install_kernel (rn, select);
       SET_FLAG (select->flags, ZEBRA_FLAG_SELECTED);
       redistribute_add (&rn->p, select);
+      if (select->type != ZEBRA_ROUTE_BGP)
+        changed = 1;
     }
 
   /* FIB route was removed, should be deleted */
@@ -1174,6 +1966,13 @@ rib_process (struct route_node *rn)
     }
 
 end:
+  rib_dep_update (rn);
+
+  /* Set above where the selected route changed, unless only BGP routes
+     were involved, gateways are not resolved through those. */
+  if (changed)
+    rib_dep_changed (&rn->p);
+
   if (IS_ZEBRA_DEBUG_RIB_Q)
     zlog_debug ("%s: %s/%d: rn %p dequeued", __func__, buf, rn->p.prefixlen, rn);
 }
@@ -1340,6 +2139,13 @@ meta_queue_new ()
   return new;
 }
 
+/* The work queue has run dry, pass what it did on to the kernel. */
+static void
+rib_queue_complete (struct work_queue *wq)
+{
+  kernel_flush ();
+}
+
 /* initialise zebra rib work queue */
 static void
 rib_queue_init (struct zebra_t *zebra)
@@ -1356,6 +2162,7 @@ rib_queue_init (struct zebra_t *zebra)
   /* fill in the work queue spec */
   zebra->ribq->spec.workfunc = &meta_queue_process;
   zebra->ribq->spec.errorfunc = NULL;
+  zebra->ribq->spec.completion_func = &rib_queue_complete;
   /* XXX: TODO: These should be runtime configurable via vty */
   zebra->ribq->spec.max_retries = 3;
   zebra->ribq->spec.hold = rib_process_hold_time;
@@ -1460,10 +2267,20 @@ rib_addnode (struct route_node *rn, struct rib *rib)
   rib_link (rn, rib);
 }
 
+/* Free RIB and nexthops. */
+void
+rib_free (struct rib *rib)
+{
+  if (rib->nhg)
+    nexthop_group_release (rib);
+  else
+    nexthop_list_free (rib->nexthop);
+  XFREE (MTYPE_RIB, rib);
+}
+
 static void
 rib_unlink (struct route_node *rn, struct rib *rib)
 {
-  struct nexthop *nexthop, *next;
   char buf[INET6_ADDRSTRLEN];
 
   assert (rn && rib);
@@ -1493,13 +2310,7 @@ rib_unlink (struct route_node *rn, struct rib *rib)
         }
     }
 
-  /* free RIB and nexthops */
-  for (nexthop = rib->nexthop; nexthop; nexthop = next)
-    {
-      next = nexthop->next;
-      nexthop_free (nexthop);
-    }
-  XFREE (MTYPE_RIB, rib);
+  rib_free (rib);
 
   route_unlock_node (rn); /* rn route table reference */
 }
@@ -1599,8 +2410,13 @@ rib_add_ipv4 (int type, int flags, struct prefix_ipv4 *p,
 
   /* If this route is kernel route, set FIB flag to the route. */
   if (type == ZEBRA_ROUTE_KERNEL || type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    {
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      SET_FLAG (rib->status, RIB_ENTRY_FIB);
+    }
+  else
+    nexthop_group_intern (rib, AF_INET);
 
   /* Link new rib to node.*/
   if (IS_ZEBRA_DEBUG_RIB)
@@ -1668,7 +2484,7 @@ void rib_dump (const char * func, const struct prefix_ipv4 * p, const struct rib
       straddr1,
       straddr2,
       (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_ACTIVE) ? "ACTIVE " : ""),
-      (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? "FIB " : ""),
+      (RIB_NEXTHOP_FIB (rib, nexthop) ? "FIB " : ""),
       (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_RECURSIVE) ? "RECURSIVE" : "")
     );
   }
@@ -1819,8 +2635,13 @@ rib_add_ipv4_multipath (struct prefix_ipv4 *p, struct rib *rib)
   
   /* If this route is kernel route, set FIB flag to the route. */
   if (rib->type == ZEBRA_ROUTE_KERNEL || rib->type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    {
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      SET_FLAG (rib->status, RIB_ENTRY_FIB);
+    }
+  else
+    nexthop_group_intern (rib, AF_INET);
 
   /* Link new rib to node.*/
   rib_addnode (rn, rib);
@@ -1939,8 +2760,7 @@ rib_delete_ipv4 (int type, int flags, struct prefix_ipv4 *p,
       if (fib && type == ZEBRA_ROUTE_KERNEL)
 	{
 	  /* Unset flags. */
-	  for (nexthop = fib->nexthop; nexthop; nexthop = nexthop->next)
-	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	  rib_fib_clear (fib);
 
 	  UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 	}
@@ -2116,7 +2936,7 @@ static_uninstall_ipv4 (struct prefix *p, struct static_ipv4 *si)
     rib_delnode (rn, rib);
   else
     {
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      if (RIB_NEXTHOP_FIB (rib, nexthop))
         rib_uninstall (rn, rib);
       nexthop_delete (rib, nexthop);
       nexthop_free (nexthop);
@@ -2389,8 +3209,13 @@ rib_add_ipv6 (int type, int flags, struct prefix_ipv6 *p,
 
   /* If this route is kernel route, set FIB flag to the route. */
   if (type == ZEBRA_ROUTE_KERNEL || type == ZEBRA_ROUTE_CONNECT)
-    for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-      SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+    {
+      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+	SET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+      SET_FLAG (rib->status, RIB_ENTRY_FIB);
+    }
+  else
+    nexthop_group_intern (rib, AF_INET6);
 
   /* Link new rib to node.*/
   rib_addnode (rn, rib);
@@ -2488,8 +3313,7 @@ rib_delete_ipv6 (int type, int flags, struct prefix_ipv6 *p,
       if (fib && type == ZEBRA_ROUTE_KERNEL)
 	{
 	  /* Unset flags. */
-	  for (nexthop = fib->nexthop; nexthop; nexthop = nexthop->next)
-	    UNSET_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB);
+	  rib_fib_clear (fib);
 
 	  UNSET_FLAG (fib->flags, ZEBRA_FLAG_SELECTED);
 	}
@@ -2669,7 +3493,7 @@ static_uninstall_ipv6 (struct prefix *p, struct static_ipv6 *si)
     }
   else
     {
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      if (RIB_NEXTHOP_FIB (rib, nexthop))
         rib_uninstall (rn, rib);
       nexthop_delete (rib, nexthop);
       nexthop_free (nexthop);
@@ -2829,6 +3653,8 @@ rib_update (void)
   struct route_node *rn;
   struct route_table *table;
   
+  nexthop_epoch++;
+
   table = vrf_table (AFI_IP, SAFI_UNICAST, 0);
   if (table)
     for (rn = route_top (table); rn; rn = route_next (rn))
@@ -2841,20 +3667,6 @@ rib_update (void)
       if (rn->info)
         rib_queue_add (&zebrad, rn);
 }
-
-/* Interface goes up. */
-static void
-rib_if_up (struct interface *ifp)
-{
-  rib_update ();
-}
-
-/* Interface goes down. */
-static void
-rib_if_down (struct interface *ifp)
-{
-  rib_update ();
-}
 
 /* Remove all routes which comes from non main table.  */
 static void
@@ -2921,6 +3733,7 @@ rib_sweep_route (void)
 {
   rib_sweep_table (vrf_table (AFI_IP, SAFI_UNICAST, 0));
   rib_sweep_table (vrf_table (AFI_IP6, SAFI_UNICAST, 0));
+  kernel_flush ();
 }
 
 /* Close RIB and clean up kernel routes. */
@@ -2946,6 +3759,7 @@ rib_close (void)
 {
   rib_close_table (vrf_table (AFI_IP, SAFI_UNICAST, 0));
   rib_close_table (vrf_table (AFI_IP6, SAFI_UNICAST, 0));
+  kernel_flush ();
 }
 
 /* Routing information base initialize. */
@@ -2955,4 +3769,13 @@ rib_init (void)
   rib_queue_init (&zebrad);
   /* VRF initialization.  */
   vrf_init ();
+
+  rib_dep_gate[AFI_IP] = route_table_init ();
+#ifdef HAVE_IPV6
+  rib_dep_gate[AFI_IP6] = route_table_init ();
+#endif /* HAVE_IPV6 */
+  rib_dep_if = hash_create (rib_dep_if_key, rib_dep_if_cmp);
+  rib_dep_nodes = hash_create (rib_dep_node_key, rib_dep_node_cmp);
+  nexthop_caches = hash_create (nexthop_cache_key, nexthop_cache_cmp);
+  nexthop_groups = hash_create (nexthop_group_key, nexthop_group_cmp);
 }
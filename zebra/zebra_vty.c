@@ -586,7 +586,7 @@ vty_show_ip_route_detail (struct vty *vty, struct route_node *rn)
           char addrstr[32];
 
 	  vty_out (vty, "  %c",
-		   CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? '*' : ' ');
+		   RIB_NEXTHOP_FIB (rib, nexthop) ? '*' : ' ');
 
 	  switch (nexthop->type)
 	    {
@@ -681,7 +681,7 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
 			 zebra_route_char (rib->type),
 			 CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
 			 ? '>' : ' ',
-			 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+			 RIB_NEXTHOP_FIB (rib, nexthop)
 			 ? '*' : ' ',
 			 inet_ntop (AF_INET, &rn->p.u.prefix, buf, BUFSIZ),
 			 rn->p.prefixlen);
@@ -694,7 +694,7 @@ vty_show_ip_route (struct vty *vty, struct route_node *rn, struct rib *rib)
 	}
       else
 	vty_out (vty, "  %c%*c",
-		 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+		 RIB_NEXTHOP_FIB (rib, nexthop)
 		 ? '*' : ' ',
 		 len - 3, ' ');
 
@@ -1555,7 +1555,7 @@ vty_show_ipv6_route_detail (struct vty *vty, struct route_node *rn)
       for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
 	{
 	  vty_out (vty, "  %c",
-		   CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB) ? '*' : ' ');
+		   RIB_NEXTHOP_FIB (rib, nexthop) ? '*' : ' ');
 
 	  switch (nexthop->type)
 	    {
@@ -1631,7 +1631,7 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
 			 zebra_route_char (rib->type),
 			 CHECK_FLAG (rib->flags, ZEBRA_FLAG_SELECTED)
 			 ? '>' : ' ',
-			 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+			 RIB_NEXTHOP_FIB (rib, nexthop)
 			 ? '*' : ' ',
 			 inet_ntop (AF_INET6, &rn->p.u.prefix6, buf, BUFSIZ),
 			 rn->p.prefixlen);
@@ -1644,7 +1644,7 @@ vty_show_ipv6_route (struct vty *vty, struct route_node *rn,
 	}
       else
 	vty_out (vty, "  %c%*c",
-		 CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB)
+		 RIB_NEXTHOP_FIB (rib, nexthop)
 		 ? '*' : ' ',
 		 len - 3, ' ');
 
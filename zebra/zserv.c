@@ -42,10 +42,14 @@
 #include "zebra/redistribute.h"
 #include "zebra/debug.h"
 #include "zebra/ipforward.h"
+#include "zebra/zebra_nht.h"
 
 /* Event list of zebra. */
 enum event { ZEBRA_SERV, ZEBRA_READ, ZEBRA_WRITE };
 
+/* Size of a client's read buffer, room for many messages. */
+#define ZSERV_RBUF_SIZE (16 * ZEBRA_MAX_PACKET_SIZ)
+
 extern struct zebra_t zebrad;
 
 static void zebra_event (enum event event, int sock, struct zserv *client);
@@ -85,8 +89,10 @@ zserv_flush_data(struct thread *thread)
     case BUFFER_PENDING:
       client->t_write = thread_add_write(zebrad.master, zserv_flush_data,
       					 client, client->sock);
+      zebra_redistribute_resume (client);
       break;
     case BUFFER_EMPTY:
+      zebra_redistribute_resume (client);
       break;
     }
   return 0;
@@ -400,7 +406,7 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
   
   for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
     {
-      if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+      if (RIB_NEXTHOP_FIB (rib, nexthop))
         {
           SET_FLAG (zapi_flags, ZAPI_MESSAGE_NEXTHOP);
           SET_FLAG (zapi_flags, ZAPI_MESSAGE_IFINDEX);
@@ -472,15 +478,65 @@ zsend_route_multipath (int cmd, struct zserv *client, struct prefix *p,
   return zebra_server_send_message(client);
 }
 
+/* Put the metric and the nexthops in the FIB of a route resolving a
+   nexthop, or a zero metric and no nexthops if there is none, as in
+   replies to nexthop lookups and in ZEBRA_NEXTHOP_UPDATE.  */
+void
+zserv_nexthop_encode (struct stream *s, struct rib *rib)
+{
+  unsigned long nump;
+  u_char num;
+  struct nexthop *nexthop;
+
+  if (! rib)
+    {
+      stream_putl (s, 0);
+      stream_putc (s, 0);
+      return;
+    }
+
+  stream_putl (s, rib->metric);
+  num = 0;
+  nump = stream_get_endp(s);
+  stream_putc (s, 0);
+  for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
+    if (RIB_NEXTHOP_FIB (rib, nexthop))
+      {
+	stream_putc (s, nexthop->type);
+	switch (nexthop->type)
+	  {
+	  case ZEBRA_NEXTHOP_IPV4:
+	    stream_put_in_addr (s, &nexthop->gate.ipv4);
+	    break;
+#ifdef HAVE_IPV6
+	  case ZEBRA_NEXTHOP_IPV6:
+	    stream_put (s, &nexthop->gate.ipv6, 16);
+	    break;
+	  case ZEBRA_NEXTHOP_IPV6_IFINDEX:
+	  case ZEBRA_NEXTHOP_IPV6_IFNAME:
+	    stream_put (s, &nexthop->gate.ipv6, 16);
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+#endif /* HAVE_IPV6 */
+	  case ZEBRA_NEXTHOP_IFINDEX:
+	  case ZEBRA_NEXTHOP_IFNAME:
+	    stream_putl (s, nexthop->ifindex);
+	    break;
+	  default:
+	    /* do nothing */
+	    break;
+	  }
+	num++;
+      }
+  stream_putc_at (s, nump, num);
+}
+
 #ifdef HAVE_IPV6
 static int
 zsend_ipv6_nexthop_lookup (struct zserv *client, struct in6_addr *addr)
 {
   struct stream *s;
   struct rib *rib;
-  unsigned long nump;
-  u_char num;
-  struct nexthop *nexthop;
 
   /* Lookup nexthop. */
   rib = rib_match_ipv6 (addr);
@@ -492,44 +548,7 @@ zsend_ipv6_nexthop_lookup (struct zserv *client, struct in6_addr *addr)
   /* Fill in result. */
   zserv_create_header (s, ZEBRA_IPV6_NEXTHOP_LOOKUP);
   stream_put (s, &addr, 16);
-
-  if (rib)
-    {
-      stream_putl (s, rib->metric);
-      num = 0;
-      nump = stream_get_endp(s);
-      stream_putc (s, 0);
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
-	  {
-	    stream_putc (s, nexthop->type);
-	    switch (nexthop->type)
-	      {
-	      case ZEBRA_NEXTHOP_IPV6:
-		stream_put (s, &nexthop->gate.ipv6, 16);
-		break;
-	      case ZEBRA_NEXTHOP_IPV6_IFINDEX:
-	      case ZEBRA_NEXTHOP_IPV6_IFNAME:
-		stream_put (s, &nexthop->gate.ipv6, 16);
-		stream_putl (s, nexthop->ifindex);
-		break;
-	      case ZEBRA_NEXTHOP_IFINDEX:
-	      case ZEBRA_NEXTHOP_IFNAME:
-		stream_putl (s, nexthop->ifindex);
-		break;
-	      default:
-                /* do nothing */
-		break;
-	      }
-	    num++;
-	  }
-      stream_putc_at (s, nump, num);
-    }
-  else
-    {
-      stream_putl (s, 0);
-      stream_putc (s, 0);
-    }
+  zserv_nexthop_encode (s, rib);
 
   stream_putw_at (s, 0, stream_get_endp (s));
   
@@ -542,9 +561,6 @@ zsend_ipv4_nexthop_lookup (struct zserv *client, struct in_addr addr)
 {
   struct stream *s;
   struct rib *rib;
-  unsigned long nump;
-  u_char num;
-  struct nexthop *nexthop;
 
   /* Lookup nexthop. */
   rib = rib_match_ipv4 (addr);
@@ -556,39 +572,7 @@ zsend_ipv4_nexthop_lookup (struct zserv *client, struct in_addr addr)
   /* Fill in result. */
   zserv_create_header (s, ZEBRA_IPV4_NEXTHOP_LOOKUP);
   stream_put_in_addr (s, &addr);
-
-  if (rib)
-    {
-      stream_putl (s, rib->metric);
-      num = 0;
-      nump = stream_get_endp(s);
-      stream_putc (s, 0);
-      for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
-	  {
-	    stream_putc (s, nexthop->type);
-	    switch (nexthop->type)
-	      {
-	      case ZEBRA_NEXTHOP_IPV4:
-		stream_put_in_addr (s, &nexthop->gate.ipv4);
-		break;
-	      case ZEBRA_NEXTHOP_IFINDEX:
-	      case ZEBRA_NEXTHOP_IFNAME:
-		stream_putl (s, nexthop->ifindex);
-		break;
-	      default:
-                /* do nothing */
-		break;
-	      }
-	    num++;
-	  }
-      stream_putc_at (s, nump, num);
-    }
-  else
-    {
-      stream_putl (s, 0);
-      stream_putc (s, 0);
-    }
+  zserv_nexthop_encode (s, rib);
 
   stream_putw_at (s, 0, stream_get_endp (s));
   
@@ -622,7 +606,7 @@ zsend_ipv4_import_lookup (struct zserv *client, struct prefix_ipv4 *p)
       nump = stream_get_endp(s);
       stream_putc (s, 0);
       for (nexthop = rib->nexthop; nexthop; nexthop = nexthop->next)
-	if (CHECK_FLAG (nexthop->flags, NEXTHOP_FLAG_FIB))
+	if (RIB_NEXTHOP_FIB (rib, nexthop))
 	  {
 	    stream_putc (s, nexthop->type);
 	    switch (nexthop->type)
@@ -682,6 +666,27 @@ zsend_router_id_update (struct zserv *client, struct prefix *p)
   return zebra_server_send_message(client);
 }
 
+/* Tell the client how a nexthop it registered now resolves.  data is
+   what zserv_nexthop_encode put for it.  */
+int
+zsend_nexthop_update (struct zserv *client, struct prefix *p,
+		      u_char *data, size_t size)
+{
+  struct stream *s;
+
+  s = client->obuf;
+  stream_reset (s);
+
+  zserv_create_header (s, ZEBRA_NEXTHOP_UPDATE);
+  stream_putc (s, p->family);
+  stream_put (s, &p->u.prefix, prefix_blen (p));
+  stream_put (s, data, size);
+
+  stream_putw_at (s, 0, stream_get_endp (s));
+
+  return zebra_server_send_message(client);
+}
+
 /* Register zebra server interface information.  Send current all
    interface and address information. */
 static int
@@ -723,43 +728,18 @@ zread_interface_delete (struct zserv *client, u_short length)
   return 0;
 }
 
-/* This function support multiple nexthop. */
-/* 
- * Parse the ZEBRA_IPV4_ROUTE_ADD sent from client. Update rib and
- * add kernel route. 
- */
-static int
-zread_ipv4_add (struct zserv *client, u_short length)
+/* Read the nexthops, distance and metric of an IPv4 route into rib.
+   This function support multiple nexthop. */
+static void
+zread_ipv4_nexthops (struct stream *s, u_char message, struct rib *rib)
 {
   int i;
-  struct rib *rib;
-  struct prefix_ipv4 p;
-  u_char message;
   struct in_addr nexthop;
   u_char nexthop_num;
   u_char nexthop_type;
-  struct stream *s;
   unsigned int ifindex;
   u_char ifname_len;
 
-  /* Get input stream.  */
-  s = client->ibuf;
-
-  /* Allocate new rib. */
-  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
-  
-  /* Type, flags, message. */
-  rib->type = stream_getc (s);
-  rib->flags = stream_getc (s);
-  message = stream_getc (s); 
-  rib->uptime = time (NULL);
-
-  /* IPv4 prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv4));
-  p.family = AF_INET;
-  p.prefixlen = stream_getc (s);
-  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
-
   /* Nexthop parse. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_NEXTHOP))
     {
@@ -800,35 +780,31 @@ zread_ipv4_add (struct zserv *client, u_short length)
   /* Metric. */
   if (CHECK_FLAG (message, ZAPI_MESSAGE_METRIC))
     rib->metric = stream_getl (s);
-    
-  /* Table */
-  rib->table=zebrad.rtm_table_default;
-  rib_add_ipv4_multipath (&p, rib);
-  return 0;
 }
 
-/* Zebra server IPv4 prefix delete function. */
+/* 
+ * Parse the ZEBRA_IPV4_ROUTE_ADD sent from client. Update rib and
+ * add kernel route. 
+ */
 static int
-zread_ipv4_delete (struct zserv *client, u_short length)
+zread_ipv4_add (struct zserv *client, u_short length)
 {
-  int i;
-  struct stream *s;
-  struct zapi_ipv4 api;
-  struct in_addr nexthop;
-  unsigned long ifindex;
+  struct rib *rib;
   struct prefix_ipv4 p;
-  u_char nexthop_num;
-  u_char nexthop_type;
-  u_char ifname_len;
-  
+  u_char message;
+  struct stream *s;
+
+  /* Get input stream.  */
   s = client->ibuf;
-  ifindex = 0;
-  nexthop.s_addr = 0;
 
+  /* Allocate new rib. */
+  rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+  
   /* Type, flags, message. */
-  api.type = stream_getc (s);
-  api.flags = stream_getc (s);
-  api.message = stream_getc (s);
+  rib->type = stream_getc (s);
+  rib->flags = stream_getc (s);
+  message = stream_getc (s); 
+  rib->uptime = time (NULL);
 
   /* IPv4 prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv4));
@@ -836,8 +812,128 @@ zread_ipv4_delete (struct zserv *client, u_short length)
   p.prefixlen = stream_getc (s);
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
+  zread_ipv4_nexthops (s, message, rib);
+    
+  /* Table */
+  rib->table=zebrad.rtm_table_default;
+  rib_add_ipv4_multipath (&p, rib);
+  return 0;
+}
+
+/* Read the prefix count of a group in a bulk message, checking it
+   against what is left of the message. */
+static u_int16_t
+zread_bulk_count (struct stream *s)
+{
+  if (STREAM_READABLE (s) < 2)
+    return 0;
+  return stream_getw (s);
+}
+
+/* Read the next prefix of a group in a bulk message.  Returns 0 if the
+   message is malformed. */
+static int
+zread_bulk_prefix (struct stream *s, struct prefix *p, int family)
+{
+  memset (p, 0, sizeof (struct prefix));
+  p->family = family;
+  if (STREAM_READABLE (s) < 1)
+    return 0;
+  p->prefixlen = stream_getc (s);
+  if (p->prefixlen > prefix_blen (p) * 8
+      || STREAM_READABLE (s) < (size_t) PSIZE (p->prefixlen))
+    return 0;
+  stream_get (&p->u.prefix, s, PSIZE (p->prefixlen));
+  return 1;
+}
+
+/* Parse ZEBRA_IPV4_ROUTE_ADD_BULK, a route added for each prefix of
+   each group, see zclient_route_bulk. */
+static int
+zread_ipv4_add_bulk (struct zserv *client, u_short length)
+{
+  struct stream *s = client->ibuf;
+  struct rib *group;
+  struct rib *rib;
+  struct nexthop *nexthop;
+  struct prefix p;
+  u_char message;
+  u_int16_t count;
+
+  while (STREAM_READABLE (s) >= 3)
+    {
+      group = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+      group->type = stream_getc (s);
+      group->flags = stream_getc (s);
+      message = stream_getc (s);
+      group->uptime = time (NULL);
+      group->table = zebrad.rtm_table_default;
+      zread_ipv4_nexthops (s, message, group);
+
+      /* The group's rib goes to the last prefix, the others get a copy
+         of it. */
+      for (count = zread_bulk_count (s); count; count--)
+	{
+	  if (! zread_bulk_prefix (s, &p, AF_INET))
+	    break;
+
+	  if (count == 1)
+	    {
+	      rib = group;
+	      group = NULL;
+	    }
+	  else
+	    {
+	      rib = XCALLOC (MTYPE_RIB, sizeof (struct rib));
+	      rib->type = group->type;
+	      rib->flags = group->flags;
+	      rib->distance = group->distance;
+	      rib->metric = group->metric;
+	      rib->uptime = group->uptime;
+	      rib->table = group->table;
+	      for (nexthop = group->nexthop; nexthop; nexthop = nexthop->next)
+		switch (nexthop->type)
+		  {
+		  case NEXTHOP_TYPE_IFINDEX:
+		    nexthop_ifindex_add (rib, nexthop->ifindex);
+		    break;
+		  case NEXTHOP_TYPE_IPV4:
+		    nexthop_ipv4_add (rib, &nexthop->gate.ipv4, NULL);
+		    break;
+		  case NEXTHOP_TYPE_BLACKHOLE:
+		    nexthop_blackhole_add (rib);
+		    break;
+		  }
+	    }
+	  rib_add_ipv4_multipath ((struct prefix_ipv4 *) &p, rib);
+	}
+
+      if (group)
+	{
+	  zlog_warn ("%s: malformed message from client %d", __func__,
+		     client->sock);
+	  rib_free (group);
+	  return -1;
+	}
+    }
+  return 0;
+}
+
+/* Read the nexthop, distance and metric of an IPv4 route to delete. */
+static void
+zread_ipv4_delete_nexthop (struct stream *s, struct zapi_ipv4 *api,
+			   struct in_addr *nexthop, unsigned long *ifindex)
+{
+  int i;
+  u_char nexthop_num;
+  u_char nexthop_type;
+  u_char ifname_len;
+
+  *ifindex = 0;
+  nexthop->s_addr = 0;
+
   /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
       nexthop_num = stream_getc (s);
 
@@ -848,14 +944,14 @@ zread_ipv4_delete (struct zserv *client, u_short length)
 	  switch (nexthop_type)
 	    {
 	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
+	      *ifindex = stream_getl (s);
 	      break;
 	    case ZEBRA_NEXTHOP_IFNAME:
 	      ifname_len = stream_getc (s);
 	      stream_forward_getp (s, ifname_len);
 	      break;
 	    case ZEBRA_NEXTHOP_IPV4:
-	      nexthop.s_addr = stream_get_ipv4 (s);
+	      nexthop->s_addr = stream_get_ipv4 (s);
 	      break;
 	    case ZEBRA_NEXTHOP_IPV6:
 	      stream_forward_getp (s, IPV6_MAX_BYTELEN);
@@ -865,22 +961,81 @@ zread_ipv4_delete (struct zserv *client, u_short length)
     }
 
   /* Distance. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
+    api->distance = stream_getc (s);
   else
-    api.distance = 0;
+    api->distance = 0;
 
   /* Metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
+    api->metric = stream_getl (s);
   else
-    api.metric = 0;
+    api->metric = 0;
+}
+
+/* Zebra server IPv4 prefix delete function. */
+static int
+zread_ipv4_delete (struct zserv *client, u_short length)
+{
+  struct stream *s;
+  struct zapi_ipv4 api;
+  struct in_addr nexthop;
+  unsigned long ifindex;
+  struct prefix_ipv4 p;
+  
+  s = client->ibuf;
+
+  /* Type, flags, message. */
+  api.type = stream_getc (s);
+  api.flags = stream_getc (s);
+  api.message = stream_getc (s);
+
+  /* IPv4 prefix. */
+  memset (&p, 0, sizeof (struct prefix_ipv4));
+  p.family = AF_INET;
+  p.prefixlen = stream_getc (s);
+  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+
+  zread_ipv4_delete_nexthop (s, &api, &nexthop, &ifindex);
     
   rib_delete_ipv4 (api.type, api.flags, &p, &nexthop, ifindex,
 		   client->rtm_table);
   return 0;
 }
 
+/* Parse ZEBRA_IPV4_ROUTE_DELETE_BULK. */
+static int
+zread_ipv4_delete_bulk (struct zserv *client, u_short length)
+{
+  struct stream *s = client->ibuf;
+  struct zapi_ipv4 api;
+  struct in_addr nexthop;
+  unsigned long ifindex;
+  struct prefix p;
+  u_int16_t count;
+
+  while (STREAM_READABLE (s) >= 3)
+    {
+      api.type = stream_getc (s);
+      api.flags = stream_getc (s);
+      api.message = stream_getc (s);
+      zread_ipv4_delete_nexthop (s, &api, &nexthop, &ifindex);
+
+      for (count = zread_bulk_count (s); count; count--)
+	{
+	  if (! zread_bulk_prefix (s, &p, AF_INET))
+	    {
+	      zlog_warn ("%s: malformed message from client %d", __func__,
+			 client->sock);
+	      return -1;
+	    }
+	  rib_delete_ipv4 (api.type, api.flags, (struct prefix_ipv4 *) &p,
+			   &nexthop, ifindex, client->rtm_table);
+	}
+    }
+  return 0;
+}
+
 /* Nexthop lookup for IPv4. */
 static int
 zread_ipv4_nexthop_lookup (struct zserv *client, u_short length)
@@ -905,78 +1060,67 @@ zread_ipv4_import_lookup (struct zserv *client, u_short length)
 }
 
 #ifdef HAVE_IPV6
-/* Zebra server IPv6 prefix add function. */
-static int
-zread_ipv6_add (struct zserv *client, u_short length)
+/* Read the nexthop, distance and metric of an IPv6 route. */
+static void
+zread_ipv6_nexthop (struct stream *s, struct zapi_ipv6 *api,
+		    struct in6_addr *nexthop, unsigned long *ifindex)
 {
   int i;
-  struct stream *s;
-  struct zapi_ipv6 api;
-  struct in6_addr nexthop;
-  unsigned long ifindex;
-  struct prefix_ipv6 p;
-  
-  s = client->ibuf;
-  ifindex = 0;
-  memset (&nexthop, 0, sizeof (struct in6_addr));
-
-  /* Type, flags, message. */
-  api.type = stream_getc (s);
-  api.flags = stream_getc (s);
-  api.message = stream_getc (s);
 
-  /* IPv4 prefix. */
-  memset (&p, 0, sizeof (struct prefix_ipv6));
-  p.family = AF_INET6;
-  p.prefixlen = stream_getc (s);
-  stream_get (&p.prefix, s, PSIZE (p.prefixlen));
+  *ifindex = 0;
+  memset (nexthop, 0, sizeof (struct in6_addr));
 
   /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_NEXTHOP))
     {
       u_char nexthop_type;
 
-      api.nexthop_num = stream_getc (s);
-      for (i = 0; i < api.nexthop_num; i++)
+      api->nexthop_num = stream_getc (s);
+      for (i = 0; i < api->nexthop_num; i++)
 	{
 	  nexthop_type = stream_getc (s);
 
 	  switch (nexthop_type)
 	    {
 	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop, s, 16);
+	      stream_get (nexthop, s, 16);
 	      break;
 	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
+	      *ifindex = stream_getl (s);
 	      break;
 	    }
 	}
     }
 
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_DISTANCE))
+    api->distance = stream_getc (s);
   else
-    api.distance = 0;
+    api->distance = 0;
 
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
+  if (CHECK_FLAG (api->message, ZAPI_MESSAGE_METRIC))
+    api->metric = stream_getl (s);
   else
-    api.metric = 0;
-    
-  if (IN6_IS_ADDR_UNSPECIFIED (&nexthop))
-    rib_add_ipv6 (api.type, api.flags, &p, NULL, ifindex, 0, api.metric,
-		  api.distance);
+    api->metric = 0;
+}
+
+static void
+zread_ipv6_route (int command, struct zapi_ipv6 *api, struct prefix_ipv6 *p,
+		  struct in6_addr *nexthop, unsigned long ifindex)
+{
+  if (IN6_IS_ADDR_UNSPECIFIED (nexthop))
+    nexthop = NULL;
+
+  if (command == ZEBRA_IPV6_ROUTE_ADD)
+    rib_add_ipv6 (api->type, api->flags, p, nexthop, ifindex, 0, api->metric,
+		  api->distance);
   else
-    rib_add_ipv6 (api.type, api.flags, &p, &nexthop, ifindex, 0, api.metric,
-		  api.distance);
-  return 0;
+    rib_delete_ipv6 (api->type, api->flags, p, nexthop, ifindex, 0);
 }
 
-/* Zebra server IPv6 prefix delete function. */
+/* Zebra server IPv6 prefix add and delete function. */
 static int
-zread_ipv6_delete (struct zserv *client, u_short length)
+zread_ipv6_add_delete (int command, struct zserv *client, u_short length)
 {
-  int i;
   struct stream *s;
   struct zapi_ipv6 api;
   struct in6_addr nexthop;
@@ -984,55 +1128,53 @@ zread_ipv6_delete (struct zserv *client, u_short length)
   struct prefix_ipv6 p;
   
   s = client->ibuf;
-  ifindex = 0;
-  memset (&nexthop, 0, sizeof (struct in6_addr));
 
   /* Type, flags, message. */
   api.type = stream_getc (s);
   api.flags = stream_getc (s);
   api.message = stream_getc (s);
 
-  /* IPv4 prefix. */
+  /* IPv6 prefix. */
   memset (&p, 0, sizeof (struct prefix_ipv6));
   p.family = AF_INET6;
   p.prefixlen = stream_getc (s);
   stream_get (&p.prefix, s, PSIZE (p.prefixlen));
 
-  /* Nexthop, ifindex, distance, metric. */
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_NEXTHOP))
+  zread_ipv6_nexthop (s, &api, &nexthop, &ifindex);
+  zread_ipv6_route (command, &api, &p, &nexthop, ifindex);
+  return 0;
+}
+
+/* Parse ZEBRA_IPV6_ROUTE_ADD_BULK or ZEBRA_IPV6_ROUTE_DELETE_BULK. */
+static int
+zread_ipv6_bulk (int command, struct zserv *client, u_short length)
+{
+  struct stream *s = client->ibuf;
+  struct zapi_ipv6 api;
+  struct in6_addr nexthop;
+  unsigned long ifindex;
+  struct prefix p;
+  u_int16_t count;
+
+  while (STREAM_READABLE (s) >= 3)
     {
-      u_char nexthop_type;
+      api.type = stream_getc (s);
+      api.flags = stream_getc (s);
+      api.message = stream_getc (s);
+      zread_ipv6_nexthop (s, &api, &nexthop, &ifindex);
 
-      api.nexthop_num = stream_getc (s);
-      for (i = 0; i < api.nexthop_num; i++)
+      for (count = zread_bulk_count (s); count; count--)
 	{
-	  nexthop_type = stream_getc (s);
-
-	  switch (nexthop_type)
+	  if (! zread_bulk_prefix (s, &p, AF_INET6))
 	    {
-	    case ZEBRA_NEXTHOP_IPV6:
-	      stream_get (&nexthop, s, 16);
-	      break;
-	    case ZEBRA_NEXTHOP_IFINDEX:
-	      ifindex = stream_getl (s);
-	      break;
+	      zlog_warn ("%s: malformed message from client %d", __func__,
+			 client->sock);
+	      return -1;
 	    }
+	  zread_ipv6_route (command, &api, (struct prefix_ipv6 *) &p,
+			    &nexthop, ifindex);
 	}
     }
-
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_DISTANCE))
-    api.distance = stream_getc (s);
-  else
-    api.distance = 0;
-  if (CHECK_FLAG (api.message, ZAPI_MESSAGE_METRIC))
-    api.metric = stream_getl (s);
-  else
-    api.metric = 0;
-    
-  if (IN6_IS_ADDR_UNSPECIFIED (&nexthop))
-    rib_delete_ipv6 (api.type, api.flags, &p, NULL, ifindex, 0);
-  else
-    rib_delete_ipv6 (api.type, api.flags, &p, &nexthop, ifindex, 0);
   return 0;
 }
 
@@ -1049,6 +1191,34 @@ zread_ipv6_nexthop_lookup (struct zserv *client, u_short length)
 }
 #endif /* HAVE_IPV6 */
 
+/* Nexthop tracking registration and unregistration. */
+static int
+zread_nexthop_register (int command, struct zserv *client, u_short length)
+{
+  struct prefix p;
+
+  memset (&p, 0, sizeof (struct prefix));
+  p.family = stream_getc (client->ibuf);
+  if (p.family == AF_INET)
+    p.prefixlen = IPV4_MAX_BITLEN;
+#ifdef HAVE_IPV6
+  else if (p.family == AF_INET6)
+    p.prefixlen = IPV6_MAX_BITLEN;
+#endif /* HAVE_IPV6 */
+  else
+    {
+      zlog_warn ("%s: unknown address family %d", __func__, p.family);
+      return -1;
+    }
+  stream_get (&p.u.prefix, client->ibuf, prefix_blen (&p));
+
+  if (command == ZEBRA_NEXTHOP_REGISTER)
+    zebra_nht_register (client, &p);
+  else
+    zebra_nht_unregister (client, &p);
+  return 0;
+}
+
 /* Register zebra server router-id information.  Send current router-id */
 static int
 zread_router_id_add (struct zserv *client, u_short length)
@@ -1075,6 +1245,12 @@ zread_router_id_delete (struct zserv *client, u_short length)
 static void
 zebra_client_close (struct zserv *client)
 {
+  /* Drop its nexthop registrations. */
+  zebra_nht_client_close (client);
+
+  /* Stop sending it routes. */
+  zebra_redistribute_stop (client);
+
   /* Close file descriptor. */
   if (client->sock)
     {
@@ -1087,6 +1263,8 @@ zebra_client_close (struct zserv *client)
     stream_free (client->ibuf);
   if (client->obuf)
     stream_free (client->obuf);
+  if (client->rbuf)
+    stream_free (client->rbuf);
   if (client->wb)
     buffer_free(client->wb);
 
@@ -1115,6 +1293,7 @@ zebra_client_create (int sock)
   client->sock = sock;
   client->ibuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
   client->obuf = stream_new (ZEBRA_MAX_PACKET_SIZ);
+  client->rbuf = stream_new (ZSERV_RBUF_SIZE);
   client->wb = buffer_new(0);
 
   /* Set table number. */
@@ -1127,106 +1306,14 @@ zebra_client_create (int sock)
   zebra_event (ZEBRA_READ, sock, client);
 }
 
-/* Handler of zebra service request. */
-static int
-zebra_client_read (struct thread *thread)
+/* Handle the message in the client's ibuf, the header read. */
+static void
+zebra_client_dispatch (struct zserv *client, uint16_t command,
+		       uint16_t length)
 {
-  int sock;
-  struct zserv *client;
-  size_t already;
-  uint16_t length, command;
-  uint8_t marker, version;
-
-  /* Get thread data.  Reset reading thread because I'm running. */
-  sock = THREAD_FD (thread);
-  client = THREAD_ARG (thread);
-  client->t_read = NULL;
-
-  if (client->t_suicide)
-    {
-      zebra_client_close(client);
-      return -1;
-    }
-
-  /* Read length and command (if we don't have it already). */
-  if ((already = stream_get_endp(client->ibuf)) < ZEBRA_HEADER_SIZE)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     ZEBRA_HEADER_SIZE-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed socket [%d]", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(ZEBRA_HEADER_SIZE-already))
-	{
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-      already = ZEBRA_HEADER_SIZE;
-    }
-
-  /* Reset to read from the beginning of the incoming packet. */
-  stream_set_getp(client->ibuf, 0);
-
-  /* Fetch header values */
-  length = stream_getw (client->ibuf);
-  marker = stream_getc (client->ibuf);
-  version = stream_getc (client->ibuf);
-  command = stream_getw (client->ibuf);
-
-  if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
-    {
-      zlog_err("%s: socket %d version mismatch, marker %d, version %d",
-               __func__, sock, marker, version);
-      zebra_client_close (client);
-      return -1;
-    }
-  if (length < ZEBRA_HEADER_SIZE) 
-    {
-      zlog_warn("%s: socket %d message length %u is less than header size %d",
-	        __func__, sock, length, ZEBRA_HEADER_SIZE);
-      zebra_client_close (client);
-      return -1;
-    }
-  if (length > STREAM_SIZE(client->ibuf))
-    {
-      zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
-	        __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
-      zebra_client_close (client);
-      return -1;
-    }
-
-  /* Read rest of data. */
-  if (already < length)
-    {
-      ssize_t nbyte;
-      if (((nbyte = stream_read_try (client->ibuf, sock,
-				     length-already)) == 0) ||
-	  (nbyte == -1))
-	{
-	  if (IS_ZEBRA_DEBUG_EVENT)
-	    zlog_debug ("connection closed [%d] when reading zebra data", sock);
-	  zebra_client_close (client);
-	  return -1;
-	}
-      if (nbyte != (ssize_t)(length-already))
-        {
-	  /* Try again later. */
-	  zebra_event (ZEBRA_READ, sock, client);
-	  return 0;
-	}
-    }
-
-  length -= ZEBRA_HEADER_SIZE;
-
   /* Debug packet information. */
   if (IS_ZEBRA_DEBUG_EVENT)
-    zlog_debug ("zebra message comes from socket [%d]", sock);
+    zlog_debug ("zebra message comes from socket [%d]", client->sock);
 
   if (IS_ZEBRA_DEBUG_PACKET && IS_ZEBRA_DEBUG_RECV)
     zlog_debug ("zebra message received [%s] %d", 
@@ -1252,12 +1339,24 @@ zebra_client_read (struct thread *thread)
     case ZEBRA_IPV4_ROUTE_DELETE:
       zread_ipv4_delete (client, length);
       break;
+    case ZEBRA_IPV4_ROUTE_ADD_BULK:
+      zread_ipv4_add_bulk (client, length);
+      break;
+    case ZEBRA_IPV4_ROUTE_DELETE_BULK:
+      zread_ipv4_delete_bulk (client, length);
+      break;
 #ifdef HAVE_IPV6
     case ZEBRA_IPV6_ROUTE_ADD:
-      zread_ipv6_add (client, length);
+      zread_ipv6_add_delete (ZEBRA_IPV6_ROUTE_ADD, client, length);
       break;
     case ZEBRA_IPV6_ROUTE_DELETE:
-      zread_ipv6_delete (client, length);
+      zread_ipv6_add_delete (ZEBRA_IPV6_ROUTE_DELETE, client, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_ADD_BULK:
+      zread_ipv6_bulk (ZEBRA_IPV6_ROUTE_ADD, client, length);
+      break;
+    case ZEBRA_IPV6_ROUTE_DELETE_BULK:
+      zread_ipv6_bulk (ZEBRA_IPV6_ROUTE_DELETE, client, length);
       break;
 #endif /* HAVE_IPV6 */
     case ZEBRA_REDISTRIBUTE_ADD:
@@ -1283,19 +1382,118 @@ zebra_client_read (struct thread *thread)
     case ZEBRA_IPV4_IMPORT_LOOKUP:
       zread_ipv4_import_lookup (client, length);
       break;
+    case ZEBRA_NEXTHOP_REGISTER:
+    case ZEBRA_NEXTHOP_UNREGISTER:
+      zread_nexthop_register (command, client, length);
+      break;
     default:
       zlog_info ("Zebra received unknown command %d", command);
       break;
     }
+}
+
+/* Handler of zebra service request.  Reads as much as the client has
+   sent and rbuf will take, and handles every whole message in it,
+   leaving the rest of a message for the next read. */
+static int
+zebra_client_read (struct thread *thread)
+{
+  int sock;
+  struct zserv *client;
+  struct stream *rbuf;
+  ssize_t nbyte;
+  size_t getp;
+  uint16_t length, command;
+  uint8_t marker, version;
+
+  /* Get thread data.  Reset reading thread because I'm running. */
+  sock = THREAD_FD (thread);
+  client = THREAD_ARG (thread);
+  client->t_read = NULL;
+  rbuf = client->rbuf;
 
   if (client->t_suicide)
     {
-      /* No need to wait for thread callback, just kill immediately. */
       zebra_client_close(client);
       return -1;
     }
 
-  stream_reset (client->ibuf);
+  /* Read whatever there is room for after what is left from last
+     time. */
+  stream_pulldown (rbuf);
+  if (STREAM_WRITEABLE (rbuf))
+    {
+      nbyte = stream_read_try (rbuf, sock, STREAM_WRITEABLE (rbuf));
+      if (nbyte == 0 || nbyte == -1)
+	{
+	  if (IS_ZEBRA_DEBUG_EVENT)
+	    zlog_debug ("connection closed socket [%d]", sock);
+	  zebra_client_close (client);
+	  return -1;
+	}
+    }
+
+  while (STREAM_READABLE (rbuf) >= ZEBRA_HEADER_SIZE)
+    {
+      /* Fetch header values */
+      getp = stream_get_getp (rbuf);
+      length = stream_getw_from (rbuf, getp);
+      marker = stream_getc_from (rbuf, getp + 2);
+      version = stream_getc_from (rbuf, getp + 3);
+      command = stream_getw_from (rbuf, getp + 4);
+
+      if (marker != ZEBRA_HEADER_MARKER || version != ZSERV_VERSION)
+	{
+	  zlog_err("%s: socket %d version mismatch, marker %d, version %d",
+		   __func__, sock, marker, version);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (length < ZEBRA_HEADER_SIZE) 
+	{
+	  zlog_warn("%s: socket %d message length %u is less than header size %d",
+		    __func__, sock, length, ZEBRA_HEADER_SIZE);
+	  zebra_client_close (client);
+	  return -1;
+	}
+      if (length > STREAM_SIZE(client->ibuf))
+	{
+	  zlog_warn("%s: socket %d message length %u exceeds buffer size %lu",
+		    __func__, sock, length, (u_long)STREAM_SIZE(client->ibuf));
+	  zebra_client_close (client);
+	  return -1;
+	}
+
+      /* The rest of it is still to come. */
+      if (STREAM_READABLE (rbuf) < length)
+	break;
+
+      /* Handlers read the message from ibuf, where they cannot run
+	 into the next one. */
+      stream_reset (client->ibuf);
+      stream_put (client->ibuf, STREAM_PNT (rbuf), length);
+      stream_forward_getp (rbuf, length);
+      stream_set_getp (client->ibuf, ZEBRA_HEADER_SIZE);
+
+      zebra_client_dispatch (client, command, length - ZEBRA_HEADER_SIZE);
+
+      if (client->t_suicide)
+	{
+	  /* No need to wait for thread callback, just kill immediately. */
+	  zebra_client_close(client);
+	  return -1;
+	}
+
+      /* Let other threads run, and come back for the rest without
+	 waiting for the socket. */
+      if (thread_should_yield (thread))
+	{
+	  client->t_read = thread_add_event (zebrad.master, zebra_client_read,
+					     client, sock);
+	  return 0;
+	}
+    }
+
   zebra_event (ZEBRA_READ, sock, client);
   return 0;
 }
@@ -1551,9 +1749,38 @@ DEFUN (show_zebra_client,
 {
   struct listnode *node;
   struct zserv *client;
+  char buf[BUFSIZ];
+  int type;
 
   for (ALL_LIST_ELEMENTS_RO (zebrad.client_list, node, client))
-    vty_out (vty, "Client fd %d%s", client->sock, VTY_NEWLINE);
+    {
+      vty_out (vty, "Client fd %d, %lu bytes waiting to be written%s",
+	       client->sock, (unsigned long) buffer_pending (client->wb),
+	       VTY_NEWLINE);
+      vty_out (vty, "  Redistribution walks sent %lu routes, "
+	       "waited for the client %lu times%s",
+	       client->redist_dump_routes, client->redist_dump_waits,
+	       VTY_NEWLINE);
+
+      for (type = 0; type < ZEBRA_ROUTE_MAX; type++)
+	if (client->redist_dump[type])
+	  break;
+      if (type == ZEBRA_ROUTE_MAX)
+	continue;
+
+      vty_out (vty, "  Redistributing");
+      for (type = 0; type < ZEBRA_ROUTE_MAX; type++)
+	if (client->redist_dump[type])
+	  vty_out (vty, " %s", zebra_route_string (type));
+      if (client->redist_rn)
+	vty_out (vty, ", at %s/%d",
+		 inet_ntop (client->redist_rn->p.family,
+			    &client->redist_rn->p.u.prefix, buf, BUFSIZ),
+		 client->redist_rn->p.prefixlen);
+      vty_out (vty, ", %s%s",
+	       client->t_redist ? "running" : "waiting for the client",
+	       VTY_NEWLINE);
+    }
   
   return CMD_SUCCESS;
 }
@@ -1704,6 +1931,8 @@ zebra_init (void)
   /* Client list init. */
   zebrad.client_list = list_new ();
 
+  zebra_nht_init ();
+
   /* Make zebra server socket. */
 #ifdef HAVE_TCP_ZEBRA
   zebra_serv ();
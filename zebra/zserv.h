@@ -42,6 +42,9 @@ struct zserv
   struct stream *ibuf;
   struct stream *obuf;
 
+  /* What has been read from the client and not yet handled. */
+  struct stream *rbuf;
+
   /* Buffer of data waiting to be written to client. */
   struct buffer *wb;
 
@@ -61,6 +64,22 @@ struct zserv
   /* Redistribute default route flag. */
   u_char redist_default;
 
+  /* Routes of the types in redist_dump are being sent to the client
+     after ZEBRA_REDISTRIBUTE_ADD, a table walk at a time, and those in
+     redist_dump_next get a walk of their own once this one is done.
+     The walk is at redist_rn, which is kept locked, in table
+     redist_afi. */
+  u_char redist_dump[ZEBRA_ROUTE_MAX];
+  u_char redist_dump_next[ZEBRA_ROUTE_MAX];
+  afi_t redist_afi;
+  struct route_node *redist_rn;
+  struct thread *t_redist;
+
+  /* Routes sent by redistribution walks, and how many times a walk
+     stopped to let the client catch up. */
+  unsigned long redist_dump_routes;
+  unsigned long redist_dump_waits;
+
   /* Interface information. */
   u_char ifinfo;
 
@@ -106,6 +125,9 @@ extern int zsend_interface_update (int, struct zserv *, struct interface *);
 extern int zsend_route_multipath (int, struct zserv *, struct prefix *, 
                                   struct rib *);
 extern int zsend_router_id_update(struct zserv *, struct prefix *);
+extern void zserv_nexthop_encode (struct stream *, struct rib *);
+extern int zsend_nexthop_update (struct zserv *, struct prefix *,
+                                 u_char *, size_t);
 
 extern pid_t pid;
 